@@ -0,0 +1,55 @@
+#ifndef __BENCH_DEVICES_HPP__
+#define __BENCH_DEVICES_HPP__
+
+#include <string>
+#include <vector>
+
+#include "mimicry_openvr/mimicry_app.hpp"
+
+/**
+ * Device table shared by the benchmarks: a typical bimanual setup with
+ * trackers, i.e. two controllers with grip, menu, trigger and trackpad
+ * buttons, and three trackers. Every device is active with a valid,
+ * identity pose.
+ **/
+namespace bench
+{
+
+inline void addButton(VRDevice &dev, ButtonId id, std::string name, bool boolean, bool pressure, bool two_d)
+{
+	VRButton &button(dev.buttons[id]);
+	button.id = id;
+	button.name = name;
+	button.val_types[VRButton::V_BOOLEAN] = boolean;
+	button.val_types[VRButton::V_PRESSURE] = pressure;
+	button.val_types[VRButton::V_2D] = two_d;
+	dev.button_mask |= vr::ButtonMaskFromId(id);
+}
+
+inline std::vector<VRDevice> makeDevices()
+{
+	std::vector<VRDevice> devices(5);
+	const char *names[] = { "left_hand", "right_hand", "tracker_a", "tracker_b", "tracker_c" };
+
+	for (unsigned i = 0; i < devices.size(); ++i) {
+		devices[i].name = names[i];
+		devices[i].role = (i == 0) ? VRDevice::LEFT : (i == 1) ? VRDevice::RIGHT : VRDevice::TRACKER;
+		devices[i].track_pose = true;
+		devices[i].ix = i + 1;
+		devices[i].pose_valid = true;
+		devices[i].pose.quat = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		if (devices[i].role != VRDevice::TRACKER) {
+			addButton(devices[i], vr::k_EButton_Grip, "grip", true, false, false);
+			addButton(devices[i], vr::k_EButton_ApplicationMenu, "menu", true, false, false);
+			addButton(devices[i], vr::k_EButton_Axis1, "trigger", true, true, false);
+			addButton(devices[i], vr::k_EButton_Axis0, "trackpad", true, false, true);
+		}
+	}
+
+	return devices;
+}
+
+} // namespace bench
+
+#endif // __BENCH_DEVICES_HPP__
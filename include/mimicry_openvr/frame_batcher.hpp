@@ -0,0 +1,64 @@
+#ifndef __FRAME_BATCHER_HPP__
+#define __FRAME_BATCHER_HPP__
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Packs the output messages of several consecutive frames into a single
+ * datagram, so that high capture rates don't cost a send per sample. A
+ * batch is sent once it holds max_frames frames, once the next message
+ * doesn't fit, or once its oldest message has waited max_delay_ns.
+ *
+ * Binary messages are packed into a BATCH message (see wire_format.hpp);
+ * JSON messages into a JSON array of the frame objects. Every message in a
+ * batch is kept whole, so receivers decode each one exactly as if it had
+ * arrived on its own.
+ **/
+class FrameBatcher
+{
+public:
+	enum Framing
+	{
+		JSON_ARRAY,
+		WIRE_BATCH
+	};
+
+	FrameBatcher() : m_framing(JSON_ARRAY), m_max_frames(0), m_max_delay_ns(0), m_max_size(0),
+			m_count(0), m_frames(0), m_deadline_ns(0), m_batches(0), m_batched_frames(0) {}
+
+	void configure(Framing framing, unsigned max_frames, int64_t max_delay_ns, size_t max_size);
+	bool enabled() const { return m_max_frames > 1; }
+
+	bool add(const void *data, size_t len, int64_t now_ns);
+	void endFrame() { m_frames++; }
+	bool full() const { return m_frames >= m_max_frames; }
+	bool due(int64_t now_ns) const { return m_count > 0 && now_ns >= m_deadline_ns; }
+	bool empty() const { return m_count == 0; }
+
+	size_t finish();
+	const uint8_t * data() const { return m_buf.data(); }
+	void clear();
+
+	std::string summary() const;
+
+	static size_t overhead(Framing framing);
+
+private:
+	Framing m_framing;
+	unsigned m_max_frames;
+	int64_t m_max_delay_ns;
+	size_t m_max_size;
+
+	std::vector<uint8_t> m_buf;
+	unsigned m_count;		// Messages in the batch
+	unsigned m_frames;		// Frames completed in the batch
+	int64_t m_deadline_ns;	// Monotonic time by which the batch must be sent
+
+	uint64_t m_batches;
+	uint64_t m_batched_frames;
+};
+
+#endif // __FRAME_BATCHER_HPP__
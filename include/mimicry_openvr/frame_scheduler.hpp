@@ -0,0 +1,88 @@
+#ifndef __FRAME_SCHEDULER_HPP__
+#define __FRAME_SCHEDULER_HPP__
+
+#include <string>
+#include <cstdint>
+
+
+/**
+ * Lateness statistics for the frames run by a FrameScheduler. Lateness is
+ * the time between a frame's deadline and the moment the loop actually
+ * woke up for it.
+ **/
+struct FrameStats
+{
+	uint64_t frames;		// Frames run since the last reset
+	uint64_t overruns;		// Frames that woke up a full period or more late
+	uint64_t skipped;		// Deadlines dropped by OverrunPolicy::SKIP
+	uint64_t samples;		// Free-running mode: polls that returned a new sample
+	uint64_t duplicates;	// Free-running mode: polls that returned no new sample
+	int64_t last_ns;
+	int64_t min_ns;
+	int64_t max_ns;
+	double mean_ns;
+	double m2_ns;			// Running sum of squared deviations (Welford)
+
+	double stddevNs() const;
+	std::string summary() const;
+};
+
+/**
+ * Paces a loop against absolute deadlines on CLOCK_MONOTONIC. Deadline n
+ * is always computed as origin + n * period, so wakeup errors and the time
+ * spent between frames never accumulate into drift. The scheduler never
+ * sleeps itself: the owner waits until the time scheduleNextFrame()
+ * returns (on a timerfd, say) and then calls startFrame().
+ *
+ * When configured with a rate of 0, the scheduler instead free-runs: the
+ * caller reports after every poll whether it found a new sample, and the
+ * wait between polls backs off exponentially while only duplicates are
+ * seen. For free-running loops the lateness statistics hold the interval
+ * between new samples.
+ **/
+class FrameScheduler
+{
+public:
+	enum OverrunPolicy
+	{
+		SKIP,		// Drop missed deadlines and resume on the next future one
+		CATCH_UP	// Run missed frames back-to-back until on schedule again
+	};
+
+	static constexpr int64_t MIN_BACKOFF_NS = 20000;
+	static constexpr int64_t MAX_BACKOFF_NS = 1000000;
+
+	FrameScheduler() : m_period_ns(0), m_policy(SKIP), m_origin_ns(0), m_deadline_ns(0), m_frame(0),
+			m_backoff_ns(0), m_last_sample_ns(0) { resetStats(); }
+
+	void configure(double freq_hz, OverrunPolicy policy);
+	void start();
+	int64_t scheduleNextFrame();
+	void startFrame();
+	void reportSample(bool fresh);
+	void resetStats();
+
+	const FrameStats &stats() const { return m_stats; }
+	double periodNs() const { return m_period_ns; }
+	OverrunPolicy policy() const { return m_policy; }
+	bool isFreeRunning() const { return m_period_ns == 0; }
+
+	static int64_t monotonicNow();
+	static int64_t realtimeNow();
+	static bool policyFromName(const std::string &name, OverrunPolicy &policy);
+
+private:
+	double m_period_ns;
+	OverrunPolicy m_policy;
+	int64_t m_origin_ns;
+	int64_t m_deadline_ns;	// Of the frame last scheduled
+	uint64_t m_frame;
+	int64_t m_backoff_ns;
+	int64_t m_last_sample_ns;
+	FrameStats m_stats;
+
+	int64_t deadlineFor(uint64_t frame) const;
+	void recordLateness(int64_t lateness_ns);
+};
+
+#endif // __FRAME_SCHEDULER_HPP__
@@ -0,0 +1,213 @@
+#ifndef __HAPTIC_PROTOCOL_HPP__
+#define __HAPTIC_PROTOCOL_HPP__
+
+#include "mimicry_openvr/wire_format.hpp"
+
+/**
+ * Binary haptic command protocol, accepted on the vibration port alongside
+ * the text commands. Every field is little-endian and packed with no
+ * padding, as in wire_format.hpp.
+ *
+ * Each datagram starts with an 8-byte header:
+ *
+ * 		u32  magic			MAGIC ("MIMH")
+ * 		u8   version		VERSION
+ * 		u8   count			Number of commands in the datagram
+ * 		u16  reserved
+ *
+ * followed by count commands, each a 12-byte fixed part:
+ *
+ * 		u8   op				Op
+ * 		u8   target			Target
+ * 		u8   device			Device slot (schema order) if T_SLOT, or name_len if T_NAME
+ * 		u8   intensity		Strength of the vibration, 255 for full strength
+ * 		u16  on_ms			Length of each burst
+ * 		u16  off_ms			Gap between bursts
+ * 		u16  repeat			Number of bursts, or of plays of the waveform; 0 counting as 1
+ * 		u8   axis			Haptic axis of the device, 0 for most controllers
+ * 		u8   waveform		0 to play bursts, or 1 + the number of a waveform of the
+ * 							parameter file ("_haptic_waveforms"), whose pulses are
+ * 							scaled by intensity. on_ms and off_ms are then ignored
+ *
+ * and, if T_NAME, the configured name of the device (name_len bytes, not
+ * NUL-terminated). OP_STOP ignores every field but the target. A command
+ * with an unknown op or target is skipped, as it may mean something else
+ * to a newer sender.
+ *
+ * Commands are applied in order, so a datagram can stop a device and
+ * start a new pattern on it, or drive both hands at once. A datagram that
+ * ends inside a command is applied up to the last whole command.
+ *
+ * A device holds at most 32 patterns and waveforms that have not ended,
+ * playing or queued (HapticScheduler::MAX_REQUESTS). Commands that would
+ * add more are skipped until some end or the device is stopped.
+ *
+ * Typical use, reading:
+ *
+ * 		mimicry::haptic::CommandReader reader(buf, len);
+ * 		mimicry::haptic::Command cmd;
+ * 		while (reader.next(cmd)) {
+ * 			...
+ * 		}
+ *
+ * and writing:
+ *
+ * 		uint8_t *p(buf);
+ * 		mimicry::haptic::putHeader(p, 1);
+ * 		mimicry::haptic::putCommand(p, cmd);
+ * 		send(sock, buf, p - buf, 0);
+ **/
+namespace mimicry
+{
+namespace haptic
+{
+
+static const uint32_t MAGIC = 0x484D494D;
+static const uint8_t VERSION = 1;
+
+static const size_t HEADER_SIZE = 8;
+static const size_t COMMAND_FIXED_SIZE = 12;
+static const uint8_t MAX_INTENSITY = 255;
+static const unsigned MAX_WAVEFORMS = 255;
+
+enum Op
+{
+	OP_QUEUE = 1,		// Start after the device's last vibration ends
+	OP_OVERLAP = 2,		// Start now, alongside the device's other vibrations
+	OP_REPLACE = 3,		// Stop the device's vibrations and start now
+	OP_STOP = 4			// Stop the device's vibrations
+};
+
+enum Target
+{
+	T_SLOT = 0,
+	T_NAME = 1
+};
+
+/**
+ * A decoded command. name points into the datagram.
+ **/
+struct Command
+{
+	uint8_t op;
+	uint8_t target;
+	uint8_t slot;			// If T_SLOT
+	const char *name;		// If T_NAME
+	uint8_t name_len;
+	uint8_t intensity;
+	uint16_t on_ms;
+	uint16_t off_ms;
+	uint16_t repeat;
+	uint8_t axis;
+	uint8_t waveform;		// 0 for bursts
+};
+
+/**
+ * Check whether a datagram is a binary command datagram rather than a text
+ * command.
+ **/
+inline bool isBinary(const uint8_t *data, size_t len)
+{
+	return len >= HEADER_SIZE && wire::getU32(data) == MAGIC;
+}
+
+/**
+ * Check whether a command has an op and target this version knows.
+ **/
+inline bool isKnown(const Command &cmd)
+{
+	return cmd.op >= OP_QUEUE && cmd.op <= OP_STOP && cmd.target <= T_NAME;
+}
+
+/**
+ * Reads the commands of a datagram in place. Does not allocate or copy,
+ * so the datagram buffer must outlive the reader and its commands.
+ **/
+class CommandReader
+{
+public:
+	CommandReader(const uint8_t *data, size_t len) : m_p(data), m_end(data + len), m_left(0), m_valid(false)
+	{
+		if (isBinary(data, len) && wire::getU8(data + 4) == VERSION) {
+			m_left = wire::getU8(data + 5);
+			m_p += HEADER_SIZE;
+			m_valid = true;
+		}
+	}
+
+	// False if the datagram is not a command datagram of a supported version
+	bool valid() const { return m_valid; }
+
+	bool next(Command &cmd)
+	{
+		if (m_left == 0 || m_end - m_p < (ptrdiff_t)COMMAND_FIXED_SIZE) {
+			return false;
+		}
+
+		cmd.op = wire::getU8(m_p);
+		cmd.target = wire::getU8(m_p + 1);
+		cmd.slot = wire::getU8(m_p + 2);
+		cmd.name = NULL;
+		cmd.name_len = 0;
+		cmd.intensity = wire::getU8(m_p + 3);
+		cmd.on_ms = wire::getU16(m_p + 4);
+		cmd.off_ms = wire::getU16(m_p + 6);
+		cmd.repeat = wire::getU16(m_p + 8);
+		cmd.axis = wire::getU8(m_p + 10);
+		cmd.waveform = wire::getU8(m_p + 11);
+
+		const uint8_t *next(m_p + COMMAND_FIXED_SIZE);
+		if (cmd.target == T_NAME) {
+			cmd.name_len = cmd.slot;
+			if (m_end - next < cmd.name_len) {
+				return false;
+			}
+			cmd.name = (const char *)next;
+			next += cmd.name_len;
+		}
+
+		m_p = next;
+		m_left--;
+		return true;
+	}
+
+private:
+	const uint8_t *m_p;
+	const uint8_t *m_end;
+	unsigned m_left;	// Commands not yet read
+	bool m_valid;
+};
+
+inline void putHeader(uint8_t *&p, uint8_t count)
+{
+	wire::putU32(p, MAGIC);
+	wire::putU8(p, VERSION);
+	wire::putU8(p, count);
+	wire::putU16(p, 0);
+}
+
+/**
+ * Write a command. For T_NAME, the name is written after the fixed part
+ * and cmd.slot is ignored.
+ **/
+inline void putCommand(uint8_t *&p, const Command &cmd)
+{
+	wire::putU8(p, cmd.op);
+	wire::putU8(p, cmd.target);
+	wire::putU8(p, (cmd.target == T_NAME) ? cmd.name_len : cmd.slot);
+	wire::putU8(p, cmd.intensity);
+	wire::putU16(p, cmd.on_ms);
+	wire::putU16(p, cmd.off_ms);
+	wire::putU16(p, cmd.repeat);
+	wire::putU8(p, cmd.axis);
+	wire::putU8(p, cmd.waveform);
+	if (cmd.target == T_NAME) {
+		memcpy(p, cmd.name, cmd.name_len);
+		p += cmd.name_len;
+	}
+}
+
+} // namespace haptic
+} // namespace mimicry
+
+#endif // __HAPTIC_PROTOCOL_HPP__
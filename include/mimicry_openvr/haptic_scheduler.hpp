@@ -0,0 +1,116 @@
+#ifndef __HAPTIC_SCHEDULER_HPP__
+#define __HAPTIC_SCHEDULER_HPP__
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include <openvr.h>
+
+/**
+ * Plays vibration requests on controllers by issuing haptic pulses from a
+ * timer, instead of spinning on TriggerHapticPulse for the length of the
+ * request. The runtime accepts one pulse per device every few ms and each
+ * pulse lasts at most MAX_PULSE_US, so a request of any length becomes one
+ * pulse per PULSE_INTERVAL_NS while it is active.
+ *
+ * Each device has its own list of requests. A request either starts right
+ * away, overlapping the ones already playing (the strongest active request
+ * sets the pulse), or is queued to start when the device's last request
+ * ends. A request may also be a pattern of bursts separated by gaps, which
+ * pulses only during its bursts, or play a waveform: a precomputed pulse
+ * length for every PULSE_INTERVAL_NS step, so that cues such as a short
+ * knock or a rising buzz can be told apart. Requests can be cancelled
+ * singly, per device or all at once. A device holds at most MAX_REQUESTS
+ * requests that have not ended; more are refused, so that a flood of
+ * requests cannot make run() arbitrarily slow.
+ *
+ * The scheduler never blocks or sleeps: the owner waits until
+ * nextDeadline() (along with whatever else it waits for) and then calls
+ * run(). An instance must only be used from one thread.
+ **/
+class HapticScheduler
+{
+public:
+	enum Mode
+	{
+		QUEUE,		// Start after the device's last request ends
+		OVERLAP		// Start now, alongside the device's other requests
+	};
+
+	static constexpr int64_t PULSE_INTERVAL_NS = 5000000;
+	static constexpr unsigned short MAX_PULSE_US = 3999;
+	static constexpr int64_t IDLE = INT64_MAX;	// nextDeadline() with nothing to play
+	static constexpr size_t MAX_REQUESTS = 32;	// Per device, playing or queued
+
+	typedef std::vector<unsigned short> Waveform;	// Pulse length for each PULSE_INTERVAL_NS step
+
+	HapticScheduler() : m_vrs(NULL), m_next_id(1), m_pulses(0) {}
+
+	void setSystem(vr::IVRSystem *vrs) { m_vrs = vrs; }
+
+	uint64_t add(vr::TrackedDeviceIndex_t ix, int64_t now_ns, int64_t duration_ns, Mode mode,
+		unsigned short pulse_us = MAX_PULSE_US, uint32_t axis = 0)
+	{
+		return addPattern(ix, now_ns, duration_ns, 0, 1, mode, pulse_us, axis);
+	}
+	uint64_t addPattern(vr::TrackedDeviceIndex_t ix, int64_t now_ns, int64_t on_ns, int64_t off_ns,
+		unsigned repeat, Mode mode, unsigned short pulse_us = MAX_PULSE_US, uint32_t axis = 0);
+	uint64_t addWaveform(vr::TrackedDeviceIndex_t ix, int64_t now_ns, size_t waveform, unsigned repeat,
+		Mode mode, unsigned short scale_us = MAX_PULSE_US, uint32_t axis = 0);
+
+	size_t defineWaveform(const std::string &name, const Waveform &pulses);
+	int findWaveform(const char *name, size_t len) const;
+	size_t numWaveforms() const { return m_waveforms.size(); }
+	bool cancel(uint64_t id);
+	void cancelDevice(vr::TrackedDeviceIndex_t ix);
+	void cancelAll();
+
+	int64_t run(int64_t now_ns);
+	int64_t nextDeadline() const;
+	bool idle() const;
+	uint64_t pulsesSent() const { return m_pulses; }
+
+private:
+	static const size_t NO_WAVEFORM = SIZE_MAX;
+
+	struct Request
+	{
+		uint64_t id;
+		int64_t start_ns;
+		int64_t end_ns;
+		int64_t on_ns;		// Length of each burst
+		int64_t period_ns;	// Burst plus gap, 0 for a single burst; length of the waveform
+		size_t waveform;	// NO_WAVEFORM for bursts
+		unsigned short pulse_us;	// Of the bursts; pulse the waveform's MAX_PULSE_US is scaled to
+		uint32_t axis;
+	};
+
+	struct Channel
+	{
+		vr::TrackedDeviceIndex_t ix;
+		int64_t next_pulse_ns;	// Earliest time the runtime accepts the next pulse
+		int64_t deadline_ns;	// Next time the channel needs run()
+		std::vector<Request> requests;
+	};
+
+	struct NamedWaveform
+	{
+		std::string name;
+		Waveform pulses;
+	};
+
+	vr::IVRSystem *m_vrs;
+	uint64_t m_next_id;
+	uint64_t m_pulses;
+	std::vector<Channel> m_channels;	// Only devices with pending requests or a recent pulse
+	std::vector<NamedWaveform> m_waveforms;
+
+	uint64_t schedule(vr::TrackedDeviceIndex_t ix, int64_t now_ns, Request &req, int64_t length_ns, Mode mode);
+	Channel &channel(vr::TrackedDeviceIndex_t ix);
+	int64_t channelDeadline(const Channel &chan, int64_t now_ns) const;
+	unsigned short pulseAt(const Request &req, int64_t t_ns) const;
+	int64_t nextOn(const Request &req, int64_t t_ns) const;
+};
+
+#endif // __HAPTIC_SCHEDULER_HPP__
@@ -0,0 +1,91 @@
+#ifndef __IO_RING_HPP__
+#define __IO_RING_HPP__
+
+#include <string>
+#include <cstdint>
+#include <sys/socket.h>
+
+// Defined by <linux/io_uring.h>, which only io_ring.cpp includes
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf_ring;
+
+/**
+ * Minimal io_uring instance on top of the raw system calls, covering what
+ * the output and vibration sockets need: submitting sendmsg requests,
+ * keeping a multishot receive armed with a ring of provided buffers, and
+ * reaping completions from the shared ring without a system call.
+ *
+ * An instance must only be used from one thread. Whether io_uring is
+ * usable is only known at runtime (the kernel may be too old, or the
+ * system calls may be filtered), so open() failing is the signal for the
+ * caller to fall back to plain socket calls.
+ *
+ * Built against kernel headers older than Linux 6.0 (HAVE_IO_URING not
+ * defined), every instance fails to open, with an error saying so.
+ **/
+class IoRing
+{
+public:
+	IoRing();
+	~IoRing() { close(); }
+
+	bool open(unsigned entries, std::string &error);
+	void close();
+	bool isOpen() const { return m_fd >= 0; }
+	int fd() const { return m_fd; }
+
+	// A completion, decoded from the kernel's io_uring_cqe
+	struct Completion
+	{
+		uint64_t user_data;
+		int32_t res;		// Result of the request: a byte count, or a negated errno
+		bool more;			// The (multishot) request stays armed
+		int buffer;			// Provided buffer the data was received into, or -1
+	};
+
+	bool queueSendmsg(int fd, const msghdr *msg, unsigned flags, uint64_t user_data);
+	bool queueRecvMultishot(int fd, uint16_t group, uint64_t user_data);
+	int submit(unsigned wait_nr = 0);
+	int wait(unsigned wait_nr, int64_t timeout_ns);
+	bool nextCompletion(Completion &completion);
+
+	bool setupBuffers(uint16_t group, unsigned count, unsigned size, std::string &error);
+	const uint8_t * buffer(unsigned id) const { return m_buffers + (size_t)id * m_buf_size; }
+	void recycleBuffer(unsigned id);
+
+private:
+	int m_fd;
+	unsigned m_sq_entries;
+	unsigned m_cq_entries;
+
+	void *m_ring;		// SQ and CQ rings, mapped together
+	size_t m_ring_size;
+	io_uring_sqe *m_sqes;
+	size_t m_sqes_size;
+
+	unsigned *m_sq_head;
+	unsigned *m_sq_tail;
+	unsigned *m_sq_mask;
+	unsigned *m_sq_array;
+	unsigned m_sq_local_tail;	// SQEs handed out by getSqe()
+	unsigned m_sq_submitted;	// SQEs passed to the kernel
+
+	unsigned *m_cq_head;
+	unsigned *m_cq_tail;
+	unsigned *m_cq_mask;
+	io_uring_cqe *m_cqes;
+
+	io_uring_buf_ring *m_buf_ring;
+	size_t m_buf_ring_size;
+	uint8_t *m_buffers;
+	size_t m_buffers_size;
+	unsigned m_buf_count;
+	unsigned m_buf_size;
+	uint16_t m_buf_tail;
+
+	io_uring_sqe * getSqe();
+	int enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, size_t arg_size);
+};
+
+#endif // __IO_RING_HPP__
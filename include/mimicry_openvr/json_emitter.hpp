@@ -0,0 +1,107 @@
+#ifndef __JSON_EMITTER_HPP__
+#define __JSON_EMITTER_HPP__
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "mimicry_openvr/json.hpp"
+
+struct VRDevice;
+struct FrameInfo;
+struct Projection;
+
+
+/**
+ * Writes the JSON output frame without building a JSON tree. The layout
+ * of every configured device is compiled once into a list of fixed text
+ * fragments and pointers to the device fields that fill the gaps between
+ * them; emitting a frame only formats those fields into a reusable
+ * buffer.
+ *
+ * The output is byte-identical to buildTree(devices, info, proj).dump():
+ * keys are laid out in the same sorted order and numbers are formatted
+ * with the same routine nlohmann::json uses.
+ *
+ * With a maximum message size set, a frame that doesn't fit is split into
+ * chunks of whole devices. Each chunk is a complete JSON object with its
+ * own copy of the frame info, which then also holds the chunk's index and
+ * the number of chunks in the frame.
+ **/
+class JsonEmitter
+{
+public:
+	static const char *FRAME_KEY; // Key of the frame's sequence number and timestamps
+
+	JsonEmitter() : m_info(NULL), m_frame_tmpl(0), m_max_size(0), m_split(false) {}
+
+	void setMaxMessageSize(size_t bytes) { m_max_size = bytes; }
+	bool compile(const std::vector<VRDevice> &devices, const FrameInfo &info, std::string &error);
+	bool compile(const std::vector<VRDevice> &devices, const FrameInfo &info, const Projection &proj,
+		std::string &error);
+	size_t emit();
+
+	const char * data() const { return m_buffer.data(); }
+
+	// Chunks of the last emitted frame; a frame that fits is a single chunk
+	size_t numChunks() const { return m_chunks.size(); }
+	const char * chunkData(size_t chunk) const;
+	size_t chunkSize(size_t chunk) const { return m_chunks[chunk].second; }
+
+	static nlohmann::json buildTree(const std::vector<VRDevice> &devices, const FrameInfo &info);
+	static nlohmann::json buildTree(const std::vector<VRDevice> &devices, const FrameInfo &info,
+		const Projection &proj);
+	static std::vector<std::string> dumpChunks(const nlohmann::json &frame, size_t max_size, int indent);
+
+private:
+	struct Op
+	{
+		enum Kind
+		{
+			LITERAL,
+			FLOAT,
+			BOOLEAN,
+			UINT64,
+			INT64
+		};
+
+		Kind kind;
+		uint32_t lit_offset;
+		uint32_t lit_len;
+		const void *value;
+	};
+
+	struct DeviceTemplate
+	{
+		std::string key;
+		const VRDevice *dev;	// NULL for the frame info, which is always written
+		std::vector<Op> ops;
+	};
+
+	// Where a device was written in the buffer by the last emit()
+	struct Span
+	{
+		size_t tmpl;
+		size_t offset;
+		size_t len;
+	};
+
+	std::string m_literals;
+	std::vector<DeviceTemplate> m_templates; // Sorted by key
+	std::vector<char> m_buffer;
+
+	const FrameInfo *m_info;
+	size_t m_frame_tmpl;	// Index of the frame info in m_templates
+	size_t m_max_size;		// 0 for no limit
+	bool m_split;			// Whether the chunks are in m_chunk_buffer rather than m_buffer
+	std::vector<Span> m_spans;
+	std::vector<char> m_chunk_buffer;
+	std::vector<std::pair<size_t, size_t>> m_chunks; // Offset and size of each chunk
+
+	void addLiteral(std::vector<Op> &ops, const std::string &text);
+	void addValue(std::vector<Op> &ops, Op::Kind kind, const void *value);
+	void split(size_t len);
+	size_t formatFrameInfo(char *out, size_t chunk, size_t num_chunks) const;
+};
+
+#endif // __JSON_EMITTER_HPP__
@@ -0,0 +1,100 @@
+#ifndef __LOGGER_HPP__
+#define __LOGGER_HPP__
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <cstdint>
+#include <semaphore.h>
+
+
+/**
+ * Tracks how often a repeated message may be logged. Messages arriving
+ * within interval_ns of the last logged one are counted instead, and the
+ * count is reported with the next message that gets through. Not thread
+ * safe; each call site owns its own limiter.
+ **/
+struct RateLimiter
+{
+	int64_t interval_ns;
+	int64_t last_ns;
+	uint64_t suppressed;
+
+	explicit RateLimiter(double interval_s = 1.0) : interval_ns(interval_s * 1e9),
+			last_ns(INT64_MIN), suppressed(0) {}
+};
+
+/**
+ * Severity-filtered logging to stdout that never blocks the caller on I/O.
+ * Messages are copied into a fixed ring of slots shared by all threads and
+ * written out by a background thread, which batches everything queued
+ * into a single write. Claiming slots is lock-free; if the ring is full the
+ * message is dropped and counted rather than waiting for the writer.
+ *
+ * Until start() is called, and after stop(), messages are written
+ * synchronously.
+ **/
+class Logger
+{
+public:
+	enum Level
+	{
+		L_DEBUG,
+		L_INFO,
+		L_WARN,
+		L_ERROR
+	};
+
+	static const size_t SLOT_TEXT = 240;
+	static const size_t NUM_SLOTS = 1024;
+	static const size_t MAX_SLOTS_PER_MESSAGE = NUM_SLOTS / 8; // Longer messages are truncated
+
+	static Logger &instance();
+
+	void start();
+	void stop();
+
+	void setLevel(Level level) { m_level.store(level, std::memory_order_relaxed); }
+	bool enabled(Level level) const { return level >= m_level.load(std::memory_order_relaxed); }
+	uint64_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+	void log(Level level, const char *text, size_t len, int newlines = 1);
+	void log(Level level, const std::string &text, int newlines = 1)
+	{
+		log(level, text.data(), text.size(), newlines);
+	}
+	void logLimited(Level level, RateLimiter &limiter, const char *text);
+
+	static bool levelFromName(const std::string &name, Level &level);
+
+private:
+	struct Slot
+	{
+		std::atomic<uint64_t> seq;
+		uint8_t level;
+		uint8_t newlines;	// Only used on the last slot of a message
+		bool more;			// The message continues in the next slot
+		uint16_t len;
+		char text[SLOT_TEXT];
+	};
+
+	Slot m_slots[NUM_SLOTS];
+	std::atomic<uint64_t> m_enqueue_pos;
+	uint64_t m_dequeue_pos;			// Only touched by the writer thread
+	std::atomic<uint64_t> m_dropped;
+	std::atomic<int> m_level;
+	std::atomic<bool> m_async;
+	std::atomic<bool> m_stopping;
+	sem_t m_pending;
+	std::thread m_writer;
+
+	Logger();
+	Logger(const Logger &) = delete;
+	Logger & operator=(const Logger &) = delete;
+
+	void writerLoop();
+	size_t drain(char *buf, size_t size, bool &continued);
+	static size_t formatPrefix(Level level, char *out);
+};
+
+#endif // __LOGGER_HPP__
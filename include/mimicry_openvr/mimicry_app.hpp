@@ -3,7 +3,10 @@
 
 #include <iostream>
 #include <map>
+#include <vector>
 #include <chrono>
+#include <atomic>
+#include <signal.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 
@@ -13,6 +16,19 @@
 
 #include <openvr.h>
 
+#include "mimicry_openvr/frame_scheduler.hpp"
+#include "mimicry_openvr/frame_batcher.hpp"
+#include "mimicry_openvr/haptic_scheduler.hpp"
+#include "mimicry_openvr/haptic_protocol.hpp"
+#include "mimicry_openvr/io_ring.hpp"
+#include "mimicry_openvr/reactor.hpp"
+#include "mimicry_openvr/wire_encoder.hpp"
+#include "mimicry_openvr/json_emitter.hpp"
+#include "mimicry_openvr/logger.hpp"
+#include "mimicry_openvr/publisher.hpp"
+#include "mimicry_openvr/shm_writer.hpp"
+#include "mimicry_openvr/subscriptions.hpp"
+
 
 typedef vr::TrackedDeviceIndex_t DevIx;
 typedef vr::VRControllerState_t DevState;
@@ -22,18 +38,67 @@ struct VRPose
 {
 	glm::vec3 pos;
 	glm::vec4 quat;
+	glm::vec3 vel;		// Linear velocity, in m/s
+	glm::vec3 ang_vel;	// Angular velocity, in rad/s
+};
+
+/**
+ * Identifies a published frame: every output format carries these so that
+ * consumers can detect loss and measure latency.
+ **/
+struct FrameInfo
+{
+	uint64_t seq = 0;			// Incremented by one for every frame sent
+	int64_t capture_ns = 0;		// CLOCK_REALTIME time the runtime was sampled
+	int64_t pose_time_ns = 0;	// CLOCK_REALTIME time the poses describe
+};
+
+/**
+ * Selects the part of each frame sent to a subscriber: a subset of the
+ * configured devices, and which of their fields to include. The default
+ * selects the same output as the main stream.
+ **/
+struct Projection
+{
+	enum Field
+	{
+		F_POSE = 1 << 0,
+		F_BUTTONS = 1 << 1,
+		F_VELOCITY = 1 << 2
+	};
+
+	uint64_t devices = ~0ull;	// Bit i selects the device in slot i
+	unsigned fields = F_POSE | F_BUTTONS;
+
+	bool hasDevice(size_t slot) const { return (devices >> slot) & 1; }
+	bool hasField(Field field) const { return (fields & field) != 0; }
 };
 
 struct VRButton
 {
+	static const int TYPE_NUM = 3;
+
+	enum ValueType
+	{
+		V_BOOLEAN = 0,
+		V_PRESSURE = 1,
+		V_2D = 2
+	};
+
 	ButtonId id;
 	std::string name;
 	bool pressed;
 	float pressure;
 	glm::vec2 touch_pos;
-	std::map<std::string, bool> val_types;
+	bool val_types[TYPE_NUM] = {};
 
 	static std::map<std::string, ButtonId> KEY_TO_ID;
+
+	static const char * typeName(int type)
+	{
+		static const char *TYPE_NAMES[TYPE_NUM] = { "boolean", "pressure", "2d" };
+		return TYPE_NAMES[type];
+	}
 };
 
 struct VRDevice
@@ -49,30 +114,91 @@ struct VRDevice
 	std::string name;
 	bool track_pose;
 	VRPose pose;
+	bool pose_valid = false;
+	uint32_t packet_num = 0;
 	DeviceRole role;
-	std::map<ButtonId, VRButton *> buttons;
+	DevIx ix = vr::k_unTrackedDeviceIndexInvalid; // Bound OpenVR index, if active
+
+	// Buttons are stored inline and indexed by their OpenVR ID. Only the buttons set in
+	// button_mask (see vr::ButtonMaskFromId) are configured.
+	uint64_t button_mask = 0;
+	VRButton buttons[vr::k_EButton_Max];
+
+	// Axis types (vr::EVRControllerAxisType) read from the runtime for the device index
+	// in props_ix. Refreshed on activation when props_ix doesn't match the new index.
+	DevIx props_ix = vr::k_unTrackedDeviceIndexInvalid;
+	int axis_types[vr::k_unControllerStateAxisCount];
+
+	bool isActive() const { return ix != vr::k_unTrackedDeviceIndexInvalid; }
+	bool hasButton(ButtonId id) const { return (button_mask & vr::ButtonMaskFromId(id)) != 0; }
 };
 
 struct VRParams
 {
+	enum OutputFormat
+	{
+		OUT_JSON,			// Compact, written by JsonEmitter
+		OUT_JSON_PRETTY,	// Indented, built as a JSON tree
+		OUT_BINARY
+	};
+
 	unsigned num_devices;
 	bool bimanual;
 	std::string out_addr;
 	unsigned out_port, vibration_port;
+	std::vector<std::string> out_addrs; // Additional "address:port" or "unix:path" destinations
+	int unix_sndbuf; // in bytes, 0 for the system default
+	std::string mcast_group; // "address:port", or empty
+	unsigned mtu; // Path MTU in bytes, 0 to never split frames
+	Publisher::MulticastOptions mcast;
+	std::string shm_name; // Empty to disable shared memory output
+	unsigned shm_ring_size;
+	std::string control_addr; // Local address of the control socket, empty for every interface
+	unsigned control_port; // 0 to disable subscriptions
+	std::vector<std::string> subscription_dests; // Destinations any client may subscribe
+	unsigned subscription_timeout; // in secs
 	unsigned update_freq;
+	FrameScheduler::OverrunPolicy overrun_policy;
+	bool pose_snapshot;
+	float pose_prediction; // in msecs
+	OutputFormat out_format;
+	unsigned schema_interval; // in msecs
+	unsigned batch_frames; // Frames packed per datagram, 0 or 1 to send each message on its own
+	float batch_latency; // Longest a message waits in a batch, in msecs
+	WireEncoder::DeltaOptions delta; // Binary output only
+	mimicry::wire::PoseFormat pose_format; // Binary output only
+	Logger::Level log_level;
+	bool echo_frames;
+	bool io_uring; // Use io_uring for the output and vibration sockets, if available
+};
 
-	const unsigned NUM_PARAMS = 6;
+/**
+ * Receives every published frame in the same process, alongside the
+ * network output (see MimicryApp::addFrameSink). Both calls are made from
+ * the main loop, so implementations must not block.
+ **/
+class FrameSink
+{
+public:
+	virtual ~FrameSink() {}
+
+	// Called once the configured devices are known, before the first frame
+	virtual bool start(const std::vector<VRDevice> &, std::string &) { return true; }
+	virtual void publish(const std::vector<VRDevice> &devices, const FrameInfo &info) = 0;
 };
 
 class MimicryApp
 {
 public:
-	static bool m_running;
-	
-	MimicryApp() : m_configured(false), m_left_config(false), m_right_config(false),
-			m_left_found(false), m_right_found(false), m_socket(0) {};
+	MimicryApp();
+	~MimicryApp();
 
 	void runMainLoop(std::string params_file);
+	void addFrameSink(FrameSink *sink) { m_sinks.push_back(sink); }
+	// Leave SIGINT and SIGTERM to the host process, which then stops the app with stop()
+	void setHandleSigint(bool handle) { m_handle_sigint = handle; }
+	// Safe to call from any thread, and before runMainLoop() has started
+	void stop();
 
 private:
 	vr::IVRSystem *m_vrs;
@@ -82,35 +208,93 @@ private:
 
 	bool m_left_config;
 	bool m_right_config;
-	int m_socket, m_vibration_socket;
-	sockaddr_in m_address;
+	int m_vibration_socket;
+	uint m_pulse_time; // Duration of a "vibrate" command in msecs
+	IoRing m_vibration_ring; // Only open when io_uring serves the vibration socket
+	bool m_vibration_received;
+	HapticScheduler m_haptics;
+	Publisher m_publisher;
+	ShmWriter m_shm;
+	SubscriptionManager m_subscriptions;
+	std::vector<FrameSink *> m_sinks; // Not owned
+	bool m_handle_sigint;
+	Reactor m_reactor;
+	int m_frame_timer;
+	int m_haptic_timer;
+	int m_signal_fd; // -1 unless the app handles signals
+	std::atomic<bool> m_running; // Cleared once, by stop() or a signal; never set again
+	int m_stop_fd; // Made readable by stop(), to wake the main loop
 	VRParams m_params;
-	std::map<std::string, VRDevice *> m_inactive_dev;
-	std::map<DevIx, VRDevice *> m_devices;
+	// Configured devices, in parameter file order. Sized once by readParameters, so 
+	// pointers into it stay valid for the lifetime of the app.
+	std::vector<VRDevice> m_devices;
+	int m_ix_to_slot[vr::k_unMaxTrackedDeviceCount]; // -1 if no device is bound to the index
+	std::vector<int> m_role_slots[VRDevice::DeviceRole::INVALID];
+	vr::TrackedDevicePose_t m_poses[vr::k_unMaxTrackedDeviceCount];
 
 	std::chrono::duration<double, std::milli> m_refresh_time;
+	FrameScheduler m_scheduler;
+	FrameBatcher m_batcher;
+	WireEncoder m_encoder;
+	JsonEmitter m_emitter;
+	FrameInfo m_frame_info; // Of the frame being built; seq is that of the next frame sent
+	RateLimiter m_inactive_limiter;
+	RateLimiter m_missing_limiter;
+	RateLimiter m_haptic_limiter;
+	int64_t m_last_schema_ns;
 
-	static void handleSigint(int sig);
+	static const uint16_t VIBRATION_BUFFER_GROUP = 0;
 
 	void addDeviceToIndex(VRDevice *dev, DevIx ix);
 	VRDevice * findDevFromRole(VRDevice::DeviceRole role, bool from_active);
+	VRDevice * findDevFromName(const std::string &name);
+	VRDevice * findDevFromName(const char *name, size_t len);
 	DevIx findDevIndexFromRole(VRDevice::DeviceRole role);
 	VRDevice * activateDevice(DevIx ix);
 	void deactivateDevice(DevIx ix);
+	void activateConnectedDevices();
+	void rebindControllers();
+	void cacheDeviceProperties(VRDevice *dev, DevIx ix);
+	void invalidateDeviceProperties(DevIx ix);
 
+	bool configurePublisher();
 	bool appInit(std::string params_file);
 	bool readParameters(std::string filename);
-	void handleInput();
+	bool handleInput();
 	bool processEvent(const vr::VREvent_t &event);
-	void handleVibration();
+	bool setupEventLoop(const sigset_t &signals);
+	void closeEventLoop();
+	void handleFrameTimer();
+	void handleSignal();
+	bool openVibrationSocket();
+	bool openVibrationRing();
+	bool armVibrationRing();
+	void useVibrationSocket();
+	void handleVibrationSocket();
+	void handleVibrationRing();
+	void handleVibrationData(const uint8_t *data, size_t len);
+	void handleHapticCommands(const uint8_t *data, size_t len);
+	void handleVibrationCommand(const std::string &input_data);
+	void runHaptics();
 	
 	void postOutputData();
+	void postJsonData();
+	void postBinaryData();
+	void sendOutput(const void *data, size_t len);
+	void endFrame();
+	void flushBatch();
+	size_t maxMessageSize() const;
+	size_t maxOutputMessageSize() const;
+	FrameBatcher::Framing batchFraming() const
+	{
+		return (m_params.out_format == VRParams::OUT_BINARY) ? FrameBatcher::WIRE_BATCH : FrameBatcher::JSON_ARRAY;
+	}
 };
 
-void printText(std::string text, int newlines, bool flush);
+void printText(std::string text, int newlines, Logger::Level level);
+std::string roleEnumToName(VRDevice::DeviceRole role);
 void handleButtonByProp(VRButton *button, vr::VRControllerAxis_t axis, int prop);
 glm::vec3 getPositionFromPose(vr::HmdMatrix34_t matrix);
 glm::vec4 getOrientationFromPose(vr::HmdMatrix34_t matrix);
-std::string getSocketData(int socket, sockaddr_in &address);
 
 #endif // __MIMICRY_APP_HPP__
\ No newline at end of file
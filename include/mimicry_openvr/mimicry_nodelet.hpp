@@ -0,0 +1,36 @@
+#ifndef __MIMICRY_NODELET_HPP__
+#define __MIMICRY_NODELET_HPP__
+
+#include <thread>
+#include <memory>
+
+#include <nodelet/nodelet.h>
+
+#include "mimicry_openvr/mimicry_app.hpp"
+#include "mimicry_openvr/ros_publisher.hpp"
+
+/**
+ * Runs MimicryApp inside a nodelet manager, publishing the topics described
+ * in ros_publisher.hpp. Nodelets loaded into the same manager receive the
+ * published messages by pointer, without serialization.
+ *
+ * The app runs its own loop on a separate thread, since it keeps its own
+ * schedule. Besides the RosPublisher options, the private parameter
+ * ~config_file names the parameter file: either a path, or a file name
+ * looked up in this package's param_files directory (default
+ * "vive_params.json"). The network output configured there is still sent.
+ **/
+class MimicryNodelet : public nodelet::Nodelet
+{
+public:
+	~MimicryNodelet();
+
+private:
+	MimicryApp m_app;
+	std::unique_ptr<RosPublisher> m_ros;
+	std::thread m_thread;
+
+	void onInit() override;
+};
+
+#endif // __MIMICRY_NODELET_HPP__
@@ -0,0 +1,114 @@
+#ifndef __PUBLISHER_HPP__
+#define __PUBLISHER_HPP__
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include "mimicry_openvr/io_ring.hpp"
+
+/**
+ * Sends every output message to a fixed list of datagram destinations.
+ * Destinations of the same address family share one socket, and a message
+ * is handed to the kernel for all of them with a single sendmmsg call over
+ * a message array built once in open(). Sends never block: a destination
+ * whose send would block, or that the kernel has no buffer space for,
+ * counts the message as dropped.
+ *
+ * A destination may be an IPv4 multicast group, in which case each message
+ * is sent to the group once and the network delivers it to every member.
+ * For consumers on the same host, destinations may also be Unix domain
+ * datagram sockets, either bound to a path or to a name in the abstract
+ * namespace, which skip the IP stack entirely. Queued Unix datagrams are
+ * charged to the sending socket until they are read, so each Unix
+ * destination gets its own socket: a slow reader then only exhausts its
+ * own send buffer and drops its own frames.
+ *
+ * With io_uring enabled and available, a message is instead queued as one
+ * sendmsg request per destination and all of them are submitted, and their
+ * completions collected, with a single system call however many sockets
+ * are involved. If the ring can't be created, open() falls back to
+ * sendmmsg.
+ **/
+class Publisher
+{
+public:
+	struct MulticastOptions
+	{
+		int ttl;				// Hops the datagrams may travel; 1 stays on the local subnet
+		std::string interface;	// Outgoing interface name or IPv4 address; empty for the default route
+		bool loopback;			// Whether receivers on this host get the datagrams too
+
+		MulticastOptions() : ttl(1), loopback(true) {}
+	};
+
+	struct Destination
+	{
+		union
+		{
+			sockaddr_in in;
+			sockaddr_un un;
+		} addr;
+		socklen_t addr_len;
+		int socket;			// Own socket of a Unix destination, -1 for AF_INET
+		bool multicast;
+		std::string label;	// "address:port" or "unix:path", for reporting
+		uint64_t sent;
+		uint64_t dropped;	// Send would block or no buffer space
+		uint64_t errors;	// Any other send error
+	};
+
+	Publisher() : m_socket(-1), m_unix_sndbuf(0), m_use_ring(false) {}
+	~Publisher() { close(); }
+
+	bool addDestination(const std::string &addr, unsigned port, std::string &error);
+	bool addMulticastGroup(const std::string &group, unsigned port, std::string &error);
+	bool addUnixDestination(const std::string &path, std::string &error);
+	void setMulticastOptions(const MulticastOptions &options) { m_mcast = options; }
+	void setUnixSendBuffer(int bytes) { m_unix_sndbuf = bytes; }
+	void setIoUring(bool enable) { m_use_ring = enable; }
+	bool open(std::string &error);
+	void close();
+	void send(const void *data, size_t len);
+
+	const std::vector<Destination> &destinations() const { return m_dests; }
+	std::string summary() const;
+
+	// "io_uring" or "sendmmsg", and why io_uring was not used if it was requested
+	const char * backend() const { return m_ring.isOpen() ? "io_uring" : "sendmmsg"; }
+	const std::string &ringError() const { return m_ring_error; }
+
+	static bool parseEndpoint(const std::string &spec, std::string &addr, unsigned &port);
+
+private:
+	// A run of consecutive messages sent through the same socket
+	struct Batch
+	{
+		int socket;
+		size_t first;
+		size_t count;
+	};
+
+	int m_socket;			// Shared by all AF_INET destinations
+	int m_unix_sndbuf;		// SO_SNDBUF of AF_UNIX sockets; 0 for the system default
+	std::vector<Destination> m_dests;
+	MulticastOptions m_mcast;
+	std::vector<mmsghdr> m_msgs;	// One per destination, grouped by socket, all sharing m_iov
+	std::vector<size_t> m_msg_dests;	// Index in m_dests of each message
+	std::vector<Batch> m_batches;
+	iovec m_iov;
+
+	bool m_use_ring;
+	IoRing m_ring;
+	std::string m_ring_error;
+
+	bool applyMulticastOptions(std::string &error);
+	void sendBatch(const Batch &batch);
+	void sendRing();
+	void countResult(Destination &dest, int err);
+};
+
+#endif // __PUBLISHER_HPP__
@@ -0,0 +1,47 @@
+#ifndef __REACTOR_HPP__
+#define __REACTOR_HPP__
+
+#include <map>
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <signal.h>
+
+/**
+ * Single-threaded event loop on top of epoll. Every input of the app, from
+ * the frame timer to signals and sockets, is a file descriptor registered
+ * with a handler, and one wait() dispatches whatever is ready.
+ *
+ * Also creates the timer, signal and event descriptors that turn time,
+ * signals and wakeups from other threads into readable events.
+ **/
+class Reactor
+{
+public:
+	typedef std::function<void(uint32_t events)> Handler;
+
+	Reactor() : m_epoll_fd(-1) {}
+	~Reactor() { close(); }
+
+	bool open(std::string &error);
+	void close();
+	bool isOpen() const { return m_epoll_fd >= 0; }
+
+	bool add(int fd, uint32_t events, const Handler &handler, std::string &error);
+	void remove(int fd);
+	int wait(int timeout_ms);
+
+	static int createTimer(std::string &error);
+	static void armTimer(int fd, int64_t deadline_ns);
+	static void disarmTimer(int fd);
+	static uint64_t readTimer(int fd);
+	static int createSignalFd(const sigset_t &signals, std::string &error);
+	static int createEventFd(std::string &error);
+	static void notifyEvent(int fd);
+
+private:
+	int m_epoll_fd;
+	std::map<int, Handler> m_handlers;
+};
+
+#endif // __REACTOR_HPP__
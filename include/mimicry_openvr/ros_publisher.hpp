@@ -0,0 +1,70 @@
+#ifndef __ROS_PUBLISHER_HPP__
+#define __ROS_PUBLISHER_HPP__
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <ros/ros.h>
+#include <tf2_ros/transform_broadcaster.h>
+
+#include "mimicry_openvr/mimicry_app.hpp"
+
+/**
+ * Publishes device state as ROS topics, so ROS consumers don't have to
+ * parse the UDP output. For each configured device <name>:
+ *
+ * 		<name>/pose		geometry_msgs/PoseStamped, while its pose is valid
+ * 		<name>/joy		sensor_msgs/Joy, for devices with configured buttons
+ *
+ * and, if enabled, one transform per device (child frame <name>) on /tf.
+ * Joy buttons and axes follow the order of the configured button IDs: one
+ * button per boolean value, then one axis per pressure value and two (x, y)
+ * per 2D value. Their names are stored in the <name>/joy_buttons and
+ * <name>/joy_axes parameters.
+ *
+ * Header stamps are the frame's capture time. Every message is a freshly
+ * allocated shared pointer that is never modified once published, so
+ * subscribers in the same process (see MimicryNodelet) receive it without
+ * serialization or copying.
+ *
+ * Options, read from the given private node handle:
+ *
+ * 		~frame_id (string, "world")	frame of the poses and transforms
+ * 		~publish_pose (bool, true)
+ * 		~publish_joy (bool, true)
+ * 		~publish_tf (bool, false)
+ * 		~queue_size (int, 10)
+ **/
+class RosPublisher : public FrameSink
+{
+public:
+	RosPublisher(const ros::NodeHandle &nh, const ros::NodeHandle &private_nh);
+
+	bool start(const std::vector<VRDevice> &devices, std::string &error) override;
+	void publish(const std::vector<VRDevice> &devices, const FrameInfo &info) override;
+
+private:
+	struct DeviceTopics
+	{
+		ros::Publisher pose;
+		ros::Publisher joy;
+		size_t num_buttons;
+		size_t num_axes;
+	};
+
+	ros::NodeHandle m_nh;
+	std::string m_frame_id;
+	bool m_publish_pose;
+	bool m_publish_joy;
+	bool m_publish_tf;
+	int m_queue_size;
+
+	std::vector<DeviceTopics> m_topics; // By slot
+	std::unique_ptr<tf2_ros::TransformBroadcaster> m_tf; // Only with ~publish_tf
+
+	void publishPose(const VRDevice &dev, const DeviceTopics &topics, const ros::Time &stamp);
+	void publishJoy(const VRDevice &dev, const DeviceTopics &topics, const ros::Time &stamp);
+};
+
+#endif // __ROS_PUBLISHER_HPP__
@@ -0,0 +1,107 @@
+#ifndef __SHM_LAYOUT_HPP__
+#define __SHM_LAYOUT_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Layout of the shared-memory transport (enabled with "_shm_name"). The
+ * segment is a POSIX shm object created by mimicry_control and mapped
+ * read-only by consumers on the same host; see shm_reader.hpp.
+ *
+ * The segment starts with a Segment header describing the configured
+ * devices, followed by a ring of ring_size FrameSlots. Frame n is written
+ * to slot n % ring_size, and `frames` is advanced to n + 1 once it is
+ * complete, so slot (frames - 1) % ring_size always holds the latest frame
+ * while the writer fills the next slot.
+ *
+ * Each slot is protected by a seqlock: its sequence number is odd while
+ * the writer is filling it. A reader copies the slot and accepts the copy
+ * only if the sequence number was even and unchanged across the copy.
+ * Readers never block the writer, and the writer never waits for readers.
+ **/
+namespace mimicry
+{
+namespace shm
+{
+
+static const uint32_t MAGIC = 0x534D494D; // "MIMS"
+static const uint32_t VERSION = 2;
+
+static const unsigned MAX_DEVICES = 16;
+static const unsigned MAX_BUTTONS = 32;
+static const unsigned NAME_LEN = 32;	// Including the terminating NUL
+
+enum DeviceFlags
+{
+	F_ACTIVE = 1 << 0,		// The device is connected and bound to an OpenVR index
+	F_POSE_VALID = 1 << 1
+};
+
+struct ButtonInfo
+{
+	uint8_t id;				// vr::EVRButtonId
+	uint8_t types;			// mimicry::wire::TypeBits of the published values
+	uint8_t reserved[2];
+	char name[NAME_LEN];
+};
+
+struct DeviceInfo
+{
+	char name[NAME_LEN];
+	uint8_t role;			// 0 = left, 1 = right, 2 = tracker
+	uint8_t num_buttons;
+	uint8_t reserved[2];
+	ButtonInfo buttons[MAX_BUTTONS]; // In ascending button ID order
+};
+
+struct ButtonState
+{
+	uint8_t pressed;
+	uint8_t reserved[3];
+	float pressure;
+	float touch[2];
+};
+
+struct DeviceState
+{
+	uint8_t flags;			// DeviceFlags
+	uint8_t reserved[3];
+	uint32_t packet_num;	// Runtime packet number of the button state
+	float pos[3];			// x, y, z
+	float quat[4];			// x, y, z, w
+	ButtonState buttons[MAX_BUTTONS]; // Same order as DeviceInfo::buttons
+};
+
+struct FrameSlot
+{
+	std::atomic<uint32_t> seq;
+	uint32_t num_devices;
+	uint64_t frame;			// Index of the frame held by the slot
+	int64_t publish_ns;		// CLOCK_MONOTONIC time the frame was written
+	int64_t capture_ns;		// CLOCK_REALTIME time the runtime was sampled
+	int64_t pose_time_ns;	// CLOCK_REALTIME time the poses describe
+	DeviceState devices[MAX_DEVICES]; // Indexed by device slot
+};
+
+struct Segment
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t ring_size;
+	uint32_t num_devices;
+	std::atomic<uint64_t> frames; // Number of frames published
+	DeviceInfo devices[MAX_DEVICES];
+	FrameSlot ring[1];		// Actually ring_size slots
+};
+
+inline size_t segmentSize(unsigned ring_size)
+{
+	return sizeof(Segment) + (ring_size - 1) * sizeof(FrameSlot);
+}
+
+} // namespace shm
+} // namespace mimicry
+
+#endif // __SHM_LAYOUT_HPP__
@@ -0,0 +1,190 @@
+#ifndef __SHM_READER_HPP__
+#define __SHM_READER_HPP__
+
+#include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mimicry_openvr/shm_layout.hpp"
+
+/**
+ * Header-only reader for the shared-memory transport described in
+ * shm_layout.hpp. Reads never block and never make a system call: the
+ * segment is mapped once in open(), and a snapshot is a copy of the
+ * configured devices out of a ring slot, validated by the slot's seqlock.
+ *
+ * Typical use:
+ *
+ * 		mimicry::shm::ShmReader reader;
+ * 		mimicry::shm::Snapshot snap;
+ * 		std::string error;
+ * 		if (reader.open("/mimicry", error) && reader.latest(snap)) {
+ * 			const mimicry::shm::DeviceState &dev(snap.devices[0]);
+ * 			if (dev.flags & mimicry::shm::F_POSE_VALID) {
+ * 				float x(dev.pos[0]);
+ * 				...
+ * 			}
+ * 		}
+ **/
+namespace mimicry
+{
+namespace shm
+{
+
+struct Snapshot
+{
+	uint64_t frame;
+	int64_t publish_ns;
+	int64_t capture_ns;
+	int64_t pose_time_ns;
+	uint32_t num_devices;
+	DeviceState devices[MAX_DEVICES];
+};
+
+/**
+ * Copy a ring slot if it holds a complete frame.
+ *
+ * Returns: true if the copy is consistent, false if the writer was filling
+ * 		the slot.
+ **/
+inline bool readSlot(const FrameSlot &slot, Snapshot &out)
+{
+	uint32_t seq(slot.seq.load(std::memory_order_acquire));
+	if (seq & 1) {
+		return false;
+	}
+
+	out.frame = slot.frame;
+	out.publish_ns = slot.publish_ns;
+	out.capture_ns = slot.capture_ns;
+	out.pose_time_ns = slot.pose_time_ns;
+	out.num_devices = slot.num_devices;
+	if (out.num_devices > MAX_DEVICES) {
+		return false;
+	}
+	memcpy(out.devices, slot.devices, out.num_devices * sizeof(DeviceState));
+
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot.seq.load(std::memory_order_relaxed) == seq;
+}
+
+class ShmReader
+{
+public:
+	ShmReader() : m_seg(NULL), m_size(0) {}
+	~ShmReader() { close(); }
+
+	/**
+	 * Map the segment published by mimicry_control.
+	 *
+	 * Params:
+	 * 		name - shm object name, as given by "_shm_name"
+	 * 		error - set to a description of the problem on failure
+	 *
+	 * Returns: true if the segment is mapped and has a supported layout.
+	 **/
+	bool open(const std::string &name, std::string &error)
+	{
+		std::string path(name.empty() || name[0] != '/' ? "/" + name : name);
+		struct stat st;
+
+		close();
+
+		int fd(shm_open(path.c_str(), O_RDONLY, 0));
+		if (fd < 0) {
+			error = "Could not open shared memory segment " + path;
+			return false;
+		}
+
+		if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(Segment)) {
+			::close(fd);
+			error = "Shared memory segment " + path + " is too small";
+			return false;
+		}
+
+		void *addr(mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0));
+		::close(fd);
+		if (addr == MAP_FAILED) {
+			error = "Could not map shared memory segment " + path;
+			return false;
+		}
+
+		m_seg = (const Segment *)addr;
+		m_size = st.st_size;
+
+		if (m_seg->magic != MAGIC || m_seg->version != VERSION || m_seg->ring_size == 0
+				|| m_seg->num_devices > MAX_DEVICES || segmentSize(m_seg->ring_size) > m_size) {
+			close();
+			error = "Unsupported shared memory layout in " + path;
+			return false;
+		}
+
+		return true;
+	}
+
+	void close()
+	{
+		if (m_seg != NULL) {
+			munmap((void *)m_seg, m_size);
+			m_seg = NULL;
+		}
+	}
+
+	unsigned numDevices() const { return m_seg->num_devices; }
+	const DeviceInfo &device(unsigned slot) const { return m_seg->devices[slot]; }
+
+	/**
+	 * Returns: number of frames published so far. The latest is frames() - 1.
+	 **/
+	uint64_t frames() const { return m_seg->frames.load(std::memory_order_acquire); }
+
+	/**
+	 * Take a snapshot of the latest frame. The writer only touches the slot
+	 * after the latest one, so the copy can only be torn if the reader is
+	 * stalled for a whole trip around the ring; a few retries cover that.
+	 *
+	 * Returns: true if a frame was copied, false if none has been published.
+	 **/
+	bool latest(Snapshot &out) const
+	{
+		for (int attempt = 0; attempt < 4; ++attempt) {
+			uint64_t n(frames());
+			if (n == 0) {
+				return false;
+			}
+			if (readFrame(n - 1, out)) {
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	/**
+	 * Copy a specific frame out of the ring, for readers that want every
+	 * frame rather than the latest one.
+	 *
+	 * Returns: true if the frame was copied, false if it has not been
+	 * 		published yet or has already been overwritten.
+	 **/
+	bool readFrame(uint64_t frame, Snapshot &out) const
+	{
+		if (frame >= frames()) {
+			return false;
+		}
+
+		return readSlot(m_seg->ring[frame % m_seg->ring_size], out) && out.frame == frame;
+	}
+
+private:
+	const Segment *m_seg;
+	size_t m_size;
+};
+
+} // namespace shm
+} // namespace mimicry
+
+#endif // __SHM_READER_HPP__
@@ -0,0 +1,43 @@
+#ifndef __SHM_WRITER_HPP__
+#define __SHM_WRITER_HPP__
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "mimicry_openvr/shm_layout.hpp"
+
+struct VRDevice;
+struct FrameInfo;
+
+/**
+ * Publishes device state into the shared-memory ring described in
+ * shm_layout.hpp. The segment is created and its device table filled in
+ * once by open(); publishing a frame is a plain copy into the next ring
+ * slot, without system calls or allocation.
+ **/
+class ShmWriter
+{
+public:
+	static constexpr unsigned DEFAULT_RING_SIZE = 64;
+
+	ShmWriter() : m_seg(NULL), m_size(0), m_frame(0) {}
+	~ShmWriter() { close(); }
+
+	bool open(const std::string &name, const std::vector<VRDevice> &devices, unsigned ring_size,
+		std::string &error);
+	void publish(const std::vector<VRDevice> &devices, const FrameInfo &info);
+	void close();
+
+	bool isOpen() const { return m_seg != NULL; }
+
+private:
+	mimicry::shm::Segment *m_seg;
+	size_t m_size;
+	std::string m_path;
+	uint64_t m_frame;
+	// Configured button IDs of each device, in DeviceInfo order
+	std::vector<uint8_t> m_button_ids[mimicry::shm::MAX_DEVICES];
+};
+
+#endif // __SHM_WRITER_HPP__
@@ -0,0 +1,75 @@
+#ifndef __SUBSCRIPTIONS_HPP__
+#define __SUBSCRIPTIONS_HPP__
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <netinet/in.h>
+
+#include "mimicry_openvr/json.hpp"
+
+struct VRDevice;
+struct FrameInfo;
+
+/**
+ * Serves the subscription control channel (enabled with "_control_port").
+ * A client sends a JSON request to the control socket and receives its
+ * own stream of frames: a subset of the devices and of their fields, at a
+ * rate of its choosing up to the update rate, in either output format, to
+ * a UDP or Unix socket destination of its choosing.
+ *
+ * A subscriber's plan is built once when it subscribes: an emitter or
+ * encoder compiled for its projection and its own publisher. Publishing a
+ * frame then only visits the subscribers that are due, so a slow dashboard
+ * costs the loop nothing on the frames it skips.
+ *
+ * Requests are unauthenticated, so a client may only have frames sent to
+ * its own address, or to the destinations configured with
+ * setAllowedDestinations(). Unix destinations must always be configured.
+ *
+ * Subscriptions are leases. A client has to repeat its request before the
+ * timeout runs out, or its stream stops; a repeated identical request
+ * only renews the lease.
+ **/
+class SubscriptionManager
+{
+public:
+	static const unsigned MAX_SUBSCRIBERS = 32;
+
+	SubscriptionManager();
+	~SubscriptionManager();
+
+	bool open(const std::string &addr, unsigned port, unsigned timeout_s, unsigned schema_interval,
+		size_t max_message_size, std::string &error);
+	void close();
+	// "address:port" or "unix:path" destinations any client may subscribe
+	void setAllowedDestinations(const std::vector<std::string> &destinations) { m_allowed = destinations; }
+	bool isOpen() const { return m_socket >= 0; }
+	int fd() const { return m_socket; }
+
+	void handleRequests(const std::vector<VRDevice> &devices, unsigned update_freq);
+	void expire(int64_t now);
+	void publish(const std::vector<VRDevice> &devices, const FrameInfo &info);
+
+	size_t numSubscribers() const { return m_subs.size(); }
+	std::string summary() const;
+
+private:
+	struct Subscriber;
+
+	int m_socket;
+	int64_t m_timeout_ns;
+	int64_t m_schema_interval_ns;
+	size_t m_max_message_size;	// 0 to never split frames
+	uint64_t m_accepted;	// Subscriptions accepted since open(), not counting renewals
+	std::vector<std::string> m_allowed;
+	std::vector<std::unique_ptr<Subscriber>> m_subs;
+
+	nlohmann::json subscribe(const nlohmann::json &req, const sockaddr_in &from,
+		const std::vector<VRDevice> &devices, unsigned update_freq);
+	nlohmann::json unsubscribe(const nlohmann::json &req, const sockaddr_in &from);
+	bool isAllowed(const std::string &destination, const sockaddr_in &from) const;
+};
+
+#endif // __SUBSCRIPTIONS_HPP__
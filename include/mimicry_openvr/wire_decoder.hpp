@@ -0,0 +1,446 @@
+#ifndef __WIRE_DECODER_HPP__
+#define __WIRE_DECODER_HPP__
+
+#include "mimicry_openvr/wire_quantize.hpp"
+
+/**
+ * Header-only decoder for the binary output protocol described in
+ * wire_format.hpp. All readers are views into the received datagram: they
+ * do not allocate or copy, so the datagram buffer must outlive them.
+ *
+ * Typical use:
+ *
+ * 		mimicry::wire::Header hdr;
+ * 		if (mimicry::wire::parseHeader(buf, len, hdr) && hdr.type == mimicry::wire::MSG_FRAME) {
+ * 			mimicry::wire::FrameReader frame(buf, len);
+ * 			mimicry::wire::DeviceRecord rec;
+ * 			uint64_t seq(frame.seq());
+ * 			while (frame.next(rec)) {
+ * 				float x(rec.pos(0));
+ * 				...
+ * 			}
+ * 		}
+ **/
+namespace mimicry
+{
+namespace wire
+{
+
+struct Header
+{
+	uint8_t version;
+	uint8_t type;
+	uint8_t chunk;
+	uint8_t num_chunks;
+	uint32_t schema_id;
+	uint16_t count;
+	uint16_t pose_format;	// PoseFormat word
+};
+
+/**
+ * Validate and parse the header of a datagram.
+ *
+ * Returns: true if the datagram is a supported mimicry message, false
+ * 		otherwise.
+ **/
+inline bool parseHeader(const uint8_t *data, size_t len, Header &hdr)
+{
+	if (len < HEADER_SIZE || getU32(data) != MAGIC) {
+		return false;
+	}
+
+	hdr.version = getU8(data + 4);
+	hdr.type = getU8(data + 5);
+	hdr.chunk = getU8(data + 6);
+	hdr.num_chunks = getU8(data + 7);
+	hdr.schema_id = getU32(data + 8);
+	hdr.count = getU16(data + 12);
+	hdr.pose_format = getU16(data + 14);
+
+	return hdr.version == VERSION;
+}
+
+/**
+ * Read the position of a device entry, in either pose encoding.
+ **/
+inline void readPosition(const uint8_t *p, const PoseFormat &fmt, float out[3])
+{
+	if (fmt.quantized()) {
+		getPosition(p, fmt, out);
+		return;
+	}
+
+	for (unsigned i = 0; i < 3; ++i) {
+		out[i] = getF32(p + 4 * i);
+	}
+}
+
+/**
+ * Read the orientation of a device entry, in either pose encoding.
+ **/
+inline void readOrientation(const uint8_t *p, const PoseFormat &fmt, float out[4])
+{
+	if (fmt.quantized()) {
+		getOrientation(p, fmt, out);
+		return;
+	}
+
+	for (unsigned i = 0; i < 4; ++i) {
+		out[i] = getF32(p + 4 * i);
+	}
+}
+
+/**
+ * One device entry of a FRAME message.
+ **/
+class DeviceRecord
+{
+public:
+	uint8_t slot() const { return getU8(m_p); }
+	uint8_t flags() const { return getU8(m_p + 1); }
+	bool poseValid() const { return (flags() & F_POSE_VALID) != 0; }
+	uint8_t numAnalog() const { return getU8(m_p + 2); }
+	uint32_t pressed() const { return getU32(m_p + 4); }
+	bool pressed(unsigned button) const { return (pressed() >> button) & 1; }
+	float pos(unsigned axis) const { float out[3]; position(out); return out[axis]; }
+	float quat(unsigned axis) const { float out[4]; orientation(out); return out[axis]; }
+	bool hasVelocity() const { return (flags() & F_VELOCITY) != 0; }
+	float vel(unsigned axis) const { return getF32(m_p + velocityOffset() + 4 * axis); }
+	float angVel(unsigned axis) const { return getF32(m_p + velocityOffset() + 12 + 4 * axis); }
+	float analog(unsigned i) const { return getF32(m_p + analogOffset() + 4 * i); }
+	size_t size() const { return analogOffset() + 4 * numAnalog(); }
+
+	// x, y, z, unpacking quantized poses
+	void position(float out[3]) const { readPosition(m_p + RECORD_PREFIX_SIZE, m_fmt, out); }
+
+	// x, y, z, w, unpacking quantized poses
+	void orientation(float out[4]) const
+	{
+		readOrientation(m_p + RECORD_PREFIX_SIZE + m_fmt.positionSize(), m_fmt, out);
+	}
+
+private:
+	const uint8_t *m_p;
+	PoseFormat m_fmt;
+
+	size_t velocityOffset() const { return RECORD_PREFIX_SIZE + m_fmt.poseSize(); }
+	size_t analogOffset() const { return velocityOffset() + (hasVelocity() ? RECORD_VELOCITY_SIZE : 0); }
+
+	friend class FrameReader;
+};
+
+/**
+ * Iterates over the device entries of a FRAME message.
+ **/
+class FrameReader
+{
+public:
+	FrameReader(const uint8_t *data, size_t len) : m_cur(data + HEADER_SIZE + FRAME_INFO_SIZE),
+			m_end(data + len), m_remaining(0), m_seq(0), m_capture_ns(0), m_pose_time_ns(0)
+	{
+		Header hdr;
+		if (parseHeader(data, len, hdr) && hdr.type == MSG_FRAME
+				&& len >= HEADER_SIZE + FRAME_INFO_SIZE) {
+			m_fmt = PoseFormat::fromWord(hdr.pose_format);
+			m_remaining = m_fmt.valid() ? hdr.count : 0;
+			m_seq = getU64(data + HEADER_SIZE);
+			m_capture_ns = getU64(data + HEADER_SIZE + 8);
+			m_pose_time_ns = getU64(data + HEADER_SIZE + 16);
+		}
+	}
+
+	uint64_t seq() const { return m_seq; }
+	int64_t captureNs() const { return m_capture_ns; }
+	int64_t poseTimeNs() const { return m_pose_time_ns; }
+
+	/**
+	 * Move to the next device entry.
+	 *
+	 * Returns: true if rec now refers to a complete entry, false if there
+	 * 		are no more entries or the datagram is truncated.
+	 **/
+	bool next(DeviceRecord &rec)
+	{
+		if (m_remaining == 0 || m_end - m_cur < (ptrdiff_t)(RECORD_PREFIX_SIZE + m_fmt.poseSize())) {
+			return false;
+		}
+
+		rec.m_p = m_cur;
+		rec.m_fmt = m_fmt;
+		if (m_end - m_cur < (ptrdiff_t)rec.size()) {
+			return false;
+		}
+
+		m_cur += rec.size();
+		m_remaining--;
+		return true;
+	}
+
+private:
+	const uint8_t *m_cur;
+	const uint8_t *m_end;
+	unsigned m_remaining;
+	uint64_t m_seq;
+	int64_t m_capture_ns;
+	int64_t m_pose_time_ns;
+	PoseFormat m_fmt;
+};
+
+/**
+ * One device entry of a DELTA message. Only the fields flagged in changes()
+ * are present; the others keep their keyframe values.
+ **/
+class DeltaRecord
+{
+public:
+	uint8_t slot() const { return getU8(m_p); }
+	uint8_t changes() const { return getU8(m_p + 1); }
+	bool has(DeltaBits bit) const { return (changes() & bit) != 0; }
+	bool removed() const { return has(D_REMOVED); }
+	uint8_t numAnalog() const { return has(D_ANALOG) ? getU8(m_p + 2) : 0; }
+	float pos(unsigned axis) const { float out[3]; position(out); return out[axis]; }
+	float quat(unsigned axis) const { float out[4]; orientation(out); return out[axis]; }
+	float vel(unsigned axis) const { return getF32(m_p + offset(D_VELOCITY) + 4 * axis); }
+	float angVel(unsigned axis) const { return getF32(m_p + offset(D_VELOCITY) + 12 + 4 * axis); }
+	uint32_t pressed() const { return getU32(m_p + offset(D_BUTTONS)); }
+	float analog(unsigned i) const { return getF32(m_p + offset(D_ANALOG) + 4 * i); }
+	size_t size() const { return offset(D_ANALOG) + 4 * numAnalog(); }
+
+	void position(float out[3]) const { readPosition(m_p + offset(D_POSITION), m_fmt, out); }
+	void orientation(float out[4]) const { readOrientation(m_p + offset(D_ORIENTATION), m_fmt, out); }
+
+private:
+	const uint8_t *m_p;
+	PoseFormat m_fmt;
+
+	/**
+	 * Returns: offset of a field within the entry, i.e. the size of the
+	 * 		fixed part and of the present fields that precede it.
+	 **/
+	size_t offset(DeltaBits field) const
+	{
+		static const DeltaBits order[] = { D_POSITION, D_ORIENTATION, D_VELOCITY, D_BUTTONS };
+		const size_t sizes[] = { m_fmt.positionSize(), m_fmt.orientationSize(), RECORD_VELOCITY_SIZE, 4 };
+		size_t off(DELTA_RECORD_FIXED_SIZE);
+
+		for (unsigned i = 0; i < 4 && order[i] != field; ++i) {
+			off += has(order[i]) ? sizes[i] : 0;
+		}
+
+		return off;
+	}
+
+	friend class DeltaReader;
+};
+
+/**
+ * Iterates over the device entries of a DELTA message.
+ **/
+class DeltaReader
+{
+public:
+	DeltaReader(const uint8_t *data, size_t len) : m_cur(data + HEADER_SIZE + DELTA_INFO_SIZE),
+			m_end(data + len), m_remaining(0), m_seq(0), m_capture_ns(0), m_pose_time_ns(0),
+			m_key_seq(0), m_valid(false)
+	{
+		Header hdr;
+		if (parseHeader(data, len, hdr) && hdr.type == MSG_DELTA
+				&& len >= HEADER_SIZE + DELTA_INFO_SIZE) {
+			m_remaining = hdr.count;
+			m_seq = getU64(data + HEADER_SIZE);
+			m_capture_ns = getU64(data + HEADER_SIZE + 8);
+			m_pose_time_ns = getU64(data + HEADER_SIZE + 16);
+			m_key_seq = getU64(data + HEADER_SIZE + FRAME_INFO_SIZE);
+			m_fmt = PoseFormat::fromWord(hdr.pose_format);
+			m_valid = m_fmt.valid();
+		}
+	}
+
+	bool valid() const { return m_valid; }
+	uint64_t seq() const { return m_seq; }
+	int64_t captureNs() const { return m_capture_ns; }
+	int64_t poseTimeNs() const { return m_pose_time_ns; }
+	uint64_t keySeq() const { return m_key_seq; }
+
+	/**
+	 * Move to the next device entry.
+	 *
+	 * Returns: true if rec now refers to a complete entry, false if there
+	 * 		are no more entries or the datagram is truncated.
+	 **/
+	bool next(DeltaRecord &rec)
+	{
+		if (!m_valid || m_remaining == 0 || m_end - m_cur < (ptrdiff_t)DELTA_RECORD_FIXED_SIZE) {
+			return false;
+		}
+
+		rec.m_p = m_cur;
+		rec.m_fmt = m_fmt;
+		if (m_end - m_cur < (ptrdiff_t)rec.size()) {
+			return false;
+		}
+
+		m_cur += rec.size();
+		m_remaining--;
+		return true;
+	}
+
+private:
+	const uint8_t *m_cur;
+	const uint8_t *m_end;
+	unsigned m_remaining;
+	uint64_t m_seq;
+	int64_t m_capture_ns;
+	int64_t m_pose_time_ns;
+	uint64_t m_key_seq;
+	PoseFormat m_fmt;
+	bool m_valid;
+};
+
+struct SchemaButton
+{
+	uint8_t id;			// vr::EVRButtonId
+	uint8_t types;		// TypeBits
+	const char *name;	// Not NUL-terminated
+	uint8_t name_len;
+	uint8_t analog_offset; // Index of the button's first value in DeviceRecord::analog
+};
+
+/**
+ * One device entry of a SCHEMA message.
+ **/
+class SchemaDevice
+{
+public:
+	uint8_t slot() const { return getU8(m_p); }
+	uint8_t role() const { return getU8(m_p + 1); }
+	uint8_t numButtons() const { return getU8(m_p + 2); }
+	uint8_t nameLen() const { return getU8(m_p + 3); }
+	const char * name() const { return (const char *)(m_p + 4); }
+
+	/**
+	 * Look up a button by its position in the schema, which is also its bit
+	 * in DeviceRecord::pressed.
+	 *
+	 * Returns: true if the button exists, false otherwise.
+	 **/
+	bool button(unsigned ix, SchemaButton &out) const
+	{
+		const uint8_t *p(m_p + 4 + nameLen());
+		uint8_t analog(0);
+
+		if (ix >= numButtons()) {
+			return false;
+		}
+
+		for (unsigned i = 0; ; ++i) {
+			out.id = getU8(p);
+			out.types = getU8(p + 1);
+			out.name_len = getU8(p + 2);
+			out.name = (const char *)(p + 3);
+			out.analog_offset = analog;
+
+			if (i == ix) {
+				return true;
+			}
+
+			analog += analogCount(out.types);
+			p += 3 + out.name_len;
+		}
+	}
+
+private:
+	const uint8_t *m_p;
+
+	friend class SchemaReader;
+};
+
+/**
+ * Iterates over the device entries of a SCHEMA message.
+ **/
+class SchemaReader
+{
+public:
+	SchemaReader(const uint8_t *data, size_t len) : m_cur(data + HEADER_SIZE), m_end(data + len),
+			m_remaining(0)
+	{
+		Header hdr;
+		if (parseHeader(data, len, hdr) && hdr.type == MSG_SCHEMA) {
+			m_remaining = hdr.count;
+		}
+	}
+
+	bool next(SchemaDevice &dev)
+	{
+		if (m_remaining == 0 || m_end - m_cur < 4) {
+			return false;
+		}
+
+		// Walk the entry once to make sure it is complete
+		const uint8_t *p(m_cur + 4 + getU8(m_cur + 3));
+		for (unsigned i = 0; i < getU8(m_cur + 2); ++i) {
+			if (m_end - p < 3) {
+				return false;
+			}
+			p += 3 + getU8(p + 2);
+		}
+		if (p > m_end) {
+			return false;
+		}
+
+		dev.m_p = m_cur;
+		m_cur = p;
+		m_remaining--;
+		return true;
+	}
+
+private:
+	const uint8_t *m_cur;
+	const uint8_t *m_end;
+	unsigned m_remaining;
+};
+
+/**
+ * Iterates over the messages packed into a BATCH message. Each one is a
+ * complete message, to be read with parseHeader() and the readers above.
+ **/
+class BatchReader
+{
+public:
+	BatchReader(const uint8_t *data, size_t len) : m_cur(data + HEADER_SIZE), m_end(data + len),
+			m_remaining(0)
+	{
+		Header hdr;
+		if (parseHeader(data, len, hdr) && hdr.type == MSG_BATCH) {
+			m_remaining = hdr.count;
+		}
+	}
+
+	bool next(const uint8_t *&msg, size_t &len)
+	{
+		if (m_remaining == 0 || m_end - m_cur < (ptrdiff_t)BATCH_ENTRY_PREFIX_SIZE) {
+			return false;
+		}
+
+		size_t size(getU16(m_cur));
+		if ((size_t)(m_end - m_cur) - BATCH_ENTRY_PREFIX_SIZE < size) {
+			return false;
+		}
+
+		msg = m_cur + BATCH_ENTRY_PREFIX_SIZE;
+		len = size;
+		m_cur += BATCH_ENTRY_PREFIX_SIZE + size;
+		m_remaining--;
+		return true;
+	}
+
+private:
+	const uint8_t *m_cur;
+	const uint8_t *m_end;
+	unsigned m_remaining;
+};
+
+} // namespace wire
+} // namespace mimicry
+
+#endif // __WIRE_DECODER_HPP__
@@ -0,0 +1,119 @@
+#ifndef __WIRE_ENCODER_HPP__
+#define __WIRE_ENCODER_HPP__
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "mimicry_openvr/wire_quantize.hpp"
+
+struct VRButton;
+struct VRDevice;
+struct FrameInfo;
+struct Projection;
+
+/**
+ * Builds SCHEMA and FRAME messages of the binary output protocol (see
+ * wire_format.hpp) for a fixed set of configured devices. Both buffers
+ * are sized once in configure(), so encoding a frame does not allocate.
+ *
+ * With a maximum message size set, schemas and frames that don't fit are
+ * split into chunks of whole device entries. The schema is split once in
+ * configure(); a frame only when it is encoded too large, so frames of a
+ * few devices are sent as a single message.
+ *
+ * With delta encoding enabled, only keyframes are full FRAME messages; the
+ * frames in between are DELTA messages holding the fields that moved away
+ * from the last keyframe by more than their epsilon.
+ *
+ * Poses are encoded as floats unless a quantized pose format is set with
+ * setPoseFormat() before configure().
+ **/
+class WireEncoder
+{
+public:
+	struct DeltaOptions
+	{
+		unsigned keyframe_frames;	// Frames from one keyframe to the next, 0 for no limit
+		unsigned keyframe_ms;		// Time from one keyframe to the next, 0 for no limit
+		float position_epsilon;		// m
+		float orientation_epsilon;	// Per quaternion component
+		float velocity_epsilon;		// m/s and rad/s
+		float analog_epsilon;
+
+		DeltaOptions() : keyframe_frames(0), keyframe_ms(0), position_epsilon(0.0f),
+			orientation_epsilon(0.0f), velocity_epsilon(0.0f), analog_epsilon(0.0f) {}
+
+		bool enabled() const { return keyframe_frames != 0 || keyframe_ms != 0; }
+	};
+
+	WireEncoder() : m_schema_id(0), m_devices(~0ull), m_fields(0), m_max_size(0), m_split(false),
+		m_have_key(false), m_key_seq(0), m_key_ns(0), m_since_key(0) {}
+
+	void setMaxMessageSize(size_t bytes) { m_max_size = bytes; }
+	void setDelta(const DeltaOptions &options) { m_delta = options; m_have_key = false; }
+	void setPoseFormat(const mimicry::wire::PoseFormat &format) { m_pose = format; }
+	bool configure(const std::vector<VRDevice> &devices, std::string &error);
+	bool configure(const std::vector<VRDevice> &devices, const Projection &proj, std::string &error);
+	size_t encodeFrame(const std::vector<VRDevice> &devices, const FrameInfo &info);
+
+	size_t numSchemaChunks() const { return m_schema_chunks.size(); }
+	const uint8_t * schemaData(size_t chunk = 0) const { return m_schema.data() + m_schema_chunks[chunk].first; }
+	size_t schemaSize(size_t chunk = 0) const { return m_schema_chunks[chunk].second; }
+	const uint8_t * frameData() const { return m_frame.data(); }
+	uint32_t schemaId() const { return m_schema_id; }
+
+	// Chunks of the last encoded frame; a frame that fits is a single chunk
+	size_t numFrameChunks() const { return m_frame_chunks.size(); }
+	const uint8_t * frameChunkData(size_t chunk) const;
+	size_t frameChunkSize(size_t chunk) const { return m_frame_chunks[chunk].second; }
+
+	static uint8_t buttonTypeBits(const VRButton &button);
+
+private:
+	// Published values of a device, as last sent in a keyframe
+	struct DeviceValues
+	{
+		bool valid;
+		uint8_t num_analog;
+		uint32_t pressed;
+		float pos[3];
+		float quat[4];
+		float vel[6];	// Linear, then angular
+		float analog[mimicry::wire::MAX_BUTTONS * 3];
+	};
+
+	std::vector<uint8_t> m_schema;
+	std::vector<uint8_t> m_frame;
+	uint32_t m_schema_id;
+	uint64_t m_devices;	// Projection::devices
+	unsigned m_fields;	// Projection::fields
+	size_t m_max_size;	// 0 for no limit
+	bool m_split;		// Whether the frame chunks are in m_chunk_buffer rather than m_frame
+
+	std::vector<std::pair<size_t, size_t>> m_schema_chunks;	// Offset and size in m_schema
+	std::vector<size_t> m_records;		// Offset of each record of the last frame in m_frame
+	std::vector<uint8_t> m_chunk_buffer;
+	std::vector<std::pair<size_t, size_t>> m_frame_chunks;	// Offset and size of each chunk
+
+	mimicry::wire::PoseFormat m_pose;
+	DeltaOptions m_delta;
+	std::vector<DeviceValues> m_key;	// By slot
+	bool m_have_key;
+	uint64_t m_key_seq;
+	int64_t m_key_ns;		// capture_ns of the keyframe
+	unsigned m_since_key;	// Deltas sent since the keyframe
+
+	uint64_t buttonMask(const VRDevice &dev) const;
+	bool splitSchema(const std::vector<size_t> &entries, uint16_t count, std::string &error);
+	void splitFrame(size_t len, mimicry::wire::MsgType type, size_t info_size);
+	bool keyframeDue(const FrameInfo &info) const;
+	void readValues(const VRDevice &dev, DeviceValues &vals) const;
+	uint8_t changedFields(const DeviceValues &vals, const DeviceValues &key) const;
+	void putPosition(uint8_t *&p, const DeviceValues &vals) const;
+	void putOrientation(uint8_t *&p, const DeviceValues &vals) const;
+	void putRecord(uint8_t *&p, size_t slot, const DeviceValues &vals) const;
+	void putDelta(uint8_t *&p, size_t slot, uint8_t changes, const DeviceValues &vals) const;
+};
+
+#endif // __WIRE_ENCODER_HPP__
@@ -0,0 +1,242 @@
+#ifndef __WIRE_FORMAT_HPP__
+#define __WIRE_FORMAT_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <endian.h>
+
+/**
+ * Binary output protocol for mimicry_control (selected with
+ * "_out_format": "binary"). Every field is little-endian and packed with
+ * no padding.
+ *
+ * Each datagram starts with a 16-byte header:
+ *
+ * 		u32  magic			MAGIC ("MIMC")
+ * 		u8   version		VERSION
+ * 		u8   type			MsgType
+ * 		u8   chunk			Index of this message among the chunks of its schema or frame
+ * 		u8   num_chunks		Number of chunks the schema or frame was split into
+ * 		u32  schema_id		Hash of the schema body; changes with the configuration
+ * 		u16  count			Number of device entries in the body
+ * 		u16  pose_format	FRAME and DELTA only: encoding of the poses in the body,
+ * 							0 for f32 poses (see wire_quantize.hpp)
+ *
+ * A schema or frame too large for the configured maximum message size is
+ * split into chunks of whole device entries. Every chunk is a complete
+ * message of its type, so each one can be decoded on its own: a lost
+ * chunk only loses the devices in it. Chunks of a frame share its frame
+ * info block, and chunks of a schema share its schema_id, which is the hash
+ * of the unsplit body.
+ *
+ * A SCHEMA message is sent on startup and then periodically. Its body
+ * holds one entry per configured device:
+ *
+ * 		u8   slot			Device slot, as referenced by frames
+ * 		u8   role			0 = left, 1 = right, 2 = tracker
+ * 		u8   num_buttons
+ * 		u8   name_len
+ * 		     name			name_len bytes, not NUL-terminated
+ * 		     buttons		num_buttons entries, in ascending button ID order:
+ * 			u8   button_id	vr::EVRButtonId
+ * 			u8   types		TypeBits of the published values
+ * 			u8   name_len
+ * 			     name
+ *
+ * A FRAME message starts with a 24-byte frame info block:
+ *
+ * 		u64  seq			Sequence number, incremented by one for every frame sent
+ * 		i64  capture_ns		CLOCK_REALTIME time at which the runtime was sampled
+ * 		i64  pose_time_ns	CLOCK_REALTIME time the poses describe, i.e. capture_ns plus
+ * 							the pose prediction interval
+ *
+ * followed by one entry per device with a valid pose:
+ *
+ * 		u8   slot
+ * 		u8   flags			RecordFlags
+ * 		u8   num_analog		Number of analog floats at the end of the entry
+ * 		u8   reserved
+ * 		u32  pressed		Bit i is the boolean state of the device's i-th schema button
+ * 		f32  pos[3]			x, y, z; or packed if the poses are quantized
+ * 		f32  quat[4]		x, y, z, w; or packed if the poses are quantized
+ * 		f32  vel[3]			Only if F_VELOCITY: linear velocity x, y, z (m/s)
+ * 		f32  ang_vel[3]		Only if F_VELOCITY: angular velocity x, y, z (rad/s)
+ * 		f32  analog[num_analog]
+ * 							For each schema button in order: pressure (if T_PRESSURE),
+ * 							then x, y (if T_2D)
+ *
+ * With delta encoding enabled ("_keyframe_frames" / "_keyframe_interval"),
+ * FRAME messages become keyframes sent every so often, and the frames in
+ * between are DELTA messages. A DELTA starts with the frame info block
+ * followed by:
+ *
+ * 		u64  key_seq		seq of the keyframe the delta is relative to
+ *
+ * and holds one entry per device whose values differ from that keyframe:
+ *
+ * 		u8   slot
+ * 		u8   changes		DeltaBits of the fields present in the entry
+ * 		u8   num_analog		Number of analog floats, if D_ANALOG
+ * 		u8   reserved
+ * 		f32  pos[3]			Only if D_POSITION; packed if the poses are quantized
+ * 		f32  quat[4]		Only if D_ORIENTATION; packed if the poses are quantized
+ * 		f32  vel[3]			Only if D_VELOCITY
+ * 		f32  ang_vel[3]		Only if D_VELOCITY
+ * 		u32  pressed		Only if D_BUTTONS
+ * 		f32  analog[num_analog]
+ * 							Only if D_ANALOG, the device's whole analog set
+ *
+ * Every delta is relative to the keyframe rather than to the previous
+ * frame, so a lost delta costs only its own frame. A field is sent once it
+ * has moved further than the configured epsilon from its keyframe value;
+ * button states are compared exactly. A device that was not in the
+ * keyframe is sent with all its fields, and one that lost tracking since
+ * is sent as an entry with only D_REMOVED. A delta with no entries is
+ * still sent, so receivers see every seq. Decoders that only understand
+ * FRAME messages keep working at the keyframe rate.
+ *
+ * With batching enabled ("_batch_frames"), the messages of several
+ * consecutive frames are packed into one BATCH datagram. Its header has
+ * count set to the number of messages it holds (schema_id and pose_format
+ * are 0), and its body is each message in the order it was produced:
+ *
+ * 		u16  length			Size of the message in bytes
+ * 		     message		A complete SCHEMA, FRAME or DELTA message, header included
+ **/
+namespace mimicry
+{
+namespace wire
+{
+
+static const uint32_t MAGIC = 0x434D494D;
+static const uint8_t VERSION = 4;
+
+static const size_t HEADER_SIZE = 16;
+static const size_t FRAME_INFO_SIZE = 24;
+static const size_t DELTA_INFO_SIZE = 32;
+static const size_t DELTA_RECORD_FIXED_SIZE = 4;
+static const size_t RECORD_FIXED_SIZE = 36;	// With f32 poses
+static const size_t RECORD_PREFIX_SIZE = 8;	// Up to the pose
+static const size_t RECORD_VELOCITY_SIZE = 24;
+static const size_t BATCH_ENTRY_PREFIX_SIZE = 2;
+static const unsigned MAX_BUTTONS = 32;
+static const unsigned MAX_CHUNKS = 255;
+
+enum MsgType
+{
+	MSG_SCHEMA = 1,
+	MSG_FRAME = 2,
+	MSG_DELTA = 3,
+	MSG_BATCH = 4
+};
+
+enum TypeBits
+{
+	T_BOOLEAN = 1 << 0,
+	T_PRESSURE = 1 << 1,
+	T_2D = 1 << 2
+};
+
+enum RecordFlags
+{
+	F_POSE_VALID = 1 << 0,
+	F_VELOCITY = 1 << 1		// Velocities follow the fixed part of the entry
+};
+
+enum DeltaBits
+{
+	D_REMOVED = 1 << 0,
+	D_POSITION = 1 << 1,
+	D_ORIENTATION = 1 << 2,
+	D_VELOCITY = 1 << 3,
+	D_BUTTONS = 1 << 4,
+	D_ANALOG = 1 << 5
+};
+
+inline void putU8(uint8_t *&p, uint8_t val) { *p++ = val; }
+
+inline void putU16(uint8_t *&p, uint16_t val)
+{
+	val = htole16(val);
+	memcpy(p, &val, sizeof(val));
+	p += sizeof(val);
+}
+
+inline void putU32(uint8_t *&p, uint32_t val)
+{
+	val = htole32(val);
+	memcpy(p, &val, sizeof(val));
+	p += sizeof(val);
+}
+
+inline void putF32(uint8_t *&p, float val)
+{
+	uint32_t bits;
+	memcpy(&bits, &val, sizeof(bits));
+	putU32(p, bits);
+}
+
+inline void putU64(uint8_t *&p, uint64_t val)
+{
+	val = htole64(val);
+	memcpy(p, &val, sizeof(val));
+	p += sizeof(val);
+}
+
+inline uint8_t getU8(const uint8_t *p) { return *p; }
+
+inline uint16_t getU16(const uint8_t *p)
+{
+	uint16_t val;
+	memcpy(&val, p, sizeof(val));
+	return le16toh(val);
+}
+
+inline uint32_t getU32(const uint8_t *p)
+{
+	uint32_t val;
+	memcpy(&val, p, sizeof(val));
+	return le32toh(val);
+}
+
+inline uint64_t getU64(const uint8_t *p)
+{
+	uint64_t val;
+	memcpy(&val, p, sizeof(val));
+	return le64toh(val);
+}
+
+inline float getF32(const uint8_t *p)
+{
+	uint32_t bits(getU32(p));
+	float val;
+	memcpy(&val, &bits, sizeof(val));
+	return val;
+}
+
+inline void putHeader(uint8_t *&p, MsgType type, uint32_t schema_id, uint16_t count,
+	uint8_t chunk = 0, uint8_t num_chunks = 1, uint16_t pose_format = 0)
+{
+	putU32(p, MAGIC);
+	putU8(p, VERSION);
+	putU8(p, type);
+	putU8(p, chunk);
+	putU8(p, num_chunks);
+	putU32(p, schema_id);
+	putU16(p, count);
+	putU16(p, pose_format);
+}
+
+/**
+ * Number of analog floats published for a button with the given type bits.
+ **/
+inline unsigned analogCount(uint8_t types)
+{
+	return ((types & T_PRESSURE) ? 1 : 0) + ((types & T_2D) ? 2 : 0);
+}
+
+} // namespace wire
+} // namespace mimicry
+
+#endif // __WIRE_FORMAT_HPP__
@@ -0,0 +1,236 @@
+#ifndef __WIRE_QUANTIZE_HPP__
+#define __WIRE_QUANTIZE_HPP__
+
+#include <cmath>
+#include <algorithm>
+
+#include "mimicry_openvr/wire_format.hpp"
+
+/**
+ * Quantized pose encoding for the binary output protocol (selected with
+ * "_pose_quantization"). Poses are packed into two bit fields in place of
+ * the f32 pos[3] and quat[4] of a device entry, each padded to whole bytes
+ * and packed LSB first:
+ *
+ * 		position	3 x pos_bits	x, y, z as signed fixed-point numbers with
+ * 									frac_bits fraction bits, i.e. in steps of
+ * 									2^-frac_bits m
+ * 		orientation	2 + 3 x quat_bits
+ * 									"Smallest three": index of the quaternion
+ * 									component with the largest magnitude, then
+ * 									the other three in x, y, z, w order
+ *
+ * The largest component is left out and rebuilt from the unit norm. The
+ * quaternion is negated first if needed so that component is positive,
+ * which describes the same rotation. The other three are then in
+ * [-1/sqrt(2), 1/sqrt(2)] and are mapped onto quat_bits unsigned steps.
+ *
+ * With 21 position bits, 14 fraction bits and 10 quaternion bits, a pose is
+ * 12 bytes instead of 28: 0.06 mm steps over +-64 m, and under 0.3 degrees
+ * of rotation error.
+ *
+ * Error bounds:
+ *
+ * 		position	At most 2^-(frac_bits + 1) m per axis within
+ * 					+-2^(pos_bits - frac_bits - 1) m. Values outside that
+ * 					range are clamped to it.
+ * 		orientation	At most e = 1 / (sqrt(2) * (2^quat_bits - 1)) per sent
+ * 					component. To first order, the rebuilt component then
+ * 					errs by at most 3e, since it is at least 1/2, so the
+ * 					quaternion is off by at most sqrt(12) e and the rotation
+ * 					angle by at most 4 sqrt(3) e rad: 0.27 degrees for 10
+ * 					bits, 0.017 degrees for 14. Mean errors are about a third
+ * 					of the bounds; pose_quantization_bench measures both.
+ *
+ * The format is carried in the pose_format word of every FRAME and DELTA
+ * header, so receivers need no configuration:
+ *
+ * 		bits 0-5	pos_bits, or 0 for f32 poses
+ * 		bits 6-10	frac_bits
+ * 		bits 11-15	quat_bits
+ **/
+namespace mimicry
+{
+namespace wire
+{
+
+static const unsigned MIN_POSITION_BITS = 8;
+static const unsigned MAX_POSITION_BITS = 32;
+static const unsigned MAX_FRACTION_BITS = 31;
+static const unsigned MIN_ORIENTATION_BITS = 6;
+static const unsigned MAX_ORIENTATION_BITS = 16;
+
+struct PoseFormat
+{
+	uint8_t pos_bits;	// 0 for f32 poses
+	uint8_t frac_bits;
+	uint8_t quat_bits;
+
+	PoseFormat() : pos_bits(0), frac_bits(0), quat_bits(0) {}
+	PoseFormat(uint8_t pos, uint8_t frac, uint8_t quat) : pos_bits(pos), frac_bits(frac), quat_bits(quat) {}
+
+	static PoseFormat fromWord(uint16_t word)
+	{
+		return PoseFormat(word & 0x3F, (word >> 6) & 0x1F, (word >> 11) & 0x1F);
+	}
+
+	uint16_t word() const { return quantized() ? pos_bits | (frac_bits << 6) | (quat_bits << 11) : 0; }
+	bool quantized() const { return pos_bits != 0; }
+	bool valid() const
+	{
+		return !quantized() || (pos_bits >= MIN_POSITION_BITS && pos_bits <= MAX_POSITION_BITS
+			&& frac_bits <= MAX_FRACTION_BITS && quat_bits >= MIN_ORIENTATION_BITS
+			&& quat_bits <= MAX_ORIENTATION_BITS);
+	}
+
+	size_t positionSize() const { return quantized() ? (3 * pos_bits + 7) / 8 : 12; }
+	size_t orientationSize() const { return quantized() ? (2 + 3 * quat_bits + 7) / 8 : 16; }
+	size_t poseSize() const { return positionSize() + orientationSize(); }
+
+	double resolution() const { return std::ldexp(1.0, -frac_bits); }	// m
+	double range() const { return std::ldexp(1.0, pos_bits - frac_bits - 1); }	// +- m
+	double orientationError() const { return 1.0 / (std::sqrt(2.0) * ((1u << quat_bits) - 1)); }
+};
+
+/**
+ * Writes bit fields LSB first into a byte buffer.
+ **/
+class BitWriter
+{
+public:
+	BitWriter(uint8_t *p) : m_p(p), m_acc(0), m_bits(0) {}
+
+	void put(uint32_t val, unsigned bits)
+	{
+		m_acc |= (uint64_t)(val & (uint32_t)((1ull << bits) - 1)) << m_bits;
+		m_bits += bits;
+		while (m_bits >= 8) {
+			*m_p++ = (uint8_t)m_acc;
+			m_acc >>= 8;
+			m_bits -= 8;
+		}
+	}
+
+	// Write out the last partial byte; returns the end of the data
+	uint8_t * flush()
+	{
+		if (m_bits > 0) {
+			*m_p++ = (uint8_t)m_acc;
+		}
+		m_acc = 0;
+		m_bits = 0;
+		return m_p;
+	}
+
+private:
+	uint8_t *m_p;
+	uint64_t m_acc;
+	unsigned m_bits;
+};
+
+/**
+ * Reads bit fields written by BitWriter.
+ **/
+class BitReader
+{
+public:
+	BitReader(const uint8_t *p) : m_p(p), m_acc(0), m_bits(0) {}
+
+	uint32_t get(unsigned bits)
+	{
+		while (m_bits < bits) {
+			m_acc |= (uint64_t)*m_p++ << m_bits;
+			m_bits += 8;
+		}
+
+		uint32_t val((uint32_t)(m_acc & ((1ull << bits) - 1)));
+		m_acc >>= bits;
+		m_bits -= bits;
+		return val;
+	}
+
+private:
+	const uint8_t *m_p;
+	uint64_t m_acc;
+	unsigned m_bits;
+};
+
+inline void putPosition(uint8_t *&p, const float pos[3], const PoseFormat &fmt)
+{
+	BitWriter out(p);
+	int64_t max((1ll << (fmt.pos_bits - 1)) - 1);
+	double scale(1ll << fmt.frac_bits);
+
+	for (unsigned i = 0; i < 3; ++i) {
+		double scaled(std::round(pos[i] * scale));
+		int64_t val(!(scaled > -max - 1) ? -max - 1 : scaled > max ? max : (int64_t)scaled);
+		out.put((uint32_t)val, fmt.pos_bits);
+	}
+
+	p = out.flush();
+}
+
+inline void getPosition(const uint8_t *p, const PoseFormat &fmt, float pos[3])
+{
+	BitReader in(p);
+	unsigned shift(64 - fmt.pos_bits);
+	double scale(1.0 / (1ll << fmt.frac_bits));
+
+	for (unsigned i = 0; i < 3; ++i) {
+		int64_t val((int64_t)((uint64_t)in.get(fmt.pos_bits) << shift) >> shift);
+		pos[i] = (float)(val * scale);
+	}
+}
+
+inline void putOrientation(uint8_t *&p, const float quat[4], const PoseFormat &fmt)
+{
+	static const float COMPONENT_MAX(1.0f / std::sqrt(2.0f));	// Of all but the largest
+	BitWriter out(p);
+	unsigned largest(0);
+	uint32_t steps((1u << fmt.quat_bits) - 1);
+
+	for (unsigned i = 1; i < 4; ++i) {
+		if (std::fabs(quat[i]) > std::fabs(quat[largest])) {
+			largest = i;
+		}
+	}
+
+	float sign(quat[largest] < 0 ? -1.0f : 1.0f);
+	out.put(largest, 2);
+	for (unsigned i = 0; i < 4; ++i) {
+		if (i == largest) {
+			continue;
+		}
+
+		float unit((sign * quat[i] + COMPONENT_MAX) / (2.0f * COMPONENT_MAX));
+		float scaled(std::round(unit * steps));
+		out.put(!(scaled > 0) ? 0 : scaled > steps ? steps : (uint32_t)scaled, fmt.quat_bits);
+	}
+
+	p = out.flush();
+}
+
+inline void getOrientation(const uint8_t *p, const PoseFormat &fmt, float quat[4])
+{
+	static const float COMPONENT_MAX(1.0f / std::sqrt(2.0f));
+	BitReader in(p);
+	unsigned largest(in.get(2));
+	float steps((float)((1u << fmt.quat_bits) - 1));
+	float sum(0.0f);
+
+	for (unsigned i = 0; i < 4; ++i) {
+		if (i == largest) {
+			continue;
+		}
+
+		quat[i] = in.get(fmt.quat_bits) / steps * 2.0f * COMPONENT_MAX - COMPONENT_MAX;
+		sum += quat[i] * quat[i];
+	}
+
+	quat[largest] = std::sqrt(std::max(0.0f, 1.0f - sum));
+}
+
+} // namespace wire
+} // namespace mimicry
+
+#endif // __WIRE_QUANTIZE_HPP__
@@ -0,0 +1,229 @@
+#ifndef __WIRE_STATE_HPP__
+#define __WIRE_STATE_HPP__
+
+#include "mimicry_openvr/wire_decoder.hpp"
+
+/**
+ * Header-only helper that rebuilds the full state of every device from a
+ * stream of FRAME and DELTA messages (see wire_format.hpp). A keyframe
+ * replaces the state outright; a delta is applied on top of the keyframe it
+ * names, so deltas can be lost or arrive out of order without corrupting
+ * the frames that follow.
+ *
+ * Typical use:
+ *
+ * 		mimicry::wire::FrameState state;
+ * 		if (state.apply(buf, len)) {
+ * 			const mimicry::wire::DeviceState &dev(state.device(slot));
+ * 			if (dev.valid) {
+ * 				float x(dev.pos[0]);
+ * 				...
+ * 			}
+ * 		}
+ **/
+namespace mimicry
+{
+namespace wire
+{
+
+static const unsigned MAX_SLOTS = 64;
+
+struct DeviceState
+{
+	bool valid;
+	bool has_velocity;
+	uint8_t num_analog;
+	uint32_t pressed;
+	float pos[3];
+	float quat[4];
+	float vel[3];
+	float ang_vel[3];
+	float analog[MAX_BUTTONS * 3];
+};
+
+class FrameState
+{
+public:
+	FrameState() : m_have_key(false), m_key_seq(0), m_seq(0), m_capture_ns(0), m_pose_time_ns(0)
+	{
+		memset(m_key, 0, sizeof(m_key));
+		memset(m_current, 0, sizeof(m_current));
+	}
+
+	/**
+	 * Apply a received message. Chunks of one keyframe or delta are applied
+	 * one by one as they arrive, and the messages of a batch in order.
+	 *
+	 * Params:
+	 * 		data - received datagram
+	 * 		len - size of the datagram in bytes
+	 *
+	 * Returns: true if the state now reflects the message's frame (for a
+	 * 		batch, the latest of its frames that could be applied), false if
+	 * 		the message is not a frame, or is a delta relative to a keyframe
+	 * 		that was not received.
+	 **/
+	bool apply(const uint8_t *data, size_t len)
+	{
+		Header hdr;
+		if (!parseHeader(data, len, hdr)) {
+			return false;
+		}
+
+		if (hdr.type == MSG_BATCH) {
+			BatchReader batch(data, len);
+			const uint8_t *msg;
+			size_t msg_len;
+			bool applied(false);
+
+			while (batch.next(msg, msg_len)) {
+				applied = applyMessage(msg, msg_len) || applied;
+			}
+			return applied;
+		}
+
+		return applyMessage(data, len);
+	}
+
+	uint64_t seq() const { return m_seq; }
+	int64_t captureNs() const { return m_capture_ns; }
+	int64_t poseTimeNs() const { return m_pose_time_ns; }
+
+	const DeviceState &device(unsigned slot) const { return m_current[slot]; }
+
+private:
+	DeviceState m_key[MAX_SLOTS];
+	DeviceState m_current[MAX_SLOTS];
+	bool m_have_key;
+	uint64_t m_key_seq;
+	uint64_t m_seq;	// Frame the current state belongs to
+	int64_t m_capture_ns;
+	int64_t m_pose_time_ns;
+
+	bool applyMessage(const uint8_t *data, size_t len)
+	{
+		Header hdr;
+		if (!parseHeader(data, len, hdr)) {
+			return false;
+		}
+
+		if (hdr.type == MSG_FRAME) {
+			return applyKeyframe(data, len);
+		}
+		if (hdr.type == MSG_DELTA) {
+			return applyDelta(data, len);
+		}
+
+		return false;
+	}
+
+	bool applyKeyframe(const uint8_t *data, size_t len)
+	{
+		FrameReader frame(data, len);
+		DeviceRecord rec;
+
+		if (len < HEADER_SIZE + FRAME_INFO_SIZE) {
+			return false;
+		}
+
+		// The first chunk of a new keyframe replaces the old one
+		if (!m_have_key || frame.seq() != m_key_seq) {
+			for (unsigned slot = 0; slot < MAX_SLOTS; ++slot) {
+				m_key[slot].valid = false;
+			}
+			m_have_key = true;
+			m_key_seq = frame.seq();
+		}
+
+		while (frame.next(rec)) {
+			if (rec.slot() >= MAX_SLOTS || rec.numAnalog() > MAX_BUTTONS * 3) {
+				continue;
+			}
+
+			DeviceState &dev(m_key[rec.slot()]);
+			dev.valid = rec.poseValid();
+			dev.has_velocity = rec.hasVelocity();
+			dev.pressed = rec.pressed();
+			dev.num_analog = rec.numAnalog();
+			rec.position(dev.pos);
+			rec.orientation(dev.quat);
+			for (unsigned i = 0; i < 3; ++i) {
+				dev.vel[i] = dev.has_velocity ? rec.vel(i) : 0.0f;
+				dev.ang_vel[i] = dev.has_velocity ? rec.angVel(i) : 0.0f;
+			}
+			for (unsigned i = 0; i < dev.num_analog; ++i) {
+				dev.analog[i] = rec.analog(i);
+			}
+		}
+
+		memcpy(m_current, m_key, sizeof(m_current));
+		setFrame(frame.seq(), frame.captureNs(), frame.poseTimeNs());
+		return true;
+	}
+
+	bool applyDelta(const uint8_t *data, size_t len)
+	{
+		DeltaReader delta(data, len);
+		DeltaRecord rec;
+
+		if (!delta.valid() || !m_have_key || delta.keySeq() != m_key_seq) {
+			return false;
+		}
+
+		// The first chunk of a new delta starts over from the keyframe
+		if (delta.seq() != m_seq) {
+			memcpy(m_current, m_key, sizeof(m_current));
+			setFrame(delta.seq(), delta.captureNs(), delta.poseTimeNs());
+		}
+
+		while (delta.next(rec)) {
+			if (rec.slot() >= MAX_SLOTS || rec.numAnalog() > MAX_BUTTONS * 3) {
+				continue;
+			}
+
+			DeviceState &dev(m_current[rec.slot()]);
+			if (rec.removed()) {
+				dev.valid = false;
+				continue;
+			}
+
+			dev.valid = true;
+			if (rec.has(D_POSITION)) {
+				rec.position(dev.pos);
+			}
+			if (rec.has(D_ORIENTATION)) {
+				rec.orientation(dev.quat);
+			}
+			if (rec.has(D_VELOCITY)) {
+				dev.has_velocity = true;
+				for (unsigned i = 0; i < 3; ++i) {
+					dev.vel[i] = rec.vel(i);
+					dev.ang_vel[i] = rec.angVel(i);
+				}
+			}
+			if (rec.has(D_BUTTONS)) {
+				dev.pressed = rec.pressed();
+			}
+			if (rec.has(D_ANALOG)) {
+				dev.num_analog = rec.numAnalog();
+				for (unsigned i = 0; i < dev.num_analog; ++i) {
+					dev.analog[i] = rec.analog(i);
+				}
+			}
+		}
+
+		return true;
+	}
+
+	void setFrame(uint64_t seq, int64_t capture_ns, int64_t pose_time_ns)
+	{
+		m_seq = seq;
+		m_capture_ns = capture_ns;
+		m_pose_time_ns = pose_time_ns;
+	}
+};
+
+} // namespace wire
+} // namespace mimicry
+
+#endif // __WIRE_STATE_HPP__
@@ -0,0 +1,123 @@
+#include <cstdio>
+
+#include "mimicry_openvr/frame_batcher.hpp"
+#include "mimicry_openvr/wire_format.hpp"
+
+
+namespace wire = mimicry::wire;
+
+/**
+ * Set how messages are packed and when batches are sent.
+ *
+ * Params:
+ * 		framing - how the messages are packed into a datagram
+ * 		max_frames - frames per batch; 0 or 1 disables batching
+ * 		max_delay_ns - longest time a message may wait in a batch
+ * 		max_size - largest datagram to send, in bytes
+ **/
+void FrameBatcher::configure(Framing framing, unsigned max_frames, int64_t max_delay_ns, size_t max_size)
+{
+	m_framing = framing;
+	m_max_frames = max_frames;
+	m_max_delay_ns = max_delay_ns;
+	m_max_size = max_size;
+	m_buf.reserve(max_size);
+	clear();
+}
+
+/**
+ * Bytes that packing adds to a batch holding a single message, so that a
+ * message of at most max_size - overhead() always fits a batch on its own.
+ **/
+size_t FrameBatcher::overhead(Framing framing)
+{
+	// "[" and "]", or the BATCH header and one length prefix
+	return (framing == JSON_ARRAY) ? 2 : wire::HEADER_SIZE + wire::BATCH_ENTRY_PREFIX_SIZE;
+}
+
+/**
+ * Append a message to the batch.
+ *
+ * Params:
+ * 		data - message to append
+ * 		len - size of the message in bytes
+ * 		now_ns - current CLOCK_MONOTONIC time, which starts the flush
+ * 			deadline if the batch was empty
+ *
+ * Returns: true if the message was appended, false if it doesn't fit in
+ * 		the rest of the batch, which must then be sent first.
+ **/
+bool FrameBatcher::add(const void *data, size_t len, int64_t now_ns)
+{
+	size_t prefix((m_framing == JSON_ARRAY) ? 1 : wire::BATCH_ENTRY_PREFIX_SIZE);
+	size_t suffix((m_framing == JSON_ARRAY) ? 1 : 0);
+	size_t start(m_buf.size());
+
+	if (m_count == 0) {
+		start = (m_framing == JSON_ARRAY) ? 0 : wire::HEADER_SIZE;
+	}
+	if (start + prefix + len + suffix > m_max_size || (m_framing == WIRE_BATCH && len > UINT16_MAX)) {
+		return false;
+	}
+
+	if (m_count == 0) {
+		m_buf.resize(start);
+		m_deadline_ns = now_ns + m_max_delay_ns;
+	}
+
+	m_buf.resize(start + prefix + len);
+	uint8_t *p(m_buf.data() + start);
+	if (m_framing == JSON_ARRAY) {
+		*p++ = (m_count == 0) ? '[' : ',';
+	}
+	else {
+		wire::putU16(p, len);
+	}
+	memcpy(p, data, len);
+	m_count++;
+
+	return true;
+}
+
+/**
+ * Complete the batch for sending.
+ *
+ * Returns: size of the datagram at data(), or 0 if the batch is empty.
+ **/
+size_t FrameBatcher::finish()
+{
+	if (m_count == 0) {
+		return 0;
+	}
+
+	if (m_framing == JSON_ARRAY) {
+		m_buf.push_back(']');
+	}
+	else {
+		uint8_t *p(m_buf.data());
+		wire::putHeader(p, wire::MSG_BATCH, 0, m_count);
+	}
+
+	m_batches++;
+	m_batched_frames += m_frames;
+	return m_buf.size();
+}
+
+/**
+ * Empty the batch once it has been sent.
+ **/
+void FrameBatcher::clear()
+{
+	m_buf.clear();
+	m_count = 0;
+	m_frames = 0;
+}
+
+std::string FrameBatcher::summary() const
+{
+	char text[96];
+
+	snprintf(text, sizeof(text), "%llu sent, %.1f frames each", (unsigned long long)m_batches,
+		(m_batches > 0) ? (double)m_batched_frames / m_batches : 0.0);
+	return text;
+}
@@ -0,0 +1,243 @@
+#include <cmath>
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+#include <time.h>
+
+#include "mimicry_openvr/frame_scheduler.hpp"
+
+
+static const int64_t NSEC_PER_SEC = 1000000000;
+
+constexpr int64_t FrameScheduler::MIN_BACKOFF_NS;
+constexpr int64_t FrameScheduler::MAX_BACKOFF_NS;
+
+
+/**
+ * Get the current time on CLOCK_MONOTONIC.
+ *
+ * Returns: time in nanoseconds.
+ **/
+int64_t FrameScheduler::monotonicNow()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Get the current time on CLOCK_REALTIME, for timestamps that are compared
+ * across hosts.
+ *
+ * Returns: time in nanoseconds since the epoch.
+ **/
+int64_t FrameScheduler::realtimeNow()
+{
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	return (int64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+/**
+ * Parse an overrun policy name as used in the parameter file.
+ *
+ * Params:
+ * 		name - "skip" or "catch_up"
+ * 		policy - set to the matching policy on success
+ *
+ * Returns: true if the name is valid, false otherwise.
+ **/
+bool FrameScheduler::policyFromName(const std::string &name, OverrunPolicy &policy)
+{
+	if (name == "skip") {
+		policy = SKIP;
+	}
+	else if (name == "catch_up") {
+		policy = CATCH_UP;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Set the loop rate and overrun behavior. The period is kept as a
+ * fractional number of nanoseconds, so rates that do not divide a second
+ * evenly (e.g., 60 Hz) still average out to the exact requested rate.
+ *
+ * Params:
+ * 		freq_hz - loop rate in Hz. A rate of 0 makes the loop free-running
+ * 		policy - what to do when one or more deadlines have been missed
+ **/
+void FrameScheduler::configure(double freq_hz, OverrunPolicy policy)
+{
+	m_period_ns = (freq_hz > 0) ? NSEC_PER_SEC / freq_hz : 0;
+	m_policy = policy;
+}
+
+/**
+ * Anchor the schedule at the current time. The first deadline is one
+ * period from now.
+ **/
+void FrameScheduler::start()
+{
+	m_origin_ns = monotonicNow();
+	m_deadline_ns = m_origin_ns;
+	m_frame = 0;
+	m_backoff_ns = 0;
+	m_last_sample_ns = m_origin_ns;
+	resetStats();
+}
+
+void FrameScheduler::resetStats()
+{
+	m_stats.frames = 0;
+	m_stats.overruns = 0;
+	m_stats.skipped = 0;
+	m_stats.samples = 0;
+	m_stats.duplicates = 0;
+	m_stats.last_ns = 0;
+	m_stats.min_ns = std::numeric_limits<int64_t>::max();
+	m_stats.max_ns = std::numeric_limits<int64_t>::min();
+	m_stats.mean_ns = 0;
+	m_stats.m2_ns = 0;
+}
+
+int64_t FrameScheduler::deadlineFor(uint64_t frame) const
+{
+	return m_origin_ns + std::llround(frame * m_period_ns);
+}
+
+void FrameScheduler::recordLateness(int64_t lateness_ns)
+{
+	FrameStats &s(m_stats);
+
+	s.frames++;
+	s.last_ns = lateness_ns;
+	s.min_ns = std::min(s.min_ns, lateness_ns);
+	s.max_ns = std::max(s.max_ns, lateness_ns);
+
+	double delta(lateness_ns - s.mean_ns);
+	s.mean_ns += delta / s.frames;
+	s.m2_ns += delta * (lateness_ns - s.mean_ns);
+
+	if (!isFreeRunning() && lateness_ns >= m_period_ns) {
+		s.overruns++;
+	}
+}
+
+/**
+ * Tell a free-running scheduler whether the last poll produced a new
+ * sample. New samples reset the backoff; duplicates double it, up to
+ * MAX_BACKOFF_NS or half the mean sample interval, whichever is lower,
+ * so that the next sample is never waited on for long.
+ *
+ * Params:
+ * 		fresh - true if the poll returned data not seen before
+ **/
+void FrameScheduler::reportSample(bool fresh)
+{
+	if (fresh) {
+		int64_t now(monotonicNow());
+
+		m_stats.samples++;
+		recordLateness(now - m_last_sample_ns);
+		m_last_sample_ns = now;
+		m_backoff_ns = 0;
+	}
+	else {
+		int64_t max_backoff(MAX_BACKOFF_NS);
+		if (m_stats.frames > 1) {
+			max_backoff = std::min(max_backoff, (int64_t)(m_stats.mean_ns / 2));
+		}
+
+		m_stats.duplicates++;
+		m_backoff_ns = std::max(MIN_BACKOFF_NS, std::min(m_backoff_ns * 2, max_backoff));
+	}
+}
+
+/**
+ * Advance to the next frame and get the time it should run at. If that
+ * deadline has already passed, the overrun policy decides which deadline
+ * the frame is run against: SKIP moves to the next deadline that is still
+ * in the future, while CATCH_UP keeps the missed one so that missed frames
+ * are run back-to-back. A free-running scheduler runs the next poll after
+ * the current backoff.
+ *
+ * Returns: CLOCK_MONOTONIC time at which to call startFrame().
+ **/
+int64_t FrameScheduler::scheduleNextFrame()
+{
+	int64_t now(monotonicNow());
+
+	if (isFreeRunning()) {
+		m_deadline_ns = now + m_backoff_ns;
+		return m_deadline_ns;
+	}
+
+	m_frame++;
+	m_deadline_ns = deadlineFor(m_frame);
+
+	if (m_policy == SKIP && now >= m_deadline_ns + m_period_ns) {
+		uint64_t next_frame((uint64_t)((now - m_origin_ns) / m_period_ns) + 1);
+		m_stats.skipped += next_frame - m_frame;
+		m_frame = next_frame;
+		m_deadline_ns = deadlineFor(m_frame);
+	}
+
+	return m_deadline_ns;
+}
+
+/**
+ * Record that the frame scheduled by scheduleNextFrame() is starting, for
+ * the lateness statistics.
+ **/
+void FrameScheduler::startFrame()
+{
+	if (!isFreeRunning()) {
+		recordLateness(monotonicNow() - m_deadline_ns);
+	}
+}
+
+double FrameStats::stddevNs() const
+{
+	return (frames > 1) ? std::sqrt(m2_ns / (frames - 1)) : 0;
+}
+
+/**
+ * Format the statistics as a single human-readable line.
+ **/
+std::string FrameStats::summary() const
+{
+	std::ostringstream out;
+
+	if (frames == 0 && duplicates == 0) {
+		return "no frames run";
+	}
+
+	out << std::fixed << std::setprecision(1);
+
+	if (samples > 0 || duplicates > 0) {
+		out << samples << " new samples in " << samples + duplicates << " polls"
+			<< ", sample interval (us): mean " << mean_ns / 1000
+			<< ", stddev " << stddevNs() / 1000
+			<< ", min " << min_ns / 1000.0
+			<< ", max " << max_ns / 1000.0;
+
+		return out.str();
+	}
+
+	out << frames << " frames, lateness (us): mean " << mean_ns / 1000
+		<< ", stddev " << stddevNs() / 1000
+		<< ", min " << min_ns / 1000.0
+		<< ", max " << max_ns / 1000.0
+		<< "; overruns " << overruns << ", skipped " << skipped;
+
+	return out.str();
+}
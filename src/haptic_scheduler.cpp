@@ -0,0 +1,334 @@
+#include <algorithm>
+
+#include "mimicry_openvr/haptic_scheduler.hpp"
+
+
+constexpr int64_t HapticScheduler::PULSE_INTERVAL_NS;
+constexpr unsigned short HapticScheduler::MAX_PULSE_US;
+constexpr int64_t HapticScheduler::IDLE;
+constexpr size_t HapticScheduler::MAX_REQUESTS;
+
+/**
+ * Schedule a vibration pattern on a device: repeat bursts of on_ns, each
+ * followed by a gap of off_ns. A single burst is a plain vibration.
+ *
+ * Params:
+ * 		ix - OpenVR index of the device
+ * 		now_ns - current CLOCK_MONOTONIC time
+ * 		on_ns - length of each burst
+ * 		off_ns - gap between bursts
+ * 		repeat - number of bursts; 0 counts as 1
+ * 		mode - whether to start now or after the device's last request
+ * 		pulse_us - length of each pulse, up to MAX_PULSE_US, which sets the
+ * 			strength of the vibration
+ * 		axis - haptic axis of the device (0 for most controllers)
+ *
+ * Returns: ID of the request, for cancel(), or 0 if the device already has
+ * 		MAX_REQUESTS requests.
+ **/
+uint64_t HapticScheduler::addPattern(vr::TrackedDeviceIndex_t ix, int64_t now_ns, int64_t on_ns, int64_t off_ns,
+	unsigned repeat, Mode mode, unsigned short pulse_us, uint32_t axis)
+{
+	Request req;
+
+	on_ns = std::max(on_ns, (int64_t)0);
+	off_ns = std::max(off_ns, (int64_t)0);
+	repeat = std::max(repeat, 1u);
+
+	req.waveform = NO_WAVEFORM;
+	req.on_ns = on_ns;
+	req.period_ns = (repeat > 1) ? on_ns + off_ns : 0;
+	req.pulse_us = std::min(pulse_us, MAX_PULSE_US);
+	req.axis = axis;
+
+	return schedule(ix, now_ns, req, (int64_t)(repeat - 1) * req.period_ns + on_ns, mode);
+}
+
+/**
+ * Schedule a waveform defined with defineWaveform() on a device.
+ *
+ * Params:
+ * 		ix - OpenVR index of the device
+ * 		now_ns - current CLOCK_MONOTONIC time
+ * 		waveform - ID of the waveform
+ * 		repeat - number of times to play the waveform; 0 counts as 1
+ * 		mode - whether to start now or after the device's last request
+ * 		scale_us - pulse length that the waveform's strongest possible
+ * 			pulse (MAX_PULSE_US) is played at; the others are scaled alike
+ * 		axis - haptic axis of the device (0 for most controllers)
+ *
+ * Returns: ID of the request, for cancel(), or 0 if there is no such
+ * 		waveform or the device already has MAX_REQUESTS requests.
+ **/
+uint64_t HapticScheduler::addWaveform(vr::TrackedDeviceIndex_t ix, int64_t now_ns, size_t waveform,
+	unsigned repeat, Mode mode, unsigned short scale_us, uint32_t axis)
+{
+	Request req;
+
+	if (waveform >= m_waveforms.size() || m_waveforms[waveform].pulses.empty()) {
+		return 0;
+	}
+
+	req.waveform = waveform;
+	req.period_ns = m_waveforms[waveform].pulses.size() * PULSE_INTERVAL_NS;
+	req.on_ns = req.period_ns;
+	req.pulse_us = std::min(scale_us, MAX_PULSE_US);
+	req.axis = axis;
+
+	return schedule(ix, now_ns, req, std::max(repeat, 1u) * req.period_ns, mode);
+}
+
+/**
+ * Add a waveform for addWaveform(). Waveforms are meant to be defined
+ * once, before anything is played.
+ *
+ * Params:
+ * 		name - name to find the waveform by
+ * 		pulses - pulse length for each PULSE_INTERVAL_NS step of the
+ * 			waveform, 0 for none. Must not be empty
+ *
+ * Returns: ID of the waveform, counting up from 0.
+ **/
+size_t HapticScheduler::defineWaveform(const std::string &name, const Waveform &pulses)
+{
+	m_waveforms.push_back(NamedWaveform());
+	m_waveforms.back().name = name;
+	m_waveforms.back().pulses = pulses;
+
+	for (unsigned short &pulse_us : m_waveforms.back().pulses) {
+		pulse_us = std::min(pulse_us, MAX_PULSE_US);
+	}
+
+	return m_waveforms.size() - 1;
+}
+
+/**
+ * Returns: ID of the named waveform, or -1 if there is none.
+ **/
+int HapticScheduler::findWaveform(const char *name, size_t len) const
+{
+	for (size_t id = 0; id < m_waveforms.size(); ++id) {
+		if (m_waveforms[id].name.compare(0, std::string::npos, name, len) == 0) {
+			return id;
+		}
+	}
+
+	return -1;
+}
+
+uint64_t HapticScheduler::schedule(vr::TrackedDeviceIndex_t ix, int64_t now_ns, Request &req, int64_t length_ns,
+	Mode mode)
+{
+	Channel &chan(channel(ix));
+
+	// Requests that have ended only go away in run(); they don't count
+	chan.requests.erase(std::remove_if(chan.requests.begin(), chan.requests.end(),
+		[now_ns](const Request &other) { return other.end_ns <= now_ns; }), chan.requests.end());
+	if (chan.requests.size() >= MAX_REQUESTS) {
+		return 0;
+	}
+
+	req.id = m_next_id++;
+	req.start_ns = now_ns;
+	if (mode == QUEUE) {
+		for (const Request &other : chan.requests) {
+			req.start_ns = std::max(req.start_ns, other.end_ns);
+		}
+	}
+	req.end_ns = req.start_ns + length_ns;
+
+	chan.requests.push_back(req);
+	chan.deadline_ns = channelDeadline(chan, now_ns);
+	return req.id;
+}
+
+/**
+ * Cancel a request, whether it is playing or still queued. Requests queued
+ * after it keep their start times.
+ *
+ * Returns: true if the request was pending, false otherwise.
+ **/
+bool HapticScheduler::cancel(uint64_t id)
+{
+	for (Channel &chan : m_channels) {
+		for (auto req = chan.requests.begin(); req != chan.requests.end(); ++req) {
+			if (req->id == id) {
+				chan.requests.erase(req);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Cancel every request of a device. The device keeps its pulse timing, so
+ * a request added right after (to replace the cancelled ones) still waits
+ * for the runtime to accept the next pulse.
+ **/
+void HapticScheduler::cancelDevice(vr::TrackedDeviceIndex_t ix)
+{
+	for (Channel &chan : m_channels) {
+		if (chan.ix == ix) {
+			chan.requests.clear();
+		}
+	}
+}
+
+void HapticScheduler::cancelAll()
+{
+	for (Channel &chan : m_channels) {
+		chan.requests.clear();
+	}
+}
+
+bool HapticScheduler::idle() const
+{
+	for (const Channel &chan : m_channels) {
+		if (!chan.requests.empty()) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Issue the pulses that are due and drop finished requests.
+ *
+ * Params:
+ * 		now_ns - current CLOCK_MONOTONIC time
+ *
+ * Returns: the next time run() needs to be called, or IDLE if there is
+ * 		nothing left to play.
+ **/
+int64_t HapticScheduler::run(int64_t now_ns)
+{
+	for (Channel &chan : m_channels) {
+		const Request *strongest(NULL);
+		unsigned short pulse_us(0);
+
+		chan.requests.erase(std::remove_if(chan.requests.begin(), chan.requests.end(),
+			[now_ns](const Request &req) { return req.end_ns <= now_ns; }), chan.requests.end());
+
+		for (const Request &req : chan.requests) {
+			unsigned short req_pulse_us(pulseAt(req, now_ns));
+			if (req_pulse_us > pulse_us) {
+				strongest = &req;
+				pulse_us = req_pulse_us;
+			}
+		}
+
+		if (strongest != NULL && now_ns >= chan.next_pulse_ns) {
+			if (m_vrs != NULL) {
+				m_vrs->TriggerHapticPulse(chan.ix, strongest->axis, pulse_us);
+				m_pulses++;
+			}
+			chan.next_pulse_ns = now_ns + PULSE_INTERVAL_NS;
+		}
+
+		chan.deadline_ns = channelDeadline(chan, now_ns);
+	}
+
+	// Forget a device once it has nothing to play and its pulse timing no longer matters
+	m_channels.erase(std::remove_if(m_channels.begin(), m_channels.end(),
+		[now_ns](const Channel &chan) { return chan.requests.empty() && now_ns >= chan.next_pulse_ns; }),
+		m_channels.end());
+
+	return nextDeadline();
+}
+
+/**
+ * Returns: the next time a pulse is due or a request starts or ends, or
+ * 		IDLE if there is nothing left to play.
+ **/
+int64_t HapticScheduler::nextDeadline() const
+{
+	int64_t deadline(IDLE);
+
+	for (const Channel &chan : m_channels) {
+		deadline = std::min(deadline, chan.deadline_ns);
+	}
+
+	return deadline;
+}
+
+int64_t HapticScheduler::channelDeadline(const Channel &chan, int64_t now_ns) const
+{
+	int64_t deadline(IDLE);
+	int64_t pulse_ns(std::max(now_ns, chan.next_pulse_ns));
+
+	for (const Request &req : chan.requests) {
+		// The next pulse of a request that is on by then, else the start of its next burst
+		int64_t on_ns(nextOn(req, pulse_ns));
+		if (on_ns < req.end_ns) {
+			deadline = std::min(deadline, on_ns);
+		}
+		deadline = std::min(deadline, req.end_ns);
+	}
+
+	return deadline;
+}
+
+/**
+ * Returns: length of the pulse the request calls for at t_ns, 0 if none.
+ **/
+unsigned short HapticScheduler::pulseAt(const Request &req, int64_t t_ns) const
+{
+	if (t_ns < req.start_ns || t_ns >= req.end_ns) {
+		return 0;
+	}
+
+	if (req.waveform == NO_WAVEFORM) {
+		bool on(req.period_ns == 0 || (t_ns - req.start_ns) % req.period_ns < req.on_ns);
+		return on ? req.pulse_us : 0;
+	}
+
+	const Waveform &pulses(m_waveforms[req.waveform].pulses);
+	size_t step(((t_ns - req.start_ns) % req.period_ns) / PULSE_INTERVAL_NS);
+	return (unsigned)pulses[step] * req.pulse_us / MAX_PULSE_US;
+}
+
+/**
+ * Returns: the first time from t_ns on at which the request calls for a
+ * 		pulse, ignoring its end, or IDLE if it never does.
+ **/
+int64_t HapticScheduler::nextOn(const Request &req, int64_t t_ns) const
+{
+	t_ns = std::max(t_ns, req.start_ns);
+	if (req.period_ns == 0) {
+		return t_ns;
+	}
+
+	int64_t phase((t_ns - req.start_ns) % req.period_ns);
+	if (req.waveform == NO_WAVEFORM) {
+		return (phase < req.on_ns) ? t_ns : t_ns - phase + req.period_ns;
+	}
+
+	// Look one cycle ahead, from the current step, for the next step with a pulse
+	const Waveform &pulses(m_waveforms[req.waveform].pulses);
+	size_t step(phase / PULSE_INTERVAL_NS);
+	for (size_t i = 0; i < pulses.size(); ++i) {
+		if ((unsigned)pulses[(step + i) % pulses.size()] * req.pulse_us / MAX_PULSE_US > 0) {
+			return (i == 0) ? t_ns : t_ns - phase + (int64_t)(step + i) * PULSE_INTERVAL_NS;
+		}
+	}
+
+	return IDLE;
+}
+
+HapticScheduler::Channel &HapticScheduler::channel(vr::TrackedDeviceIndex_t ix)
+{
+	for (Channel &chan : m_channels) {
+		if (chan.ix == ix) {
+			return chan;
+		}
+	}
+
+	m_channels.push_back(Channel());
+	m_channels.back().ix = ix;
+	m_channels.back().next_pulse_ns = 0;
+	m_channels.back().deadline_ns = IDLE;
+	return m_channels.back();
+}
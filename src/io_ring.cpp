@@ -0,0 +1,381 @@
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <ctime>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "mimicry_openvr/io_ring.hpp"
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+
+IoRing::IoRing() : m_fd(-1), m_sq_entries(0), m_cq_entries(0), m_ring(MAP_FAILED),
+	m_ring_size(0), m_sqes((io_uring_sqe *)MAP_FAILED), m_sqes_size(0), m_sq_head(NULL),
+	m_sq_tail(NULL), m_sq_mask(NULL), m_sq_array(NULL), m_sq_local_tail(0), m_sq_submitted(0),
+	m_cq_head(NULL), m_cq_tail(NULL), m_cq_mask(NULL), m_cqes(NULL),
+	m_buf_ring((io_uring_buf_ring *)MAP_FAILED), m_buf_ring_size(0), m_buffers((uint8_t *)MAP_FAILED),
+	m_buffers_size(0), m_buf_count(0), m_buf_size(0), m_buf_tail(0)
+{
+}
+
+/**
+ * Create the ring and map its queues.
+ *
+ * Params:
+ * 		entries - submission queue size; rounded up to a power of two by the
+ * 			kernel
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the ring is ready, false if io_uring is not available
+ * 		or lacks a feature this wrapper relies on.
+ **/
+bool IoRing::open(unsigned entries, std::string &error)
+{
+	io_uring_params params;
+
+	close();
+	memset(&params, 0, sizeof(params));
+
+	m_fd = syscall(__NR_io_uring_setup, entries, &params);
+	if (m_fd < 0) {
+		error = std::string("io_uring_setup failed: ") + strerror(errno);
+		return false;
+	}
+
+	// Single mmap (5.4) and wait timeouts (5.11)
+	if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+		error = "io_uring is too old (needs Linux 5.11 or later).";
+		close();
+		return false;
+	}
+
+	m_sq_entries = params.sq_entries;
+	m_cq_entries = params.cq_entries;
+
+	size_t sq_size(params.sq_off.array + params.sq_entries * sizeof(unsigned));
+	size_t cq_size(params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+	m_ring_size = (sq_size > cq_size) ? sq_size : cq_size;
+	m_ring = mmap(NULL, m_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+		IORING_OFF_SQ_RING);
+	m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+	m_sqes = (io_uring_sqe *)mmap(NULL, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		m_fd, IORING_OFF_SQES);
+
+	if (m_ring == MAP_FAILED || m_sqes == MAP_FAILED) {
+		error = std::string("Could not map io_uring queues: ") + strerror(errno);
+		close();
+		return false;
+	}
+
+	uint8_t *ring((uint8_t *)m_ring);
+	m_sq_head = (unsigned *)(ring + params.sq_off.head);
+	m_sq_tail = (unsigned *)(ring + params.sq_off.tail);
+	m_sq_mask = (unsigned *)(ring + params.sq_off.ring_mask);
+	m_sq_array = (unsigned *)(ring + params.sq_off.array);
+	m_cq_head = (unsigned *)(ring + params.cq_off.head);
+	m_cq_tail = (unsigned *)(ring + params.cq_off.tail);
+	m_cq_mask = (unsigned *)(ring + params.cq_off.ring_mask);
+	m_cqes = (io_uring_cqe *)(ring + params.cq_off.cqes);
+
+	m_sq_local_tail = *m_sq_tail;
+	m_sq_submitted = m_sq_local_tail;
+
+	return true;
+}
+
+void IoRing::close()
+{
+	if (m_buf_ring != MAP_FAILED) {
+		munmap(m_buf_ring, m_buf_ring_size);
+		m_buf_ring = (io_uring_buf_ring *)MAP_FAILED;
+	}
+	if (m_buffers != MAP_FAILED) {
+		munmap(m_buffers, m_buffers_size);
+		m_buffers = (uint8_t *)MAP_FAILED;
+	}
+	if (m_sqes != MAP_FAILED) {
+		munmap(m_sqes, m_sqes_size);
+		m_sqes = (io_uring_sqe *)MAP_FAILED;
+	}
+	if (m_ring != MAP_FAILED) {
+		munmap(m_ring, m_ring_size);
+		m_ring = MAP_FAILED;
+	}
+	if (m_fd >= 0) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+}
+
+/**
+ * Get the next free submission queue entry, cleared. It is passed to the
+ * kernel by the next submit() or wait().
+ *
+ * Returns: the entry, or NULL if the submission queue is full.
+ **/
+io_uring_sqe * IoRing::getSqe()
+{
+	unsigned head(__atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE));
+
+	if (m_sq_local_tail - head >= m_sq_entries) {
+		return NULL;
+	}
+
+	unsigned ix(m_sq_local_tail & *m_sq_mask);
+	m_sq_array[ix] = ix;
+	m_sq_local_tail++;
+
+	memset(&m_sqes[ix], 0, sizeof(io_uring_sqe));
+	return &m_sqes[ix];
+}
+
+int IoRing::enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg,
+	size_t arg_size)
+{
+	__atomic_store_n(m_sq_tail, m_sq_local_tail, __ATOMIC_RELEASE);
+
+	for (;;) {
+		int ret(syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, flags, arg, arg_size));
+		if (ret >= 0) {
+			m_sq_submitted += ret;
+			return ret;
+		}
+		if (errno != EINTR) {
+			return -errno;
+		}
+	}
+}
+
+/**
+ * Pass the pending entries to the kernel, optionally waiting for
+ * completions in the same system call.
+ *
+ * Params:
+ * 		wait_nr - number of completions to wait for
+ *
+ * Returns: number of entries submitted, or a negated errno.
+ **/
+int IoRing::submit(unsigned wait_nr)
+{
+	return enter(m_sq_local_tail - m_sq_submitted, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0,
+		NULL, 0);
+}
+
+/**
+ * Pass the pending entries to the kernel and wait for completions, for at
+ * most the given time.
+ *
+ * Returns: number of entries submitted, -ETIME if the time ran out, or
+ * 		another negated errno.
+ **/
+int IoRing::wait(unsigned wait_nr, int64_t timeout_ns)
+{
+	__kernel_timespec ts;
+	io_uring_getevents_arg arg;
+
+	ts.tv_sec = timeout_ns / 1000000000;
+	ts.tv_nsec = timeout_ns % 1000000000;
+	memset(&arg, 0, sizeof(arg));
+	arg.sigmask_sz = _NSIG / 8;
+	arg.ts = (uint64_t)(uintptr_t)&ts;
+
+	return enter(m_sq_local_tail - m_sq_submitted, wait_nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+		&arg, sizeof(arg));
+}
+
+/**
+ * Take the next completion off the completion queue. Only reads shared
+ * memory; no system call is made.
+ *
+ * Returns: true if cqe was filled in, false if the queue is empty.
+ **/
+bool IoRing::nextCompletion(Completion &completion)
+{
+	unsigned head(*m_cq_head);
+
+	if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+		return false;
+	}
+
+	const io_uring_cqe &cqe(m_cqes[head & *m_cq_mask]);
+	completion.user_data = cqe.user_data;
+	completion.res = cqe.res;
+	completion.more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+	completion.buffer = (cqe.flags & IORING_CQE_F_BUFFER) ? (int)(cqe.flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+	__atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * Register a ring of provided buffers, from which multishot receives pick
+ * a buffer for each datagram.
+ *
+ * Params:
+ * 		group - buffer group ID, as passed to prepRecvMultishot()
+ * 		count - number of buffers; must be a power of two
+ * 		size - size of each buffer in bytes
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the buffers are registered, false otherwise (Linux 5.19
+ * 		or later is needed).
+ **/
+bool IoRing::setupBuffers(uint16_t group, unsigned count, unsigned size, std::string &error)
+{
+	io_uring_buf_reg reg;
+
+	long page(sysconf(_SC_PAGESIZE));
+	m_buf_ring_size = (count * sizeof(io_uring_buf) + page - 1) / page * page;
+	m_buf_ring = (io_uring_buf_ring *)mmap(NULL, m_buf_ring_size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	m_buffers_size = (size_t)count * size;
+	m_buffers = (uint8_t *)mmap(NULL, m_buffers_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+		-1, 0);
+	if (m_buf_ring == MAP_FAILED || m_buffers == MAP_FAILED) {
+		error = "Could not allocate io_uring buffers.";
+		return false;
+	}
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uint64_t)(uintptr_t)m_buf_ring;
+	reg.ring_entries = count;
+	reg.bgid = group;
+	if (syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		error = std::string("Could not register io_uring buffers: ") + strerror(errno);
+		return false;
+	}
+
+	m_buf_count = count;
+	m_buf_size = size;
+	m_buf_tail = 0;
+	for (unsigned id = 0; id < count; ++id) {
+		recycleBuffer(id);
+	}
+
+	return true;
+}
+
+/**
+ * Hand a provided buffer back to the kernel once its data has been used.
+ **/
+void IoRing::recycleBuffer(unsigned id)
+{
+	// Not m_buf_ring->bufs: compiled as C++, the kernel header's flexible array
+	// member lands after the tail instead of overlaying it
+	io_uring_buf &buf(((io_uring_buf *)m_buf_ring)[m_buf_tail & (m_buf_count - 1)]);
+
+	buf.addr = (uint64_t)(uintptr_t)buffer(id);
+	buf.len = m_buf_size;
+	buf.bid = id;
+	m_buf_tail++;
+
+	__atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+}
+
+/**
+ * Queue a sendmsg request. msg must stay valid until it completes.
+ *
+ * Returns: true if queued, false if the submission queue is full.
+ **/
+bool IoRing::queueSendmsg(int fd, const msghdr *msg, unsigned flags, uint64_t user_data)
+{
+	io_uring_sqe *sqe(getSqe());
+
+	if (sqe == NULL) {
+		return false;
+	}
+
+	sqe->opcode = IORING_OP_SENDMSG;
+	sqe->fd = fd;
+	sqe->addr = (uint64_t)(uintptr_t)msg;
+	sqe->len = 1;
+	sqe->msg_flags = flags;
+	sqe->user_data = user_data;
+	return true;
+}
+
+/**
+ * Queue a receive that stays armed and completes once per datagram, each
+ * into a buffer of the given group. It ends (a completion without more set)
+ * when it runs out of buffers or fails, and must then be queued again.
+ *
+ * Returns: true if queued, false if the submission queue is full.
+ **/
+bool IoRing::queueRecvMultishot(int fd, uint16_t group, uint64_t user_data)
+{
+	io_uring_sqe *sqe(getSqe());
+
+	if (sqe == NULL) {
+		return false;
+	}
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = group;
+	sqe->user_data = user_data;
+	return true;
+}
+
+#else // HAVE_IO_URING
+
+// Built without the kernel headers io_uring needs: open() always fails, so
+// callers use plain socket calls, and nothing else is ever reached
+
+IoRing::IoRing() : m_fd(-1), m_sq_entries(0), m_cq_entries(0), m_ring(NULL), m_ring_size(0),
+	m_sqes(NULL), m_sqes_size(0), m_sq_head(NULL), m_sq_tail(NULL), m_sq_mask(NULL), m_sq_array(NULL),
+	m_sq_local_tail(0), m_sq_submitted(0), m_cq_head(NULL), m_cq_tail(NULL), m_cq_mask(NULL),
+	m_cqes(NULL), m_buf_ring(NULL), m_buf_ring_size(0), m_buffers(NULL), m_buffers_size(0),
+	m_buf_count(0), m_buf_size(0), m_buf_tail(0)
+{
+}
+
+bool IoRing::open(unsigned, std::string &error)
+{
+	error = "io_uring support was not compiled in: the kernel headers predate Linux 6.0.";
+	return false;
+}
+
+void IoRing::close()
+{
+}
+
+int IoRing::submit(unsigned)
+{
+	return -ENOSYS;
+}
+
+int IoRing::wait(unsigned, int64_t)
+{
+	return -ENOSYS;
+}
+
+bool IoRing::nextCompletion(Completion &)
+{
+	return false;
+}
+
+bool IoRing::setupBuffers(uint16_t, unsigned, unsigned, std::string &error)
+{
+	error = "io_uring support was not compiled in: the kernel headers predate Linux 6.0.";
+	return false;
+}
+
+void IoRing::recycleBuffer(unsigned)
+{
+}
+
+bool IoRing::queueSendmsg(int, const msghdr *, unsigned, uint64_t)
+{
+	return false;
+}
+
+bool IoRing::queueRecvMultishot(int, uint16_t, uint64_t)
+{
+	return false;
+}
+
+#endif // HAVE_IO_URING
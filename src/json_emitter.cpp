@@ -0,0 +1,616 @@
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <algorithm>
+
+#include "mimicry_openvr/mimicry_app.hpp"
+#include "mimicry_openvr/json_emitter.hpp"
+
+
+using json = nlohmann::json;
+
+// Large enough for any double formatted by nlohmann::detail::to_chars, or any 64-bit integer
+static const size_t MAX_NUMBER_LEN = 32;
+// Large enough for the frame info of a chunk, with every number at its widest
+static const size_t MAX_FRAME_INFO_LEN = 256;
+
+const char *JsonEmitter::FRAME_KEY = "_frame";
+
+
+/**
+ * Build the JSON output frame as a tree. This is the reference layout the
+ * compiled emitter reproduces, and is also used for pretty-printed output.
+ *
+ * Params:
+ * 		devices - configured devices. Only active devices with a valid pose
+ * 			are included
+ * 		info - sequence number and timestamps of the frame
+ *
+ * Returns: JSON object keyed by device name, plus FRAME_KEY. Empty if no
+ * 		device is included.
+ **/
+json JsonEmitter::buildTree(const std::vector<VRDevice> &devices, const FrameInfo &info)
+{
+	return buildTree(devices, info, Projection());
+}
+
+/**
+ * Build the JSON output frame as a tree, limited to the devices and fields
+ * selected by a projection.
+ **/
+json JsonEmitter::buildTree(const std::vector<VRDevice> &devices, const FrameInfo &info,
+	const Projection &proj)
+{
+	json j;
+
+	for (size_t slot = 0; slot < devices.size(); ++slot) {
+		const VRDevice *dev(&devices[slot]);
+
+		if (!proj.hasDevice(slot) || !dev->isActive() || !dev->pose_valid) {
+			continue;
+		}
+
+		j[dev->name]["_role"] = roleEnumToName(dev->role);
+
+		VRPose dev_pose = dev->pose;
+		if (proj.hasField(Projection::F_POSE)) {
+			j[dev->name]["pose"]["position"]["x"] = dev_pose.pos.x;
+			j[dev->name]["pose"]["position"]["y"] = dev_pose.pos.y;
+			j[dev->name]["pose"]["position"]["z"] = dev_pose.pos.z;
+
+			j[dev->name]["pose"]["orientation"]["x"] = dev_pose.quat.x;
+			j[dev->name]["pose"]["orientation"]["y"] = dev_pose.quat.y;
+			j[dev->name]["pose"]["orientation"]["z"] = dev_pose.quat.z;
+			j[dev->name]["pose"]["orientation"]["w"] = dev_pose.quat.w;
+		}
+
+		if (proj.hasField(Projection::F_VELOCITY)) {
+			j[dev->name]["velocity"]["linear"]["x"] = dev_pose.vel.x;
+			j[dev->name]["velocity"]["linear"]["y"] = dev_pose.vel.y;
+			j[dev->name]["velocity"]["linear"]["z"] = dev_pose.vel.z;
+
+			j[dev->name]["velocity"]["angular"]["x"] = dev_pose.ang_vel.x;
+			j[dev->name]["velocity"]["angular"]["y"] = dev_pose.ang_vel.y;
+			j[dev->name]["velocity"]["angular"]["z"] = dev_pose.ang_vel.z;
+		}
+
+		if (dev->role == VRDevice::DeviceRole::TRACKER || !proj.hasField(Projection::F_BUTTONS)) {
+			continue;
+		}
+
+		for (uint64_t mask(dev->button_mask); mask != 0; mask &= mask - 1) {
+			const VRButton *button(&dev->buttons[__builtin_ctzll(mask)]);
+
+			if (button->val_types[VRButton::V_BOOLEAN]) {
+				j[dev->name][button->name]["boolean"] = button->pressed;
+			}
+			if (button->val_types[VRButton::V_PRESSURE]) {
+				j[dev->name][button->name]["pressure"] = button->pressure;
+			}
+			if (button->val_types[VRButton::V_2D]) {
+				j[dev->name][button->name]["2d"]["x"] = button->touch_pos.x;
+				j[dev->name][button->name]["2d"]["y"] = button->touch_pos.y;
+			}
+		}
+	}
+
+	if (!j.empty()) {
+		j[FRAME_KEY]["seq"] = info.seq;
+		j[FRAME_KEY]["capture_ns"] = info.capture_ns;
+		j[FRAME_KEY]["pose_time_ns"] = info.pose_time_ns;
+	}
+
+	return j;
+}
+
+/**
+ * Write an integer in decimal, as nlohmann::json does.
+ *
+ * Returns: pointer past the last digit written.
+ **/
+static char * formatUnsigned(char *p, uint64_t val)
+{
+	char digits[20];
+	int n(0);
+
+	do {
+		digits[n++] = '0' + val % 10;
+		val /= 10;
+	} while (val != 0);
+
+	while (n > 0) {
+		*p++ = digits[--n];
+	}
+
+	return p;
+}
+
+static char * formatSigned(char *p, int64_t val)
+{
+	if (val < 0) {
+		*p++ = '-';
+		return formatUnsigned(p, -(uint64_t)val);
+	}
+
+	return formatUnsigned(p, val);
+}
+
+static char * appendText(char *p, const char *text)
+{
+	size_t len(strlen(text));
+
+	memcpy(p, text, len);
+	return p + len;
+}
+
+void JsonEmitter::addLiteral(std::vector<Op> &ops, const std::string &text)
+{
+	// Fragments are appended in order, so consecutive literals can share one op
+	if (!ops.empty() && ops.back().kind == Op::LITERAL
+			&& ops.back().lit_offset + ops.back().lit_len == m_literals.size()) {
+		ops.back().lit_len += text.size();
+	}
+	else {
+		Op op;
+		op.kind = Op::LITERAL;
+		op.lit_offset = m_literals.size();
+		op.lit_len = text.size();
+		op.value = NULL;
+		ops.emplace_back(op);
+	}
+
+	m_literals += text;
+}
+
+void JsonEmitter::addValue(std::vector<Op> &ops, Op::Kind kind, const void *value)
+{
+	Op op;
+	op.kind = kind;
+	op.lit_offset = 0;
+	op.lit_len = 0;
+	op.value = value;
+	ops.emplace_back(op);
+}
+
+/**
+ * Compile the output layout for the configured devices. The devices must
+ * stay at the same address for as long as the emitter is used.
+ *
+ * Params:
+ * 		devices - configured devices
+ * 		info - frame info to publish with every frame
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the layout could be compiled, false otherwise.
+ **/
+bool JsonEmitter::compile(const std::vector<VRDevice> &devices, const FrameInfo &info,
+	std::string &error)
+{
+	return compile(devices, info, Projection(), error);
+}
+
+/**
+ * Compile the output layout for the devices and fields selected by a
+ * projection. Devices outside the projection are never written.
+ **/
+bool JsonEmitter::compile(const std::vector<VRDevice> &devices, const FrameInfo &info,
+	const Projection &proj, std::string &error)
+{
+	size_t max_size(2);
+
+	m_literals.clear();
+	m_templates.clear();
+
+	DeviceTemplate frame_tmpl;
+	frame_tmpl.key = FRAME_KEY;
+	frame_tmpl.dev = NULL;
+	addLiteral(frame_tmpl.ops, json(FRAME_KEY).dump() + ":{\"capture_ns\":");
+	addValue(frame_tmpl.ops, Op::INT64, &info.capture_ns);
+	addLiteral(frame_tmpl.ops, ",\"pose_time_ns\":");
+	addValue(frame_tmpl.ops, Op::INT64, &info.pose_time_ns);
+	addLiteral(frame_tmpl.ops, ",\"seq\":");
+	addValue(frame_tmpl.ops, Op::UINT64, &info.seq);
+	addLiteral(frame_tmpl.ops, "}");
+	m_templates.emplace_back(frame_tmpl);
+
+	for (size_t slot = 0; slot < devices.size(); ++slot) {
+		const VRDevice &dev(devices[slot]);
+		DeviceTemplate tmpl;
+		tmpl.key = dev.name;
+		tmpl.dev = &dev;
+
+		if (dev.name == FRAME_KEY) {
+			error = "Device name '" + dev.name + "' is reserved for output data.";
+			return false;
+		}
+		if (!proj.hasDevice(slot)) {
+			continue;
+		}
+
+		// Group the device's entries by key; the map yields them in the same order as json
+		std::map<std::string, int> entries;
+		entries["_role"] = -1;
+		if (proj.hasField(Projection::F_POSE)) {
+			entries["pose"] = -2;
+		}
+		if (proj.hasField(Projection::F_VELOCITY)) {
+			entries["velocity"] = -3;
+		}
+
+		for (uint64_t mask(dev.button_mask); mask != 0; mask &= mask - 1) {
+			int id(__builtin_ctzll(mask));
+			const VRButton &button(dev.buttons[id]);
+
+			if (dev.role == VRDevice::DeviceRole::TRACKER || !proj.hasField(Projection::F_BUTTONS)) {
+				break;
+			}
+			if (!button.val_types[VRButton::V_BOOLEAN] && !button.val_types[VRButton::V_PRESSURE]
+					&& !button.val_types[VRButton::V_2D]) {
+				continue;
+			}
+			if (entries.find(button.name) != entries.end()) {
+				error = "Button name '" + button.name + "' for device " + dev.name
+					+ " collides with another output key.";
+				return false;
+			}
+
+			entries[button.name] = id;
+		}
+
+		addLiteral(tmpl.ops, json(dev.name).dump() + ":{");
+
+		std::map<std::string, int>::iterator it(entries.begin());
+		for ( ; it != entries.end(); ++it) {
+			if (it != entries.begin()) {
+				addLiteral(tmpl.ops, ",");
+			}
+			addLiteral(tmpl.ops, json(it->first).dump() + ":");
+
+			if (it->second == -1) {
+				addLiteral(tmpl.ops, json(roleEnumToName(dev.role)).dump());
+			}
+			else if (it->second == -2) {
+				addLiteral(tmpl.ops, "{\"orientation\":{\"w\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.quat.w);
+				addLiteral(tmpl.ops, ",\"x\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.quat.x);
+				addLiteral(tmpl.ops, ",\"y\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.quat.y);
+				addLiteral(tmpl.ops, ",\"z\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.quat.z);
+				addLiteral(tmpl.ops, "},\"position\":{\"x\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.pos.x);
+				addLiteral(tmpl.ops, ",\"y\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.pos.y);
+				addLiteral(tmpl.ops, ",\"z\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.pos.z);
+				addLiteral(tmpl.ops, "}}");
+			}
+			else if (it->second == -3) {
+				addLiteral(tmpl.ops, "{\"angular\":{\"x\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.ang_vel.x);
+				addLiteral(tmpl.ops, ",\"y\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.ang_vel.y);
+				addLiteral(tmpl.ops, ",\"z\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.ang_vel.z);
+				addLiteral(tmpl.ops, "},\"linear\":{\"x\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.vel.x);
+				addLiteral(tmpl.ops, ",\"y\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.vel.y);
+				addLiteral(tmpl.ops, ",\"z\":");
+				addValue(tmpl.ops, Op::FLOAT, &dev.pose.vel.z);
+				addLiteral(tmpl.ops, "}}");
+			}
+			else {
+				const VRButton &button(dev.buttons[it->second]);
+				const char *sep("{");
+
+				if (button.val_types[VRButton::V_2D]) {
+					addLiteral(tmpl.ops, std::string(sep) + "\"2d\":{\"x\":");
+					addValue(tmpl.ops, Op::FLOAT, &button.touch_pos.x);
+					addLiteral(tmpl.ops, ",\"y\":");
+					addValue(tmpl.ops, Op::FLOAT, &button.touch_pos.y);
+					addLiteral(tmpl.ops, "}");
+					sep = ",";
+				}
+				if (button.val_types[VRButton::V_BOOLEAN]) {
+					addLiteral(tmpl.ops, std::string(sep) + "\"boolean\":");
+					addValue(tmpl.ops, Op::BOOLEAN, &button.pressed);
+					sep = ",";
+				}
+				if (button.val_types[VRButton::V_PRESSURE]) {
+					addLiteral(tmpl.ops, std::string(sep) + "\"pressure\":");
+					addValue(tmpl.ops, Op::FLOAT, &button.pressure);
+				}
+				addLiteral(tmpl.ops, "}");
+			}
+		}
+
+		addLiteral(tmpl.ops, "}");
+
+		m_templates.emplace_back(tmpl);
+	}
+
+	// Leave room for the separating commas and the widest possible values
+	for (const DeviceTemplate &tmpl : m_templates) {
+		max_size += 1;
+		for (const Op &op : tmpl.ops) {
+			max_size += (op.kind == Op::LITERAL) ? op.lit_len : MAX_NUMBER_LEN;
+		}
+	}
+
+	std::sort(m_templates.begin(), m_templates.end(),
+		[](const DeviceTemplate &a, const DeviceTemplate &b) { return a.key < b.key; });
+
+	for (size_t i = 0; i < m_templates.size(); ++i) {
+		if (m_templates[i].dev == NULL) {
+			m_frame_tmpl = i;
+		}
+	}
+
+	m_info = &info;
+	m_buffer.resize(max_size);
+	m_spans.reserve(m_templates.size());
+	m_chunks.reserve(m_templates.size());
+
+	return true;
+}
+
+/**
+ * Write the frame info and the current state of every active device with
+ * a valid pose into the output buffer.
+ *
+ * Returns: size of the frame in bytes, or 0 if no device was written. The
+ * 		frame is available through data() until the next call.
+ **/
+size_t JsonEmitter::emit()
+{
+	char *p(m_buffer.data());
+	bool first(true);
+	unsigned num_devices(0);
+
+	m_spans.clear();
+	m_chunks.clear();
+	m_split = false;
+
+	*p++ = '{';
+
+	for (const DeviceTemplate &tmpl : m_templates) {
+		if (tmpl.dev != NULL) {
+			if (!tmpl.dev->isActive() || !tmpl.dev->pose_valid) {
+				continue;
+			}
+			num_devices++;
+		}
+
+		if (!first) {
+			*p++ = ',';
+		}
+		first = false;
+
+		if (tmpl.dev != NULL) {
+			Span span = { (size_t)(&tmpl - m_templates.data()), (size_t)(p - m_buffer.data()), 0 };
+			m_spans.push_back(span);
+		}
+
+		for (const Op &op : tmpl.ops) {
+			switch (op.kind)
+			{
+				case Op::LITERAL:
+				{
+					memcpy(p, m_literals.data() + op.lit_offset, op.lit_len);
+					p += op.lit_len;
+				}	break;
+
+				case Op::FLOAT:
+				{
+					double val(*(const float *)op.value);
+
+					if (std::isfinite(val)) {
+						p = nlohmann::detail::to_chars(p, p + MAX_NUMBER_LEN, val);
+					}
+					else {
+						memcpy(p, "null", 4);
+						p += 4;
+					}
+				}	break;
+
+				case Op::UINT64:
+				{
+					p = formatUnsigned(p, *(const uint64_t *)op.value);
+				}	break;
+
+				case Op::INT64:
+				{
+					p = formatSigned(p, *(const int64_t *)op.value);
+				}	break;
+
+				case Op::BOOLEAN:
+				{
+					if (*(const bool *)op.value) {
+						memcpy(p, "true", 4);
+						p += 4;
+					}
+					else {
+						memcpy(p, "false", 5);
+						p += 5;
+					}
+				}	break;
+			}
+		}
+
+		if (tmpl.dev != NULL) {
+			m_spans.back().len = (p - m_buffer.data()) - m_spans.back().offset;
+		}
+	}
+
+	if (num_devices == 0) {
+		return 0;
+	}
+
+	*p++ = '}';
+
+	size_t len(p - m_buffer.data());
+	if (m_max_size == 0 || len <= m_max_size) {
+		m_chunks.emplace_back(0, len);
+	}
+	else {
+		split(len);
+	}
+
+	return len;
+}
+
+/**
+ * Write the frame info of one chunk of a split frame, which adds the
+ * chunk's index and the number of chunks to the keys of FRAME_KEY.
+ *
+ * Returns: number of bytes written.
+ **/
+size_t JsonEmitter::formatFrameInfo(char *out, size_t chunk, size_t num_chunks) const
+{
+	char *p(out);
+
+	p = appendText(p, "\"");
+	p = appendText(p, FRAME_KEY);
+	p = appendText(p, "\":{\"capture_ns\":");
+	p = formatSigned(p, m_info->capture_ns);
+	p = appendText(p, ",\"chunk\":");
+	p = formatUnsigned(p, chunk);
+	p = appendText(p, ",\"chunks\":");
+	p = formatUnsigned(p, num_chunks);
+	p = appendText(p, ",\"pose_time_ns\":");
+	p = formatSigned(p, m_info->pose_time_ns);
+	p = appendText(p, ",\"seq\":");
+	p = formatUnsigned(p, m_info->seq);
+	p = appendText(p, "}");
+
+	return p - out;
+}
+
+/**
+ * Pack the devices written by emit() into chunks of at most the maximum
+ * message size, in key order, each a complete object with its own frame
+ * info. A device too large for a chunk of its own is sent alone anyway.
+ *
+ * Params:
+ * 		len - size of the unsplit frame in m_buffer
+ **/
+void JsonEmitter::split(size_t len)
+{
+	char info[MAX_FRAME_INFO_LEN];
+	// There are never more chunks than devices, so this bounds the frame info of every chunk
+	size_t info_max(formatFrameInfo(info, m_spans.size(), m_spans.size()));
+	size_t size(0);
+
+	// First pass: the first device and number of devices of each chunk
+	for (size_t i = 0; i < m_spans.size(); ++i) {
+		size_t need(m_spans[i].len + 1);
+
+		if (m_chunks.empty() || size + need > m_max_size) {
+			m_chunks.emplace_back(i, 0);
+			size = 2 + info_max;
+		}
+		m_chunks.back().second++;
+		size += need;
+	}
+
+	m_chunk_buffer.resize(len + m_chunks.size() * (info_max + 3));
+	m_split = true;
+
+	// Second pass: write the chunks, replacing the device ranges with their offsets and sizes
+	char *p(m_chunk_buffer.data());
+	size_t num_chunks(m_chunks.size());
+	for (size_t c = 0; c < num_chunks; ++c) {
+		size_t first(m_chunks[c].first);
+		size_t end(first + m_chunks[c].second);
+		char *start(p);
+		bool info_written(false);
+		bool first_entry(true);
+
+		*p++ = '{';
+		for (size_t i = first; i <= end; ++i) {
+			if (!info_written && (i == end || m_spans[i].tmpl > m_frame_tmpl)) {
+				if (!first_entry) {
+					*p++ = ',';
+				}
+				p += formatFrameInfo(p, c, num_chunks);
+				info_written = true;
+				first_entry = false;
+			}
+			if (i == end) {
+				break;
+			}
+
+			if (!first_entry) {
+				*p++ = ',';
+			}
+			memcpy(p, m_buffer.data() + m_spans[i].offset, m_spans[i].len);
+			p += m_spans[i].len;
+			first_entry = false;
+		}
+		*p++ = '}';
+
+		m_chunks[c] = std::make_pair(start - m_chunk_buffer.data(), p - start);
+	}
+}
+
+const char * JsonEmitter::chunkData(size_t chunk) const
+{
+	return (m_split ? m_chunk_buffer.data() : m_buffer.data()) + m_chunks[chunk].first;
+}
+
+/**
+ * Split a frame built by buildTree() into chunks of whole devices, like
+ * emit() does for compact output. Every chunk is dumped again as it grows,
+ * which is only acceptable because pretty-printed output is meant for
+ * debugging.
+ *
+ * Params:
+ * 		frame - frame to split
+ * 		max_size - maximum size of a chunk in bytes, 0 for no limit
+ * 		indent - indentation, as passed to json::dump
+ *
+ * Returns: the text of each chunk; the whole frame if it fits.
+ **/
+std::vector<std::string> JsonEmitter::dumpChunks(const json &frame, size_t max_size, int indent)
+{
+	std::vector<std::string> out(1, frame.dump(indent));
+	if (max_size == 0 || out[0].size() <= max_size || frame.find(FRAME_KEY) == frame.end()) {
+		return out;
+	}
+
+	// Size chunks with chunk numbers at least as wide as the final ones
+	json info(frame[FRAME_KEY]);
+	info["chunk"] = frame.size();
+	info["chunks"] = frame.size();
+
+	std::vector<json> chunks;
+	for (json::const_iterator it(frame.begin()); it != frame.end(); ++it) {
+		if (it.key() == FRAME_KEY) {
+			continue;
+		}
+
+		if (!chunks.empty()) {
+			json candidate(chunks.back());
+			candidate[it.key()] = it.value();
+			if (candidate.dump(indent).size() <= max_size) {
+				chunks.back() = candidate;
+				continue;
+			}
+		}
+
+		chunks.emplace_back(json::object());
+		chunks.back()[FRAME_KEY] = info;
+		chunks.back()[it.key()] = it.value();
+	}
+
+	out.clear();
+	for (size_t c = 0; c < chunks.size(); ++c) {
+		chunks[c][FRAME_KEY]["chunk"] = c;
+		chunks[c][FRAME_KEY]["chunks"] = chunks.size();
+		out.emplace_back(chunks[c].dump(indent));
+	}
+
+	return out;
+}
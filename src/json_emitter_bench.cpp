@@ -0,0 +1,105 @@
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include "mimicry_openvr/mimicry_app.hpp"
+#include "mimicry_openvr/json_emitter.hpp"
+#include "mimicry_openvr/bench_devices.hpp"
+
+
+/**
+ * Compares the precompiled JsonEmitter against building and dumping a JSON
+ * tree for a typical bimanual setup with trackers. Every frame is checked
+ * for byte identity before the two are timed.
+ *
+ * Usage: json_emitter_bench [frames]
+ **/
+
+static void randomize(std::vector<VRDevice> &devices, std::mt19937 &rng)
+{
+	std::uniform_real_distribution<float> pos(-2.0f, 2.0f);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::bernoulli_distribution coin(0.5);
+
+	for (VRDevice &dev : devices) {
+		dev.pose.pos = glm::vec3(pos(rng), pos(rng), pos(rng));
+		dev.pose.quat = glm::vec4(unit(rng), unit(rng), unit(rng), unit(rng));
+
+		for (uint64_t mask(dev.button_mask); mask != 0; mask &= mask - 1) {
+			VRButton &button(dev.buttons[__builtin_ctzll(mask)]);
+			button.pressed = coin(rng);
+			// Exercise the integral and zero special cases as well as arbitrary values
+			button.pressure = coin(rng) ? unit(rng) : (coin(rng) ? 1.0f : 0.0f);
+			button.touch_pos = glm::vec2(unit(rng), unit(rng));
+		}
+	}
+}
+
+static double elapsedNs(int64_t start)
+{
+	return FrameScheduler::monotonicNow() - start;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned frames((argc > 1) ? atoi(argv[1]) : 100000);
+	std::vector<VRDevice> devices(bench::makeDevices());
+	std::mt19937 rng(42);
+	JsonEmitter emitter;
+	FrameInfo info;
+	std::string error;
+	size_t checksum(0);
+
+	if (!emitter.compile(devices, info, error)) {
+		std::cerr << error << std::endl;
+		return 1;
+	}
+
+	// Check byte identity over a range of values, including inactive devices
+	for (unsigned i = 0; i < 10000; ++i) {
+		randomize(devices, rng);
+		devices[2 + i % 3].pose_valid = (i % 7 != 0);
+		info.seq = i;
+		info.capture_ns = (int64_t)rng() * (i % 2 ? 1 : -1);
+		info.pose_time_ns = info.capture_ns + i;
+
+		std::string expected(JsonEmitter::buildTree(devices, info).dump());
+		size_t len(emitter.emit());
+
+		if (std::string(emitter.data(), len) != expected) {
+			std::cerr << "Output mismatch on frame " << i << ":" << std::endl
+				<< "  tree:    " << expected << std::endl
+				<< "  emitter: " << std::string(emitter.data(), len) << std::endl;
+			return 1;
+		}
+	}
+
+	for (VRDevice &dev : devices) {
+		dev.pose_valid = true;
+	}
+	randomize(devices, rng);
+
+	int64_t start(FrameScheduler::monotonicNow());
+	for (unsigned i = 0; i < frames; ++i) {
+		devices[0].pose.pos.x += 1e-6f;
+		std::string output(JsonEmitter::buildTree(devices, info).dump());
+		checksum += output.size();
+	}
+	double tree_ns(elapsedNs(start) / frames);
+
+	start = FrameScheduler::monotonicNow();
+	for (unsigned i = 0; i < frames; ++i) {
+		devices[0].pose.pos.x += 1e-6f;
+		checksum += emitter.emit();
+	}
+	double emitter_ns(elapsedNs(start) / frames);
+
+	std::cout << "Frames: " << frames << " (checksum " << checksum << ")" << std::endl;
+	std::cout << "json tree + dump: " << tree_ns << " ns/frame" << std::endl;
+	std::cout << "JsonEmitter:      " << emitter_ns << " ns/frame" << std::endl;
+	std::cout << "Speedup:          " << tree_ns / emitter_ns << "x" << std::endl;
+
+	return 0;
+}
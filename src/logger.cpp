@@ -0,0 +1,288 @@
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+#include "mimicry_openvr/logger.hpp"
+
+
+// Size of the writer thread's output batch
+static const size_t WRITE_BUFFER_SIZE = 64 * 1024;
+static const int MAX_NEWLINES = 4;
+
+
+Logger::Logger() : m_enqueue_pos(0), m_dequeue_pos(0), m_dropped(0), m_level(L_INFO),
+		m_async(false), m_stopping(false)
+{
+	for (size_t i = 0; i < NUM_SLOTS; ++i) {
+		m_slots[i].seq.store(i, std::memory_order_relaxed);
+	}
+	sem_init(&m_pending, 0, 0);
+}
+
+Logger &Logger::instance()
+{
+	static Logger logger;
+	return logger;
+}
+
+/**
+ * Start the background writer. From here on, log() only queues messages.
+ **/
+void Logger::start()
+{
+	if (m_async.load()) {
+		return;
+	}
+
+	m_stopping.store(false);
+	m_writer = std::thread(&Logger::writerLoop, this);
+	m_async.store(true);
+}
+
+/**
+ * Write out everything still queued and stop the background writer. Must
+ * not race with other threads that are still logging.
+ **/
+void Logger::stop()
+{
+	if (!m_async.load()) {
+		return;
+	}
+
+	m_stopping.store(true);
+	sem_post(&m_pending);
+	m_writer.join();
+	m_async.store(false);
+}
+
+size_t Logger::formatPrefix(Level level, char *out)
+{
+	static const char *PREFIXES[] = { "[DEBUG] ", "", "[WARN] ", "[ERROR] " };
+	size_t len(strlen(PREFIXES[level]));
+
+	memcpy(out, PREFIXES[level], len);
+	return len;
+}
+
+/**
+ * Log a message if its level is enabled. Apart from the level prefix, the
+ * text is written as-is, followed by the given number of newlines; 0 lets
+ * the next message continue the same line.
+ *
+ * Params:
+ * 		level - severity of the message
+ * 		text - message text; does not need to be NUL-terminated
+ * 		len - length of the text
+ * 		newlines - number of newlines to write after the text
+ **/
+void Logger::log(Level level, const char *text, size_t len, int newlines)
+{
+	if (!enabled(level)) {
+		return;
+	}
+
+	newlines = (newlines < 0) ? 0 : (newlines > MAX_NEWLINES) ? MAX_NEWLINES : newlines;
+
+	if (!m_async.load(std::memory_order_acquire)) {
+		char prefix[16];
+		fwrite(prefix, 1, formatPrefix(level, prefix), stdout);
+		fwrite(text, 1, len, stdout);
+		for (int i = 0; i < newlines; ++i) {
+			fputc('\n', stdout);
+		}
+		fflush(stdout);
+		return;
+	}
+
+	size_t num_slots(len == 0 ? 1 : (len + SLOT_TEXT - 1) / SLOT_TEXT);
+	if (num_slots > MAX_SLOTS_PER_MESSAGE) {
+		num_slots = MAX_SLOTS_PER_MESSAGE;
+		len = num_slots * SLOT_TEXT;
+	}
+
+	// Claim num_slots consecutive slots. A slot is free for position pos when its
+	// sequence number equals pos; otherwise either another producer got there first
+	// (the enqueue position moved) or the writer has not caught up (the ring is full)
+	uint64_t pos(m_enqueue_pos.load(std::memory_order_relaxed));
+	while (true) {
+		bool free(true);
+		for (size_t i = 0; i < num_slots; ++i) {
+			if (m_slots[(pos + i) % NUM_SLOTS].seq.load(std::memory_order_acquire) != pos + i) {
+				free = false;
+				break;
+			}
+		}
+
+		if (!free) {
+			uint64_t cur(m_enqueue_pos.load(std::memory_order_relaxed));
+			if (cur == pos) {
+				m_dropped.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+			pos = cur;
+		}
+		else if (m_enqueue_pos.compare_exchange_weak(pos, pos + num_slots,
+				std::memory_order_relaxed)) {
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < num_slots; ++i) {
+		Slot &slot(m_slots[(pos + i) % NUM_SLOTS]);
+		size_t piece(len > SLOT_TEXT ? SLOT_TEXT : len);
+
+		memcpy(slot.text, text, piece);
+		slot.len = piece;
+		slot.level = level;
+		slot.more = (i + 1 < num_slots);
+		slot.newlines = newlines;
+		slot.seq.store(pos + i + 1, std::memory_order_release);
+
+		text += piece;
+		len -= piece;
+	}
+
+	sem_post(&m_pending);
+}
+
+/**
+ * Log a repeated message at most once per limiter interval. The number of
+ * messages suppressed since the last one is appended to the text.
+ **/
+void Logger::logLimited(Level level, RateLimiter &limiter, const char *text)
+{
+	if (!enabled(level)) {
+		return;
+	}
+
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	int64_t now(ts.tv_sec * 1000000000ll + ts.tv_nsec);
+
+	if (limiter.last_ns != INT64_MIN && now - limiter.last_ns < limiter.interval_ns) {
+		limiter.suppressed++;
+		return;
+	}
+
+	if (limiter.suppressed > 0) {
+		char buf[SLOT_TEXT];
+		int len(snprintf(buf, sizeof(buf), "%s (%llu similar messages suppressed)", text,
+			(unsigned long long)limiter.suppressed));
+		log(level, buf, (len < (int)sizeof(buf)) ? len : sizeof(buf) - 1);
+	}
+	else {
+		log(level, text, strlen(text));
+	}
+
+	limiter.last_ns = now;
+	limiter.suppressed = 0;
+}
+
+/**
+ * Parse a log level name as used in the parameter file.
+ *
+ * Params:
+ * 		name - "debug", "info", "warn" or "error"
+ * 		level - set to the matching level on success
+ *
+ * Returns: true if the name is valid, false otherwise.
+ **/
+bool Logger::levelFromName(const std::string &name, Level &level)
+{
+	if (name == "debug") {
+		level = L_DEBUG;
+	}
+	else if (name == "info") {
+		level = L_INFO;
+	}
+	else if (name == "warn") {
+		level = L_WARN;
+	}
+	else if (name == "error") {
+		level = L_ERROR;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Copy published messages into buf, stopping when the queue is empty or buf
+ * could not hold another slot.
+ *
+ * Params:
+ * 		continued - whether the last slot copied ended mid-message; carried
+ * 			between calls so continuation slots are not prefixed again
+ *
+ * Returns: number of bytes copied.
+ **/
+size_t Logger::drain(char *buf, size_t size, bool &continued)
+{
+	size_t used(0);
+
+	while (size - used >= SLOT_TEXT + 16 + MAX_NEWLINES) {
+		Slot &slot(m_slots[m_dequeue_pos % NUM_SLOTS]);
+
+		if (slot.seq.load(std::memory_order_acquire) != m_dequeue_pos + 1) {
+			break;
+		}
+
+		if (!continued) {
+			used += formatPrefix((Level)slot.level, buf + used);
+		}
+		memcpy(buf + used, slot.text, slot.len);
+		used += slot.len;
+
+		continued = slot.more;
+		if (!slot.more) {
+			for (int i = 0; i < slot.newlines; ++i) {
+				buf[used++] = '\n';
+			}
+		}
+
+		slot.seq.store(m_dequeue_pos + NUM_SLOTS, std::memory_order_release);
+		m_dequeue_pos++;
+	}
+
+	return used;
+}
+
+void Logger::writerLoop()
+{
+	static char buf[WRITE_BUFFER_SIZE];
+	bool continued(false);
+	uint64_t reported_drops(0);
+
+	while (true) {
+		while (sem_wait(&m_pending) != 0) {}
+
+		bool stopping(m_stopping.load());
+
+		size_t len;
+		while ((len = drain(buf, sizeof(buf), continued)) > 0) {
+			for (size_t off = 0; off < len; ) {
+				ssize_t written(write(STDOUT_FILENO, buf + off, len - off));
+				if (written <= 0) {
+					break;
+				}
+				off += written;
+			}
+		}
+
+		uint64_t drops(m_dropped.load(std::memory_order_relaxed));
+		if (drops != reported_drops && !continued) {
+			int n(snprintf(buf, sizeof(buf), "[WARN] %llu log messages dropped\n",
+				(unsigned long long)(drops - reported_drops)));
+			if (write(STDOUT_FILENO, buf, n) == n) {
+				reported_drops = drops;
+			}
+		}
+
+		if (stopping) {
+			break;
+		}
+	}
+}
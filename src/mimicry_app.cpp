@@ -1,10 +1,15 @@
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <map>
 #include <chrono>
-#include <thread>
-#include <poll.h>
+#include <cstring>
+#include <cmath>
 #include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -19,6 +24,11 @@ using json = nlohmann::json;
 typedef vr::TrackedDeviceIndex_t DevIx;
 typedef vr::VRControllerState_t DeviceState;
 typedef vr::EVRButtonId ButtonId;
+namespace haptic = mimicry::haptic;
+
+static const unsigned MIN_MTU = 576;				// Every IPv4 host must accept datagrams this large
+static const unsigned IPV4_UDP_HEADER_SIZE = 28;	// Without IP options
+static const size_t MAX_UDP_PAYLOAD = 65507;
 
 
 std::map<std::string, ButtonId> VRButton::KEY_TO_ID = {
@@ -82,64 +92,195 @@ std::string roleEnumToName(VRDevice::DeviceRole role) {
 
 
 /**
- * Print a string to the screen.
+ * Parse an output format name as used in the parameter file.
+ * 
+ * Params:
+ * 		name - "json", "json_pretty" or "binary"
+ * 		format - set to the matching format on success
+ * 
+ * Returns: true if the name is valid, false otherwise.
+ **/
+bool outputFormatFromName(std::string name, VRParams::OutputFormat &format)
+{
+	if (name == "json") {
+		format = VRParams::OUT_JSON;
+	}
+	else if (name == "json_pretty") {
+		format = VRParams::OUT_JSON_PRETTY;
+	}
+	else if (name == "binary") {
+		format = VRParams::OUT_BINARY;
+	}
+	else {
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Parse the pose quantization settings of the parameter file. The position
+ * resolution is rounded down to a power of two, i.e. a whole number of
+ * fraction bits.
+ * 
+ * Params:
+ * 		j - "_pose_quantization" object
+ * 		format - set to the matching pose format on success
+ * 		error - set to a description of the problem on failure
+ * 
+ * Returns: true if the settings describe a valid format, false otherwise.
+ **/
+bool poseFormatFromJson(const json &j, mimicry::wire::PoseFormat &format, std::string &error)
+{
+	unsigned pos_bits(j.value("position_bits", 21u));
+	double resolution(j.value("position_resolution", 0.0001));
+	unsigned quat_bits(j.value("orientation_bits", 10u));
+
+	if (!(resolution > 0) || resolution > 1) {
+		error = "Invalid pose quantization: position_resolution must be in (0, 1] m.";
+		return false;
+	}
+
+	int frac_bits(std::max(0, (int)std::ceil(-std::log2(resolution) - 1e-9)));
+	if (pos_bits < mimicry::wire::MIN_POSITION_BITS || pos_bits > mimicry::wire::MAX_POSITION_BITS
+			|| frac_bits >= (int)pos_bits) {
+		error = "Invalid pose quantization: position_bits must be in ["
+			+ std::to_string(mimicry::wire::MIN_POSITION_BITS) + ", "
+			+ std::to_string(mimicry::wire::MAX_POSITION_BITS) + "] and cover at least +-1 m.";
+		return false;
+	}
+	if (quat_bits < mimicry::wire::MIN_ORIENTATION_BITS || quat_bits > mimicry::wire::MAX_ORIENTATION_BITS) {
+		error = "Invalid pose quantization: orientation_bits must be in ["
+			+ std::to_string(mimicry::wire::MIN_ORIENTATION_BITS) + ", "
+			+ std::to_string(mimicry::wire::MAX_ORIENTATION_BITS) + "].";
+		return false;
+	}
+
+	format = mimicry::wire::PoseFormat(pos_bits, frac_bits, quat_bits);
+	return true;
+}
+
+
+/**
+ * Compile a waveform of the parameter file into the pulse length of each
+ * haptic pulse step. A waveform is a list of segments, each either a
+ * constant intensity or a linear ramp between two intensities:
+ *
+ * 		{"ms": 40, "intensity": 1.0}
+ * 		{"ms": 100, "from": 0.2, "to": 1.0}
+ *
+ * where intensities go from 0 (no pulse) to 1 (the longest pulse).
+ * 
+ * Params:
+ * 		j - "segments" array of the waveform
+ * 		pulses - set to the pulse length of every step on success
+ * 		error - set to a description of the problem on failure
+ * 
+ * Returns: true if the segments are valid, false otherwise.
+ **/
+bool waveformFromJson(const json &j, HapticScheduler::Waveform &pulses, std::string &error)
+{
+	static const double STEP_MS(HapticScheduler::PULSE_INTERVAL_NS / 1000000.0);
+
+	pulses.clear();
+	if (!j.is_array()) {
+		error = "segments must be an array.";
+		return false;
+	}
+
+	for (const json &seg : j) {
+		double ms(seg.value("ms", 0.0));
+		double from(seg.value("from", seg.value("intensity", -1.0)));
+		double to(seg.value("to", from));
+
+		if (!(ms > 0)) {
+			error = "every segment needs a positive \"ms\".";
+			return false;
+		}
+		if (!(from >= 0 && from <= 1 && to >= 0 && to <= 1)) {
+			error = "every segment needs an \"intensity\" or \"from\" and \"to\" in [0, 1].";
+			return false;
+		}
+
+		// At least one step, so that short segments are not lost
+		unsigned steps(std::max(1l, std::lround(ms / STEP_MS)));
+		for (unsigned step = 0; step < steps; ++step) {
+			double intensity(from + (to - from) * (step + 0.5) / steps);
+			pulses.push_back(std::lround(intensity * HapticScheduler::MAX_PULSE_US));
+		}
+	}
+
+	if (pulses.empty()) {
+		error = "segments cannot be empty.";
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Print a string to the screen through the logger.
  * 
  * Params:
  * 		text - text to print
  * 		newlines - number of newlines to print at the end of input string
- * 		flush - whether to flush text. Generally, only needed when
- * 			printing a large body of text with manual newlines
+ * 		level - severity of the message: L_ERROR for failures, L_WARN for
+ * 			problems the program works around
  */
-void printText(std::string text="", int newlines=1, bool flush=false)
+void printText(std::string text="", int newlines=1, Logger::Level level=Logger::L_INFO)
 {
     // TODO: Consider adding param for width of text line
-    std::cout << text;
-
-    for (int i = 0; i < newlines; i++) {
-        if (i > 1) {
-            std::cout << "\n";
-        }
-        else {
-            std::cout << std::endl;
-        }
-    }
-
-    if (flush) {
-        std::cout.flush();
-    }
+    Logger::instance().log(level, text, newlines);
 
     return;
 }
 
 /**
- * Find a device within the list indicated that matches the given role.
- * It's expected that there is only one controller for each role of left
- * and right, though no validation is performed. For trackers, the first
+ * Find a configured device that matches the given role and activation 
+ * state. There is only one controller for each role of left and right, 
+ * so those lookups are a single table access. For trackers, the first
  * one found will be returned.
  * 
  * Params:
  * 		role - role to search for
- * 		from_active - if true, will only search list of active devices.
- * 			Otherwise, only the list of inactive devices is searched
+ * 		from_active - if true, will only search active devices. Otherwise,
+ * 			only inactive devices are searched
  * 
  * Returns: Pointer to device if found, NULL otherwise.
  **/
 VRDevice * MimicryApp::findDevFromRole(VRDevice::DeviceRole role, bool from_active)
 {
-	if (from_active) {
-		std::map<DevIx, VRDevice *>::iterator it(m_devices.begin());
-		for ( ; it != m_devices.end(); ++it) {
-			if (it->second->role == role) {
-				return it->second;
-			}
+	if (role == VRDevice::DeviceRole::INVALID) {
+		return NULL;
+	}
+
+	for (int slot : m_role_slots[role]) {
+		if (m_devices[slot].isActive() == from_active) {
+			return &m_devices[slot];
 		}
 	}
-	else {
-		std::map<std::string, VRDevice *>::iterator it(m_inactive_dev.begin());
-		for ( ; it != m_inactive_dev.end(); ++it) {
-			if (it->second->role == role) {
-				return it->second;
-			}
+
+	return NULL;
+}
+
+/**
+ * Find a configured device by its name.
+ * 
+ * Params:
+ * 		name - device name, as given in the parameter file
+ * 
+ * Returns: Pointer to device if found, NULL otherwise.
+ **/
+VRDevice * MimicryApp::findDevFromName(const std::string &name)
+{
+	return findDevFromName(name.data(), name.length());
+}
+
+VRDevice * MimicryApp::findDevFromName(const char *name, size_t len)
+{
+	for (VRDevice &dev : m_devices) {
+		if (dev.name.compare(0, std::string::npos, name, len) == 0) {
+			return &dev;
 		}
 	}
 
@@ -159,30 +300,24 @@ VRDevice * MimicryApp::findDevFromRole(VRDevice::DeviceRole role, bool from_acti
  **/
 DevIx MimicryApp::findDevIndexFromRole(VRDevice::DeviceRole role)
 {
-	std::map<DevIx, VRDevice *>::iterator it(m_devices.begin());
-	for ( ; it != m_devices.end(); ++it) {
-		if (it->second->role == role) {
-			return it->first;
-		}
-	}
+	VRDevice *dev(findDevFromRole(role, true));
 
-	return 0;
+	return (dev != NULL) ? dev->ix : 0;
 }
 
 /**
- * Move a device from the list of inactive devices to the list of active 
- * devices.
- * This is a helper function to perform the actual move and performs 
+ * Bind an inactive device to an OpenVR index, making it active.
+ * This is a helper function to perform the actual binding and performs 
  * minimal validation--it should be called in the context of a broader
  * activation function. In particular, this function does not check
- * against the list of inactive devices.
+ * whether the device is already bound.
  * 
  * Params:
  * 		dev - device to activate
- * 		ix - key to associate with the device
+ * 		ix - index to bind the device to
  **/
 void MimicryApp::addDeviceToIndex(VRDevice *dev, DevIx ix) {
-	if (dev != NULL && m_devices.find(ix) == m_devices.end()) {
+	if (dev != NULL && m_ix_to_slot[ix] < 0) {
 
 		if (dev->role == VRDevice::DeviceRole::LEFT) {
 			m_left_found = true;
@@ -191,14 +326,54 @@ void MimicryApp::addDeviceToIndex(VRDevice *dev, DevIx ix) {
 			m_right_found = true;
 		}
 
-		m_inactive_dev.erase(dev->name);
-		m_devices[ix] = dev;
+		dev->ix = ix;
+		m_ix_to_slot[ix] = dev - m_devices.data();
+
+		if (dev->props_ix != ix) {
+			cacheDeviceProperties(dev, ix);
+		}
+	}
+}
+
+/**
+ * Read the device properties used on every frame from the runtime and
+ * store them with the device, so that the input loop does not need to
+ * query them again while the device stays at the same index.
+ * 
+ * Params:
+ * 		dev - device to store the properties in
+ * 		ix - OpenVR index to read the properties from
+ **/
+void MimicryApp::cacheDeviceProperties(VRDevice *dev, DevIx ix)
+{
+	for (unsigned axis = 0; axis < vr::k_unControllerStateAxisCount; ++axis) {
+		dev->axis_types[axis] = m_vrs->GetInt32TrackedDeviceProperty(ix, 
+			(vr::ETrackedDeviceProperty)(vr::Prop_Axis0Type_Int32 + axis));
+	}
+
+	dev->props_ix = ix;
+}
+
+/**
+ * Mark the cached properties for the given index as stale. Active devices
+ * read them again on the next frame, inactive devices the next time they
+ * are activated.
+ * 
+ * Params:
+ * 		ix - OpenVR index of the device whose properties changed
+ **/
+void MimicryApp::invalidateDeviceProperties(DevIx ix)
+{
+	for (VRDevice &dev : m_devices) {
+		if (dev.props_ix == ix) {
+			dev.props_ix = vr::k_unTrackedDeviceIndexInvalid;
+		}
 	}
 }
 
 /**
  * Given the index for a device in OpenVR, performs validation steps and
- * moves the device from the inactive list to the active list.
+ * binds a matching inactive device to it.
  * 
  * Params:
  * 		ix - OpenVR index for device
@@ -208,9 +383,17 @@ void MimicryApp::addDeviceToIndex(VRDevice *dev, DevIx ix) {
 VRDevice * MimicryApp::activateDevice(DevIx ix) 
 {
 	VRDevice *dev = NULL;
+
+	if (ix >= vr::k_unMaxTrackedDeviceCount) {
+		return NULL;
+	}
+	if (m_ix_to_slot[ix] >= 0) {
+		return &m_devices[m_ix_to_slot[ix]];
+	}
+
 	vr::ETrackedDeviceClass dev_class(m_vrs->GetTrackedDeviceClass(ix));
 
-	if (dev_class = vr::ETrackedDeviceClass::TrackedDeviceClass_Controller) {
+	if (dev_class == vr::ETrackedDeviceClass::TrackedDeviceClass_Controller) {
 		vr::ETrackedControllerRole role(m_vrs->GetControllerRoleForTrackedDeviceIndex(ix));
 		
 		if (role == vr::TrackedControllerRole_LeftHand) {
@@ -237,15 +420,49 @@ VRDevice * MimicryApp::activateDevice(DevIx ix)
 }
 
 /**
- * Move device at given index from active list to inactive list.
+ * Activate every configured device that is already connected. Used once at
+ * startup; after that, devices are bound and unbound through runtime
+ * events.
+ **/
+void MimicryApp::activateConnectedDevices()
+{
+	for (DevIx ix = vr::k_unTrackedDeviceIndex_Hmd; ix < vr::k_unMaxTrackedDeviceCount; ++ix) {
+		if (m_vrs->IsTrackedDeviceConnected(ix)) {
+			activateDevice(ix);
+		}
+	}
+}
+
+/**
+ * Unbind all active controllers and bind them again based on the roles
+ * currently reported by the runtime.
+ **/
+void MimicryApp::rebindControllers()
+{
+	for (VRDevice &dev : m_devices) {
+		if (dev.isActive() && (dev.role == VRDevice::DeviceRole::LEFT 
+				|| dev.role == VRDevice::DeviceRole::RIGHT)) {
+			deactivateDevice(dev.ix);
+		}
+	}
+
+	for (DevIx ix = vr::k_unTrackedDeviceIndex_Hmd; ix < vr::k_unMaxTrackedDeviceCount; ++ix) {
+		if (m_vrs->GetTrackedDeviceClass(ix) == vr::TrackedDeviceClass_Controller) {
+			activateDevice(ix);
+		}
+	}
+}
+
+/**
+ * Unbind the device at the given index, making it inactive.
  * 
  * Params:
  * 		ix - index of device to deactivate
  **/
 void MimicryApp::deactivateDevice(DevIx ix)
 {
-	if (m_devices.find(ix) != m_devices.end()) {
-		VRDevice *dev(m_devices[ix]);
+	if (ix < vr::k_unMaxTrackedDeviceCount && m_ix_to_slot[ix] >= 0) {
+		VRDevice *dev(&m_devices[m_ix_to_slot[ix]]);
 
 		if (dev->role == VRDevice::DeviceRole::LEFT) {
 			m_left_found = false;
@@ -254,8 +471,9 @@ void MimicryApp::deactivateDevice(DevIx ix)
 			m_right_found = false;
 		}
 
-		m_inactive_dev[dev->name] = dev;
-		m_devices.erase(ix);
+		dev->ix = vr::k_unTrackedDeviceIndexInvalid;
+		dev->pose_valid = false;
+		m_ix_to_slot[ix] = -1;
 	}
 }
 
@@ -344,10 +562,11 @@ glm::vec4 getOrientationFromPose(vr::HmdMatrix34_t matrix)
 bool MimicryApp::readParameters(std::string filename) {
 	json j;
 	std::ifstream in_file;
+	unsigned num_configured;
 
 	in_file.open(filename);
 	if (!in_file.is_open()) {
-		printText("Unable to open parameter file.");
+		printText("Unable to open parameter file.", 1, Logger::L_ERROR);
 		goto param_exit;
 	}
 
@@ -355,48 +574,166 @@ bool MimicryApp::readParameters(std::string filename) {
 
 	m_params.bimanual = j["_bimanual"];
 	m_params.num_devices = j["_num_devices"];
-	m_params.out_addr = j["_out_addr"];
-	m_params.out_port = j["_out_port"];
+	m_params.out_addr = j.value("_out_addr", "");
+	m_params.out_port = j.value("_out_port", 0u);
 	m_params.vibration_port = j["_vibration_port"];
 	m_params.update_freq = j["_update_freq"];
 
+	m_params.out_addrs = j.value("_out_addrs", std::vector<std::string>());
+	m_params.unix_sndbuf = j.value("_unix_sndbuf", 0);
+	m_params.mcast_group = j.value("_mcast_group", "");
+	m_params.mtu = j.value("_mtu", 1500u);
+	m_params.mcast.ttl = j.value("_mcast_ttl", 1);
+	m_params.mcast.interface = j.value("_mcast_interface", "");
+	m_params.mcast.loopback = j.value("_mcast_loopback", true);
+	m_params.shm_name = j.value("_shm_name", "");
+	m_params.shm_ring_size = j.value("_shm_ring_size", ShmWriter::DEFAULT_RING_SIZE);
+	m_params.control_addr = j.value("_control_addr", "127.0.0.1");
+	m_params.control_port = j.value("_control_port", 0u);
+	m_params.subscription_dests = j.value("_subscription_destinations", std::vector<std::string>());
+	m_params.subscription_timeout = j.value("_subscription_timeout", 10u);
+	m_params.echo_frames = j.value("_echo_frames", false);
+	m_params.io_uring = j.value("_io_uring", false);
+	m_params.pose_snapshot = j.value("_pose_snapshot", false);
+	m_params.pose_prediction = j.value("_pose_prediction", 0.0f);
+
+	if (!Logger::levelFromName(j.value("_log_level", "info"), m_params.log_level)) {
+		printText("Invalid log level specified. Valid values are 'debug', 'info', 'warn' and 'error'.", 1, Logger::L_ERROR);
+		goto param_exit;
+	}
+	Logger::instance().setLevel(m_params.log_level);
+
+	if (!FrameScheduler::policyFromName(j.value("_overrun_policy", "skip"), m_params.overrun_policy)) {
+		printText("Invalid overrun policy specified. Valid values are 'skip' and 'catch_up'.", 1, Logger::L_ERROR);
+		goto param_exit;
+	}
+	if (m_params.mtu != 0 && m_params.mtu < MIN_MTU) {
+		printText("Invalid MTU specified. The MTU must be at least " + std::to_string(MIN_MTU) + " bytes.", 1, Logger::L_ERROR);
+		goto param_exit;
+	}
+	if (m_params.pose_prediction < 0) {
+		printText("Pose prediction time cannot be negative.", 1, Logger::L_ERROR);
+		goto param_exit;
+	}
+	if (!outputFormatFromName(j.value("_out_format", "json"), m_params.out_format)) {
+		printText("Invalid output format specified. Valid values are 'json', 'json_pretty' and 'binary'.", 1, Logger::L_ERROR);
+		goto param_exit;
+	}
+	m_params.schema_interval = j.value("_schema_interval", 1000);
+
+	m_params.batch_frames = j.value("_batch_frames", 0u);
+	m_params.batch_latency = j.value("_batch_latency", 5.0f);
+	if (m_params.batch_frames > 1 && m_params.batch_latency <= 0) {
+		printText("Batch latency must be positive.", 1, Logger::L_ERROR);
+		goto param_exit;
+	}
+
+	m_params.delta.keyframe_frames = j.value("_keyframe_frames", 0u);
+	m_params.delta.keyframe_ms = j.value("_keyframe_interval", 0u);
+	{
+		json eps(j.value("_delta_epsilon", json::object()));
+		m_params.delta.position_epsilon = eps.value("position", 0.0001f);
+		m_params.delta.orientation_epsilon = eps.value("orientation", 0.0001f);
+		m_params.delta.velocity_epsilon = eps.value("velocity", 0.001f);
+		m_params.delta.analog_epsilon = eps.value("analog", 0.001f);
+	}
+	if (m_params.delta.position_epsilon < 0 || m_params.delta.orientation_epsilon < 0
+			|| m_params.delta.velocity_epsilon < 0 || m_params.delta.analog_epsilon < 0) {
+		printText("Delta epsilons cannot be negative.", 1, Logger::L_ERROR);
+		goto param_exit;
+	}
+	if (m_params.delta.enabled() && m_params.out_format != VRParams::OUT_BINARY) {
+		printText("Delta encoding is only available with binary output; sending full frames.", 1, Logger::L_WARN);
+	}
+	if (j.contains("_pose_quantization")) {
+		std::string error;
+		if (!poseFormatFromJson(j["_pose_quantization"], m_params.pose_format, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			goto param_exit;
+		}
+	}
+	if (m_params.pose_format.quantized() && m_params.out_format != VRParams::OUT_BINARY) {
+		printText("Pose quantization is only available with binary output; sending float poses.", 1, Logger::L_WARN);
+	}
+	if (j.contains("_haptic_waveforms")) {
+		for (const json &wave : j["_haptic_waveforms"]) {
+			std::string name(wave.value("name", ""));
+			HapticScheduler::Waveform pulses;
+			std::string error;
+
+			if (name.empty() || name.find(':') != std::string::npos) {
+				printText("Every haptic waveform needs a name, without ':'.", 1, Logger::L_ERROR);
+				goto param_exit;
+			}
+			if (m_haptics.findWaveform(name.data(), name.length()) >= 0) {
+				printText("Duplicate haptic waveform name specified: " + name, 1, Logger::L_ERROR);
+				goto param_exit;
+			}
+			if (m_haptics.numWaveforms() >= haptic::MAX_WAVEFORMS) {
+				printText("At most " + std::to_string(haptic::MAX_WAVEFORMS) + " haptic waveforms can be defined.", 1, Logger::L_ERROR);
+				goto param_exit;
+			}
+			if (!waveformFromJson(wave.value("segments", json()), pulses, error)) {
+				printText("Invalid haptic waveform '" + name + "': " + error, 1, Logger::L_ERROR);
+				goto param_exit;
+			}
+			m_haptics.defineWaveform(name, pulses);
+		}
+	}
+
+	// Program-wide settings are prefixed with '_', everything else is a device
+	num_configured = 0;
+	for (json::iterator it(j.begin()); it != j.end(); ++it) {
+		if (it.key().compare(0, 1, "_") != 0) {
+			num_configured++;
+		}
+	}
+
 	if (m_params.num_devices <= 0 || m_params.num_devices > vr::k_unMaxTrackedDeviceCount) {
-		printText("Invalid number of devices specified.");
+		printText("Invalid number of devices specified.", 1, Logger::L_ERROR);
 		goto param_exit;
 	}
-	if (m_params.num_devices != (j.size() - m_params.NUM_PARAMS)) {
-		printText("The number of devices configured does not match '_num_devices'.");
+	if (m_params.num_devices != num_configured) {
+		printText("The number of devices configured does not match '_num_devices'.", 1, Logger::L_ERROR);
 		goto param_exit;
 	}
 	if (m_params.bimanual && m_params.num_devices < 2) {
-		printText("At least 2 devices must be specified for bimanual control.");
+		printText("At least 2 devices must be specified for bimanual control.", 1, Logger::L_ERROR);
 		goto param_exit;
 	}
 
+	m_devices.resize(m_params.num_devices);
+	std::fill(m_ix_to_slot, m_ix_to_slot + vr::k_unMaxTrackedDeviceCount, -1);
+
 	for (int i = 0; i < m_params.num_devices; ++i) {
-		VRDevice *dev(new VRDevice());
+		VRDevice *dev(&m_devices[i]);
 		std::string cur_dev("dev" + std::to_string(i));
 
 		dev->name = j[cur_dev]["_name"];
 		dev->role = roleNameToEnum(j[cur_dev]["_role"]);
 
+		for (int slot = 0; slot < i; ++slot) {
+			if (m_devices[slot].name == dev->name) {
+				printText("Duplicate device name specified: " + dev->name, 1, Logger::L_ERROR);
+				goto param_exit;
+			}
+		}
+
 		if (dev->role == VRDevice::DeviceRole::TRACKER) {
+			// Trackers have no buttons and always publish their pose
+			dev->track_pose = true;
+			m_role_slots[dev->role].emplace_back(i);
 			continue;
 		}
 
 		dev->track_pose = j[cur_dev]["_track_pose"];
 
-		if (m_inactive_dev.find(dev->name) != m_inactive_dev.end()) {
-			printText("Duplicate device name specified: " + dev->name);
-			goto param_exit;
-		}
-
 		switch (dev->role)
 		{
 			case VRDevice::DeviceRole::LEFT:
 			{
 				if (m_left_config) {
-					printText("Multiple left controllers specified.");
+					printText("Multiple left controllers specified.", 1, Logger::L_ERROR);
 					goto param_exit;
 				}
 				m_left_config = true;
@@ -405,7 +742,7 @@ bool MimicryApp::readParameters(std::string filename) {
 			case VRDevice::DeviceRole::RIGHT:
 			{
 				if (m_right_config) {
-					printText("Multiple right controllers specified.");
+					printText("Multiple right controllers specified.", 1, Logger::L_ERROR);
 					goto param_exit;
 				}
 				m_right_config = true;
@@ -418,7 +755,7 @@ bool MimicryApp::readParameters(std::string filename) {
 
 			default:
 			{
-				printText("Invalid device role for " + dev->name);
+				printText("Invalid device role for " + dev->name, 1, Logger::L_ERROR);
 				goto param_exit;
 			}
 		}
@@ -428,20 +765,20 @@ bool MimicryApp::readParameters(std::string filename) {
 			std::string but_key(it.key());
 
 			if (VRButton::KEY_TO_ID.find(but_key) == VRButton::KEY_TO_ID.end()) {
-				printText("Invalid button ID: " + but_key);
+				printText("Invalid button ID: " + but_key, 1, Logger::L_ERROR);
 				goto param_exit;
 			}
 
 			vr::EVRButtonId cur_but = VRButton::KEY_TO_ID.at(but_key);
-			VRButton *but(new VRButton());
+			VRButton *but(&dev->buttons[cur_but]);
 			but->id = cur_but;
 
 			but->name = j[cur_dev]["buttons"][but_key]["name"];
 			
-			std::map<ButtonId, VRButton *>::iterator but_it = dev->buttons.begin();
-			for ( ; but_it != dev->buttons.end(); ++but_it) {
-				if (but_it->second->name == but->name) {
-					printText("Duplicate button name: " + but->name + " for device " + dev->name);
+			for (int id = 0; id < vr::k_EButton_Max; ++id) {
+				if (id != cur_but && dev->hasButton((ButtonId)id) 
+						&& dev->buttons[id].name == but->name) {
+					printText("Duplicate button name: " + but->name + " for device " + dev->name, 1, Logger::L_ERROR);
 					goto param_exit;
 				}
 			}
@@ -450,24 +787,29 @@ bool MimicryApp::readParameters(std::string filename) {
 			json::iterator t_it_end(j[cur_dev]["buttons"][but_key]["types"].end());
 			for ( ; t_it != t_it_end; ++t_it) {
 				std::string cur_type(t_it.key());
+				int type(0);
+
+				while (type < VRButton::TYPE_NUM && cur_type != VRButton::typeName(type)) {
+					type++;
+				}
 
-				if (cur_type != "boolean" && cur_type != "pressure" && cur_type != "2d") {
-					printText("Invalid button data input type: " + cur_type);
+				if (type == VRButton::TYPE_NUM) {
+					printText("Invalid button data input type: " + cur_type, 1, Logger::L_ERROR);
 					goto param_exit;
 				}
 
-				but->val_types[cur_type] = j[cur_dev]["buttons"][but_key]["types"][cur_type];
+				but->val_types[type] = j[cur_dev]["buttons"][but_key]["types"][cur_type];
 			}
 			
-			dev->buttons[cur_but] = but;
+			dev->button_mask |= vr::ButtonMaskFromId(cur_but);
 		}
 
-		m_inactive_dev[dev->name] = dev;
+		m_role_slots[dev->role].emplace_back(i);
 	}
 
 	if (m_params.bimanual && (!m_left_config || !m_right_config)) {
-		printText("Bimanual mode was specified, but left and right controllers are not\n", 0);
-		printText("both configured.");
+		printText("Bimanual mode was specified, but left and right controllers are not\n", 0, Logger::L_ERROR);
+		printText("both configured.", 1, Logger::L_ERROR);
 		goto param_exit;
 	}
 
@@ -482,6 +824,81 @@ param_exit:
 
 
 
+/**
+ * Register the configured output destinations with the publisher and open
+ * its socket. The primary destination is _out_addr/_out_port, if a port
+ * was given; every entry of _out_addrs and the multicast group, if any,
+ * are added after it. No destination is needed if subscriptions are
+ * enabled.
+ * 
+ * Returns: true if successful, false otherwise.
+ **/
+bool MimicryApp::configurePublisher()
+{
+	std::string error;
+
+	if (m_params.out_port != 0
+			&& !m_publisher.addDestination(m_params.out_addr, m_params.out_port, error)) {
+		printText(error, 1, Logger::L_ERROR);
+		return false;
+	}
+
+	for (const std::string &spec : m_params.out_addrs) {
+		std::string addr;
+		unsigned port;
+
+		if (spec.compare(0, 5, "unix:") == 0) {
+			if (!m_publisher.addUnixDestination(spec.substr(5), error)) {
+				printText(error, 1, Logger::L_ERROR);
+				return false;
+			}
+			continue;
+		}
+
+		if (!Publisher::parseEndpoint(spec, addr, port)) {
+			printText("Invalid output destination: " + spec + ". Expected 'address:port' or 'unix:path'.", 1, Logger::L_ERROR);
+			return false;
+		}
+		if (!m_publisher.addDestination(addr, port, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			return false;
+		}
+	}
+
+	if (!m_params.mcast_group.empty()) {
+		std::string addr;
+		unsigned port;
+
+		if (!Publisher::parseEndpoint(m_params.mcast_group, addr, port)) {
+			printText("Invalid multicast group: " + m_params.mcast_group + ". Expected 'address:port'.", 1, Logger::L_ERROR);
+			return false;
+		}
+		if (!m_publisher.addMulticastGroup(addr, port, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			return false;
+		}
+		m_publisher.setMulticastOptions(m_params.mcast);
+	}
+
+	m_publisher.setUnixSendBuffer(m_params.unix_sndbuf);
+	m_publisher.setIoUring(m_params.io_uring);
+
+	// With a control port, clients can subscribe instead, so a fixed destination is optional
+	if (m_publisher.destinations().empty() && m_params.control_port != 0) {
+		return true;
+	}
+
+	if (!m_publisher.open(error)) {
+		printText(error, 1, Logger::L_ERROR);
+		return false;
+	}
+	if (m_params.io_uring && !m_publisher.ringError().empty()) {
+		printText("io_uring is not available for output (" + m_publisher.ringError() + "); using sendmmsg.", 1, Logger::L_WARN);
+	}
+
+	return true;
+}
+
 /**
  * Perform initialization steps for the mimicry_control app.
  * 
@@ -496,27 +913,82 @@ bool MimicryApp::appInit(std::string filename)
 		return false;
 	}
 
-	if ((m_socket = socket(AF_INET, SOCK_DGRAM, 0)) == 0) {
-		printText("Could not initialize socket.");
+	if (!configurePublisher()) {
 		return false;
 	}
 
-	m_address.sin_family = AF_INET;
-	m_address.sin_port = htons(m_params.out_port);
+	if (!m_params.shm_name.empty()) {
+		std::string error;
+		if (!m_shm.open(m_params.shm_name, m_devices, m_params.shm_ring_size, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			return false;
+		}
+	}
+
+	if (m_params.control_port != 0) {
+		std::string error;
+		m_subscriptions.setAllowedDestinations(m_params.subscription_dests);
+		if (!m_subscriptions.open(m_params.control_addr, m_params.control_port, m_params.subscription_timeout,
+				m_params.schema_interval, maxMessageSize(), error)) {
+			printText(error, 1, Logger::L_ERROR);
+			return false;
+		}
+	}
+
+	if (m_params.batch_frames > 1) {
+		// Without an MTU, batches are only bounded by the largest UDP payload
+		size_t max_size((m_params.mtu > 0) ? maxMessageSize() : MAX_UDP_PAYLOAD);
+		m_batcher.configure(batchFraming(), m_params.batch_frames,
+			(int64_t)(m_params.batch_latency * 1000000.0), max_size);
+
+		char text[128];
+		snprintf(text, sizeof(text), "Batching up to %u frames per datagram, sent within %g ms.",
+			m_params.batch_frames, m_params.batch_latency);
+		printText(text);
+	}
+
+	m_emitter.setMaxMessageSize(maxOutputMessageSize());
+	m_encoder.setMaxMessageSize(maxOutputMessageSize());
+
+	if (m_params.out_format == VRParams::OUT_JSON) {
+		std::string error;
+		if (!m_emitter.compile(m_devices, m_frame_info, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			return false;
+		}
+	}
+	else if (m_params.out_format == VRParams::OUT_BINARY) {
+		std::string error;
+		m_encoder.setDelta(m_params.delta);
+		m_encoder.setPoseFormat(m_params.pose_format);
+		if (m_params.pose_format.quantized()) {
+			const mimicry::wire::PoseFormat &fmt(m_params.pose_format);
+			char text[128];
+			snprintf(text, sizeof(text), "Quantizing poses to %g mm over +-%g m, %zu bytes per pose.",
+				fmt.resolution() * 1000.0, fmt.range(), fmt.poseSize());
+			printText(text);
+		}
+		if (!m_encoder.configure(m_devices, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			return false;
+		}
+
+		// Announce the schema right away; it is repeated periodically from then on
+		for (size_t chunk = 0; chunk < m_encoder.numSchemaChunks(); ++chunk) {
+			sendOutput(m_encoder.schemaData(chunk), m_encoder.schemaSize(chunk));
+		}
+		m_last_schema_ns = FrameScheduler::monotonicNow();
+	}
 
-	if (m_params.out_addr == "") {
-		m_address.sin_addr.s_addr = INADDR_ANY; 
+	// Convert refresh frequency from Hz to actual time for each loop. A frequency of 0
+	// leaves the loop free-running, publishing as soon as a new sample is available
+	if (m_params.update_freq > 0) {
+		m_refresh_time = std::chrono::duration<double, std::milli>(1000.0 / m_params.update_freq);
 	}
 	else {
-		if(inet_pton(AF_INET, m_params.out_addr.c_str(), &m_address.sin_addr) <= 0)  
-    	{ 
-			printText("Invalid address specified."); 
-			return false; 
-    	} 
+		m_refresh_time = std::chrono::duration<double, std::milli>(0);
 	}
-   
-	// Convert refresh frequency from Hz to actual time for each loop
-	m_refresh_time = std::chrono::duration<double, std::milli>(1000 / m_params.update_freq);
+	m_scheduler.configure(m_params.update_freq, m_params.overrun_policy);
 
 	return true;
 }
@@ -524,47 +996,71 @@ bool MimicryApp::appInit(std::string filename)
 /**
  * Process state data for all configured devices, along with any events
  * or other input.
+ * 
+ * Returns: true if any device reported a new sample (a new controller
+ * 		packet or a changed pose) since the last call, false otherwise.
  **/
-void MimicryApp::handleInput()
+bool MimicryApp::handleInput()
 {
-	// Mark all devices as deactivated and reactivate them if still connected
-	std::vector<DevIx> ix_queue;
-	std::map<DevIx, VRDevice *>::iterator it(m_devices.begin());
-	for ( ; it != m_devices.end(); ++it) {
-		ix_queue.emplace_back(it->first);
+	bool fresh(false);
+
+	vr::VREvent_t event;
+	while (m_vrs->PollNextEvent(&event, sizeof(event))) {
+		processEvent(event);
 	}
 
-	for (auto ix : ix_queue) {
-		// Deletes indexes from m_devices, so shouldn't iterate over it at the same time
-		deactivateDevice(ix);
+	// Poses are sampled now, and describe the device positions at the end of the
+	// prediction interval (which is only configurable for snapshots)
+	m_frame_info.capture_ns = FrameScheduler::realtimeNow();
+	m_frame_info.pose_time_ns = m_frame_info.capture_ns
+		+ (m_params.pose_snapshot ? (int64_t)(m_params.pose_prediction * 1e6) : 0);
+
+	if (m_params.pose_snapshot) {
+		// A single call samples every device at the same tracking instant
+		m_vrs->GetDeviceToAbsoluteTrackingPose(vr::TrackingUniverseStanding, 
+			m_params.pose_prediction / 1000.0f, m_poses, vr::k_unMaxTrackedDeviceCount);
 	}
 
-	for (unsigned ix = vr::k_unTrackedDeviceIndex_Hmd; ix < vr::k_unMaxTrackedDeviceCount; ++ix) {
-		if (!m_vrs->IsTrackedDeviceConnected(ix)) {
+	for (VRDevice &dev_entry : m_devices) {
+		if (!dev_entry.isActive()) {
 			continue;
 		}
 
-		vr::TrackedDevicePose_t dev_pose;
+		VRDevice *dev(&dev_entry);
+		DevIx ix(dev->ix);
+		bool is_controller(dev->role == VRDevice::DeviceRole::LEFT 
+			|| dev->role == VRDevice::DeviceRole::RIGHT);
+		vr::TrackedDevicePose_t &dev_pose(m_poses[ix]);
 		DeviceState dev_state;
-		m_vrs->GetControllerStateWithPose(vr::TrackingUniverseStanding, ix, &dev_state, 
-			sizeof(dev_state), &dev_pose);
 
-		if (!dev_pose.bPoseIsValid) {
-			continue;
+		if (m_params.pose_snapshot) {
+			// Pose was already sampled above, so only controllers need their input state
+			dev_state.unPacketNum = dev->packet_num;
+			if (is_controller) {
+				m_vrs->GetControllerState(ix, &dev_state, sizeof(dev_state));
+			}
+		}
+		else {
+			m_vrs->GetControllerStateWithPose(vr::TrackingUniverseStanding, ix, &dev_state, 
+				sizeof(dev_state), &dev_pose);
 		}
 
-		VRDevice *dev = activateDevice(ix);
-		if (dev == NULL) {
+		dev->pose_valid = dev_pose.bPoseIsValid;
+		if (!dev->pose_valid) {
 			continue;
 		}
 
+		if (dev->props_ix != ix) {
+			cacheDeviceProperties(dev, ix);
+		}
+
 		// Exclude trackers from button handling
-		if (dev->role == VRDevice::DeviceRole::LEFT || dev->role == VRDevice::DeviceRole::RIGHT) {
-			std::map<ButtonId, VRButton *>::iterator it(dev->buttons.begin());
-			for ( ; it != dev->buttons.end(); ++it) {
-				VRButton *button(it->second);
-					
-				ButtonId id(it->first);
+		if (is_controller) {
+			// Visit the configured buttons only, lowest ID first
+			for (uint64_t mask(dev->button_mask); mask != 0; mask &= mask - 1) {
+				ButtonId id((ButtonId)__builtin_ctzll(mask));
+				VRButton *button(&dev->buttons[id]);
+
 				// NOTE: OpenVR has built-in pressure thresholds to identify a button as pressed
 				bool pressed((vr::ButtonMaskFromId(id) & dev_state.ulButtonPressed) != 0);
 
@@ -581,205 +1077,745 @@ void MimicryApp::handleInput()
 					}	break;
 
 					case vr::k_EButton_Axis0:
-					{
-						button->pressed = pressed;
-						int prop(m_vrs->GetInt32TrackedDeviceProperty(ix, 
-							(vr::ETrackedDeviceProperty)(vr::Prop_Axis0Type_Int32 + 0)));
-						handleButtonByProp(button, dev_state.rAxis[0], prop);
-					}	break;
-
 					case vr::k_EButton_Axis1:
-					{
-						button->pressed = pressed;
-						int prop(m_vrs->GetInt32TrackedDeviceProperty(ix, 
-							(vr::ETrackedDeviceProperty)(vr::Prop_Axis0Type_Int32 + 1)));
-						handleButtonByProp(button, dev_state.rAxis[1], prop);
-					}	break;
-
 					case vr::k_EButton_Axis2:
-					{
-						button->pressed = pressed;
-						int prop(m_vrs->GetInt32TrackedDeviceProperty(ix, 
-							(vr::ETrackedDeviceProperty)(vr::Prop_Axis0Type_Int32 + 2)));
-						handleButtonByProp(button, dev_state.rAxis[2], prop);
-					}	break;
-
 					case vr::k_EButton_Axis3:
-					{
-						button->pressed = pressed;
-						int prop(m_vrs->GetInt32TrackedDeviceProperty(ix, 
-							(vr::ETrackedDeviceProperty)(vr::Prop_Axis0Type_Int32 + 3)));
-						handleButtonByProp(button, dev_state.rAxis[3], prop);
-					}	break;
-
 					case vr::k_EButton_Axis4:
 					{
 						button->pressed = pressed;
-						int prop(m_vrs->GetInt32TrackedDeviceProperty(ix, 
-							(vr::ETrackedDeviceProperty)(vr::Prop_Axis0Type_Int32 + 4)));
-						handleButtonByProp(button, dev_state.rAxis[4], prop);
+						unsigned axis(id - vr::k_EButton_Axis0);
+						handleButtonByProp(button, dev_state.rAxis[axis], dev->axis_types[axis]);
 					}	break;
 
 				}
 			}
 		}
 
+		VRPose prev_pose(dev->pose);
 		dev->pose.pos = getPositionFromPose(dev_pose.mDeviceToAbsoluteTracking);
 		dev->pose.quat = getOrientationFromPose(dev_pose.mDeviceToAbsoluteTracking);
-	}	
+		dev->pose.vel = glm::vec3(dev_pose.vVelocity.v[0], dev_pose.vVelocity.v[1],
+			dev_pose.vVelocity.v[2]);
+		dev->pose.ang_vel = glm::vec3(dev_pose.vAngularVelocity.v[0], dev_pose.vAngularVelocity.v[1],
+			dev_pose.vAngularVelocity.v[2]);
+
+		if (dev_state.unPacketNum != dev->packet_num 
+				|| memcmp(&prev_pose, &dev->pose, sizeof(VRPose)) != 0) {
+			dev->packet_num = dev_state.unPacketNum;
+			fresh = true;
+		}
+	}
+
+	return fresh;
 }
 
 /**
- * Publish state data for all configured devices in JSON format.
+ * Handle a single event from the runtime.
+ * 
+ * Params:
+ * 		event - event to process
+ * 
+ * Returns: true if the event was relevant to the app, false otherwise.
  **/
-void MimicryApp::postOutputData()
+bool MimicryApp::processEvent(const vr::VREvent_t &event)
 {
-	json j;
-
-	if (m_params.bimanual && (!m_left_found || !m_right_found)) {
-		printText("No data published due to missing devices.");
+	switch (event.eventType)
+	{
+		case vr::VREvent_PropertyChanged:
+		{
+			vr::ETrackedDeviceProperty prop(event.data.property.prop);
+			if (prop < vr::Prop_Axis0Type_Int32 
+					|| prop >= vr::Prop_Axis0Type_Int32 + (int)vr::k_unControllerStateAxisCount) {
+				return false;
+			}
+			invalidateDeviceProperties(event.trackedDeviceIndex);
+		}	break;
+
+		case vr::VREvent_TrackedDeviceActivated:
+		{
+			activateDevice(event.trackedDeviceIndex);
+		}	break;
+
+		case vr::VREvent_TrackedDeviceDeactivated:
+		{
+			deactivateDevice(event.trackedDeviceIndex);
+			invalidateDeviceProperties(event.trackedDeviceIndex);
+		}	break;
+
+		case vr::VREvent_TrackedDeviceRoleChanged:
+		{
+			// Roles can be swapped between controllers, so all of them are rebound at once
+			rebindControllers();
+		}	break;
+
+		case vr::VREvent_TrackedDeviceUpdated:
+		{
+			invalidateDeviceProperties(event.trackedDeviceIndex);
+		}	break;
+
+		default:
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Publish state data for all configured devices in the configured output
+ * format, to shared memory if enabled, and to the subscribers that are
+ * due for a frame.
+ **/
+void MimicryApp::postOutputData()
+{
+	// Shared memory carries every device's state flags, so local readers get every
+	// frame and decide for themselves what is missing
+	if (m_shm.isOpen()) {
+		m_shm.publish(m_devices, m_frame_info);
+	}
+
+	if (m_params.bimanual && (!m_left_found || !m_right_found 
+			|| !findDevFromRole(VRDevice::DeviceRole::LEFT, true)->pose_valid
+			|| !findDevFromRole(VRDevice::DeviceRole::RIGHT, true)->pose_valid)) {
+		Logger::instance().logLimited(Logger::L_WARN, m_missing_limiter,
+			"No data published due to missing devices.");
+		return;
+	}
+
+	m_subscriptions.publish(m_devices, m_frame_info);
+	for (FrameSink *sink : m_sinks) {
+		sink->publish(m_devices, m_frame_info);
+	}
+
+	switch (m_params.out_format)
+	{
+		case VRParams::OUT_JSON:
+		case VRParams::OUT_JSON_PRETTY:
+		{
+			postJsonData();
+		}	break;
+
+		case VRParams::OUT_BINARY:
+		{
+			postBinaryData();
+		}	break;
+	}
+}
+
+/**
+ * Publish state data for all configured devices in JSON format. Compact
+ * frames are written by the precompiled emitter; pretty-printed frames go
+ * through a full JSON tree.
+ **/
+void MimicryApp::postJsonData()
+{
+	if (m_params.out_format == VRParams::OUT_JSON_PRETTY) {
+		json j(JsonEmitter::buildTree(m_devices, m_frame_info));
+
+		if (j.empty()) {
+			Logger::instance().logLimited(Logger::L_WARN, m_inactive_limiter,
+				"No devices are currently active.");
+			return;
+		}
+
+		for (const std::string &output : JsonEmitter::dumpChunks(j, maxOutputMessageSize(), 3)) {
+			sendOutput(output.c_str(), output.size());
+			if (m_params.echo_frames) {
+				Logger::instance().log(Logger::L_INFO, output);
+			}
+		}
+		endFrame();
 		return;
 	}
 
-	if (m_devices.size() == 0) {
-		printText("No devices are currently active.");
+	size_t len(m_emitter.emit());
+	if (len == 0) {
+		Logger::instance().logLimited(Logger::L_WARN, m_inactive_limiter,
+			"No devices are currently active.");
 		return;
 	}
 
-	std::map<DevIx, VRDevice *>::iterator it(m_devices.begin());
-	for ( ; it != m_devices.end(); ++it) {
-		VRDevice *dev(it->second);
-		
-		j[dev->name]["_role"] = roleEnumToName(dev->role);
+	for (size_t chunk = 0; chunk < m_emitter.numChunks(); ++chunk) {
+		sendOutput(m_emitter.chunkData(chunk), m_emitter.chunkSize(chunk));
+		if (m_params.echo_frames) {
+			Logger::instance().log(Logger::L_INFO, m_emitter.chunkData(chunk), m_emitter.chunkSize(chunk));
+		}
+	}
+	endFrame();
+}
+
+/**
+ * Publish state data for all configured devices in the binary format
+ * described in wire_format.hpp. The schema is re-sent every
+ * schema_interval msecs so that receivers joining late can decode frames.
+ **/
+void MimicryApp::postBinaryData()
+{
+	int64_t now(FrameScheduler::monotonicNow());
+	if (now - m_last_schema_ns >= m_params.schema_interval * 1000000ll) {
+		for (size_t chunk = 0; chunk < m_encoder.numSchemaChunks(); ++chunk) {
+			sendOutput(m_encoder.schemaData(chunk), m_encoder.schemaSize(chunk));
+		}
+		m_last_schema_ns = now;
+	}
 
-		VRPose dev_pose = dev->pose;
-		j[dev->name]["pose"]["position"]["x"] = dev_pose.pos.x;
-		j[dev->name]["pose"]["position"]["y"] = dev_pose.pos.y;
-		j[dev->name]["pose"]["position"]["z"] = dev_pose.pos.z;
+	size_t len(m_encoder.encodeFrame(m_devices, m_frame_info));
+	if (len == 0) {
+		Logger::instance().logLimited(Logger::L_WARN, m_inactive_limiter,
+			"No devices are currently active.");
+		return;
+	}
 
-		j[dev->name]["pose"]["orientation"]["x"] = dev_pose.quat.x;
-		j[dev->name]["pose"]["orientation"]["y"] = dev_pose.quat.y;
-		j[dev->name]["pose"]["orientation"]["z"] = dev_pose.quat.z;
-		j[dev->name]["pose"]["orientation"]["w"] = dev_pose.quat.w;
+	for (size_t chunk = 0; chunk < m_encoder.numFrameChunks(); ++chunk) {
+		sendOutput(m_encoder.frameChunkData(chunk), m_encoder.frameChunkSize(chunk));
+	}
+	endFrame();
+}
 
-		if (dev->role == VRDevice::DeviceRole::TRACKER) {
+/**
+ * Send a serialized message through the output socket.
+ * 
+ * Params:
+ * 		data - message to send
+ * 		len - size of the message in bytes
+ **/
+void MimicryApp::sendOutput(const void *data, size_t len)
+{
+	if (m_batcher.enabled()) {
+		int64_t now(FrameScheduler::monotonicNow());
+		if (m_batcher.add(data, len, now)) {
+			return;
+		}
+
+		// Full; start a new batch, unless the message is too large for any batch
+		flushBatch();
+		if (m_batcher.add(data, len, now)) {
+			return;
+		}
+	}
+
+	m_publisher.send(data, len);
+}
+
+/**
+ * Finish publishing the current frame: advance the sequence number, and
+ * send the batch once it holds the configured number of frames.
+ **/
+void MimicryApp::endFrame()
+{
+	m_frame_info.seq++;
+
+	if (m_batcher.enabled()) {
+		m_batcher.endFrame();
+		if (m_batcher.full()) {
+			flushBatch();
+		}
+	}
+}
+
+/**
+ * Send the messages batched so far, if any, as a single datagram.
+ **/
+void MimicryApp::flushBatch()
+{
+	size_t len(m_batcher.finish());
+
+	if (len > 0) {
+		m_publisher.send(m_batcher.data(), len);
+	}
+	m_batcher.clear();
+}
+
+/**
+ * Get the largest message that can be sent without IP fragmentation, given
+ * the configured path MTU.
+ * 
+ * Returns: maximum UDP payload in bytes, or 0 if frames are never split.
+ **/
+size_t MimicryApp::maxMessageSize() const
+{
+	return (m_params.mtu > 0) ? m_params.mtu - IPV4_UDP_HEADER_SIZE : 0;
+}
+
+/**
+ * Get the largest message the output formats may produce. With batching,
+ * room is left for the batch framing, so every message fits in a batch.
+ * 
+ * Returns: maximum message size in bytes, or 0 if frames are never split.
+ **/
+size_t MimicryApp::maxOutputMessageSize() const
+{
+	if (m_params.mtu == 0 || m_params.batch_frames <= 1) {
+		return maxMessageSize();
+	}
+
+	return maxMessageSize() - FrameBatcher::overhead(batchFraming());
+}
+
+/**
+ * Act on one datagram received on the vibration socket, either binary
+ * haptic commands or a text command.
+ **/
+void MimicryApp::handleVibrationData(const uint8_t *data, size_t len)
+{
+	if (haptic::isBinary(data, len)) {
+		handleHapticCommands(data, len);
+	}
+	else {
+		// Text commands were always read as C strings
+		handleVibrationCommand(std::string((const char *)data, strnlen((const char *)data, len)));
+	}
+}
+
+/**
+ * Apply the commands of a binary haptic datagram (see haptic_protocol.hpp)
+ * in order. Commands are read in place, without allocating.
+ **/
+void MimicryApp::handleHapticCommands(const uint8_t *data, size_t len)
+{
+	haptic::CommandReader reader(data, len);
+	haptic::Command cmd;
+	int64_t now(FrameScheduler::monotonicNow());
+
+	if (!reader.valid()) {
+		Logger::instance().logLimited(Logger::L_WARN, m_haptic_limiter, "Unsupported haptic command version.");
+		return;
+	}
+
+	while (reader.next(cmd)) {
+		if (!haptic::isKnown(cmd)) {
+			Logger::instance().logLimited(Logger::L_WARN, m_haptic_limiter, "Unknown haptic command op or target.");
 			continue;
 		}
 
-		std::map<ButtonId, VRButton *>::iterator b_it(dev->buttons.begin());
-		for ( ; b_it != dev->buttons.end(); ++b_it) {
-			VRButton *button(b_it->second);
-
-			std::map<std::string, bool>::iterator t_it(button->val_types.begin());
-			for ( ; t_it != button->val_types.end(); ++t_it) {
-				std::string type(t_it->first);
-				bool enabled(t_it->second);
-
-				if (enabled) {
-					if (type == "boolean") {
-						j[dev->name][button->name]["boolean"] = button->pressed;
-					}
-					else if (type == "pressure") {
-						j[dev->name][button->name]["pressure"] = button->pressure;
-					}
-					else if (type == "2d") {
-						j[dev->name][button->name]["2d"]["x"] = button->touch_pos.x;
-						j[dev->name][button->name]["2d"]["y"] = button->touch_pos.y;						
-					}
-				}				
-			}
+		const VRDevice *dev((cmd.target == haptic::T_NAME) ? findDevFromName(cmd.name, cmd.name_len)
+			: (cmd.slot < m_devices.size()) ? &m_devices[cmd.slot] : NULL);
+
+		if (dev == NULL || !dev->isActive()) {
+			Logger::instance().logLimited(Logger::L_WARN, m_haptic_limiter, "No active device for a haptic command.");
+			continue;
+		}
+
+		if (cmd.op == haptic::OP_STOP || cmd.op == haptic::OP_REPLACE) {
+			m_haptics.cancelDevice(dev->ix);
+		}
+		if (cmd.op == haptic::OP_STOP) {
+			continue;
+		}
+
+		unsigned short pulse_us(cmd.intensity * HapticScheduler::MAX_PULSE_US / haptic::MAX_INTENSITY);
+		HapticScheduler::Mode mode((cmd.op == haptic::OP_QUEUE) ? HapticScheduler::QUEUE : HapticScheduler::OVERLAP);
+		uint64_t id;
+		if (cmd.waveform == 0) {
+			id = m_haptics.addPattern(dev->ix, now, cmd.on_ms * 1000000ll, cmd.off_ms * 1000000ll, cmd.repeat,
+				mode, pulse_us, cmd.axis);
+		}
+		else if (cmd.waveform > m_haptics.numWaveforms()) {
+			Logger::instance().logLimited(Logger::L_WARN, m_haptic_limiter, "No such haptic waveform.");
+			continue;
+		}
+		else {
+			id = m_haptics.addWaveform(dev->ix, now, cmd.waveform - 1, cmd.repeat, mode, pulse_us, cmd.axis);
+		}
+
+		if (id == 0) {
+			Logger::instance().logLimited(Logger::L_WARN, m_haptic_limiter, "Too many haptic requests pending on a device.");
 		}
 	}
-	
-	std::string output(j.dump(3));
-	sendto(m_socket, output.c_str(), strlen(output.c_str()), 0, (sockaddr *) &m_address, sizeof(m_address));
-	printText(output);
 }
 
-std::string getSocketData(int socket, sockaddr_in &address)
+/**
+ * Act on one message received on the vibration socket.
+ * 
+ * Params:
+ * 		input_data - received message
+ **/
+void MimicryApp::handleVibrationCommand(const std::string &input_data)
 {
-	socklen_t len_data;
-	uint static const DATA_SIZE = 2048;
-	char buffer[DATA_SIZE];
+	static const std::string VIBRATE_PREFIX("vibrate:");
+	static const std::string STOP_PREFIX("stop:");
+	static const std::string PULSE_TIME_PREFIX("pulse_time:");
+	static const std::string CUE_PREFIX("cue:");
+
+	if (input_data.compare("vibrate") == 0 || input_data.compare(0, VIBRATE_PREFIX.length(), VIBRATE_PREFIX) == 0) {
+		// Right controller unless a device is named
+		const VRDevice *dev(input_data.length() > VIBRATE_PREFIX.length()
+			? findDevFromName(input_data.substr(VIBRATE_PREFIX.length()))
+			: findDevFromRole(VRDevice::DeviceRole::RIGHT, true));
+
+		if (dev == NULL || !dev->isActive()) {
+			printText("No active device to vibrate for '" + input_data + "'.", 1, Logger::L_WARN);
+			return;
+		}
 
-	len_data = recvfrom(socket, buffer, DATA_SIZE, MSG_WAITALL, (sockaddr *) &(address), &len_data); 
-	std::string data;
-	if (len_data != -1) {
-		if (len_data >= DATA_SIZE) {
-			len_data = DATA_SIZE-1;
+		// Queued behind any vibration still playing, as commands used to wait for the previous one
+		if (m_haptics.add(dev->ix, FrameScheduler::monotonicNow(), m_pulse_time * 1000000ll, HapticScheduler::QUEUE) == 0) {
+			Logger::instance().logLimited(Logger::L_WARN, m_haptic_limiter, "Too many haptic requests pending on a device.");
+		}
+	}
+	else if (input_data.compare(0, CUE_PREFIX.length(), CUE_PREFIX) == 0) {
+		// "cue:<waveform>" on the right controller, or "cue:<waveform>:<device>"
+		size_t name_end(input_data.find(':', CUE_PREFIX.length()));
+		std::string name(input_data.substr(CUE_PREFIX.length(), name_end - CUE_PREFIX.length()));
+		const VRDevice *dev((name_end != std::string::npos)
+			? findDevFromName(input_data.substr(name_end + 1))
+			: findDevFromRole(VRDevice::DeviceRole::RIGHT, true));
+		int waveform(m_haptics.findWaveform(name.data(), name.length()));
+
+		if (waveform < 0) {
+			printText("No haptic waveform named '" + name + "'.", 1, Logger::L_WARN);
+			return;
+		}
+		if (dev == NULL || !dev->isActive()) {
+			printText("No active device to play a cue for '" + input_data + "'.", 1, Logger::L_WARN);
+			return;
+		}
+
+		// Started right away, over whatever the device is playing, so cues are never delayed
+		if (m_haptics.addWaveform(dev->ix, FrameScheduler::monotonicNow(), waveform, 1, HapticScheduler::OVERLAP) == 0) {
+			Logger::instance().logLimited(Logger::L_WARN, m_haptic_limiter, "Too many haptic requests pending on a device.");
+		}
+	}
+	else if (input_data.compare("stop") == 0) {
+		m_haptics.cancelAll();
+	}
+	else if (input_data.compare(0, STOP_PREFIX.length(), STOP_PREFIX) == 0) {
+		const VRDevice *dev(findDevFromName(input_data.substr(STOP_PREFIX.length())));
+		if (dev != NULL && dev->isActive()) {
+			m_haptics.cancelDevice(dev->ix);
 		}
-		buffer[len_data] = '\0';
-		data = buffer;
 	}
+	else if (input_data.compare(0, PULSE_TIME_PREFIX.length(), PULSE_TIME_PREFIX) == 0) {
+		std::string val_str(input_data.substr(PULSE_TIME_PREFIX.length()));
+		try {
+			m_pulse_time = std::stoi(val_str);
+			printText("Vibration pulse duration set to ", 0);
+			printText(val_str);
+		}
+		catch (const std::invalid_argument& exc) {
+			printText("Invalid vibration duration specified.", 1, Logger::L_WARN);
+		}
+	}
+}
+
+/**
+ * Play the haptic pulses that are due, and set the haptic timer for the
+ * next ones.
+ **/
+void MimicryApp::runHaptics()
+{
+	int64_t deadline(m_haptics.run(FrameScheduler::monotonicNow()));
 
-	return data;
+	if (deadline == HapticScheduler::IDLE) {
+		Reactor::disarmTimer(m_haptic_timer);
+	}
+	else {
+		Reactor::armTimer(m_haptic_timer, deadline);
+	}
 }
 
-void MimicryApp::handleVibration()
+/**
+ * Open the vibration socket, bound to vibration_port on every interface.
+ * The socket is non-blocking, as it is only read once epoll reports data.
+ * 
+ * Returns: true on success, false otherwise.
+ **/
+bool MimicryApp::openVibrationSocket()
 {
-	while (!m_configured && m_running) {} // Wait for configuration
-	
-	// Initialize vibration socket
 	sockaddr_in address;
 
-	if ((m_vibration_socket = socket(AF_INET, SOCK_DGRAM, 0)) == 0) {
-		printText("Could not initialize vibration socket.");
+	if ((m_vibration_socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+		printText("Could not initialize vibration socket.", 1, Logger::L_ERROR);
+		return false;
 	}
 
 	address.sin_family = AF_INET;
 	address.sin_addr.s_addr = INADDR_ANY;
 	address.sin_port = htons(m_params.vibration_port);
-   
-	if (bind(m_vibration_socket, (const sockaddr *)&address, sizeof(address)) < 0) { 
-		printText("Vibration socket binding failed."); 
+
+	if (bind(m_vibration_socket, (const sockaddr *)&address, sizeof(address)) < 0) {
+		printText("Vibration socket binding failed.", 1, Logger::L_ERROR);
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Handle every datagram waiting on the vibration socket.
+ **/
+void MimicryApp::handleVibrationSocket()
+{
+	static const size_t DATA_SIZE = 2048;
+	uint8_t buffer[DATA_SIZE];
+	ssize_t len;
+
+	while ((len = recv(m_vibration_socket, buffer, DATA_SIZE, 0)) >= 0) {
+		handleVibrationData(buffer, len);
 	}
 
-	pollfd poll_fds;
-	poll_fds.fd = m_vibration_socket;
-	poll_fds.events = POLLIN; // Wait until there's data to read
+	runHaptics();
+}
 
-	uint pulse_time(300); // in msecs
-	while (m_running)
-	{
-		if (poll(&poll_fds, 1, m_refresh_time.count()) > 0) {
-			std::string input_data(getSocketData(m_vibration_socket, address));
-
-			if (input_data.compare("vibrate") == 0) {
-				DevIx right_ix(findDevIndexFromRole(VRDevice::DeviceRole::RIGHT));
-				auto vibration_start(std::chrono::high_resolution_clock::now());
-				auto current_time(vibration_start);
-				auto pulse_duration(std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::milliseconds(pulse_time)));
-				std::chrono::duration<double, std::milli> time_elapsed(current_time - vibration_start);
-				while (time_elapsed < pulse_duration) {
-					m_vrs->TriggerHapticPulse(right_ix, 0, 1);
-
-					current_time = std::chrono::high_resolution_clock::now();
-					time_elapsed = current_time - vibration_start;
-				}
-			}
-			else if (input_data.compare(0, std::string("pulse_time:").length(), "pulse_time:") == 0) {
-				std::string val_str(input_data.substr(std::string("pulse_time:").length()));
-				try {
-					pulse_time = std::stoi(val_str);
-					printText("Vibration pulse duration set to ", 0);
-					printText(val_str);
-				}
-				catch (const std::invalid_argument& exc) {
-					printText("Invalid vibration duration specified." );
-				}
+/**
+ * Serve the vibration socket through io_uring instead of reading it: a
+ * multishot receive stays armed on it and each datagram lands in a
+ * provided buffer. The ring's descriptor is watched by the reactor, which
+ * reports it readable whenever completions are waiting.
+ * 
+ * Returns: true if the ring is set up, false if io_uring is not available,
+ * 		in which case the socket is read directly.
+ **/
+bool MimicryApp::openVibrationRing()
+{
+	static const unsigned NUM_BUFFERS = 16;
+	static const unsigned BUFFER_SIZE = 2048;
+	std::string error;
+
+	if (!m_vibration_ring.open(4, error)
+			|| !m_vibration_ring.setupBuffers(VIBRATION_BUFFER_GROUP, NUM_BUFFERS, BUFFER_SIZE, error)) {
+		printText("io_uring is not available for the vibration socket (" + error + "); using epoll.", 1, Logger::L_WARN);
+		m_vibration_ring.close();
+		return false;
+	}
+
+	m_vibration_received = false;
+	if (!armVibrationRing()) {
+		printText("Could not queue a receive on the vibration socket; using epoll.", 1, Logger::L_WARN);
+		m_vibration_ring.close();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Queue a multishot receive on the vibration socket.
+ * 
+ * Returns: true if the receive was submitted, false otherwise.
+ **/
+bool MimicryApp::armVibrationRing()
+{
+	return m_vibration_ring.queueRecvMultishot(m_vibration_socket, VIBRATION_BUFFER_GROUP, 0)
+		&& m_vibration_ring.submit() >= 0;
+}
+
+/**
+ * Stop serving the vibration socket through io_uring and read it directly
+ * from then on, including whatever is already waiting on it.
+ **/
+void MimicryApp::useVibrationSocket()
+{
+	std::string error;
+
+	m_reactor.remove(m_vibration_ring.fd());
+	m_vibration_ring.close();
+	if (!m_reactor.add(m_vibration_socket, EPOLLIN, [this](uint32_t) { handleVibrationSocket(); }, error)) {
+		printText(error, 1, Logger::L_ERROR);
+	}
+	handleVibrationSocket();
+}
+
+/**
+ * Handle the datagrams the multishot receive has completed, re-arming it
+ * if it has ended normally or ran out of buffers. Any other error, such as
+ * a kernel without multishot receives, falls back to reading the socket
+ * directly rather than re-arming a receive that keeps failing.
+ **/
+void MimicryApp::handleVibrationRing()
+{
+	IoRing::Completion completion;
+	bool armed(true);
+
+	while (m_vibration_ring.nextCompletion(completion)) {
+		if (!completion.more) {
+			armed = false;
+		}
+
+		if (completion.res < 0) {
+			if (completion.res == -ENOBUFS) {
+				continue; // Ends the receive until it is armed again
 			}
+
+			// Kernels without multishot receives reject the request outright
+			printText(m_vibration_received
+				? std::string("io_uring receive failed on the vibration socket: ") + strerror(-completion.res) + "; using epoll."
+				: std::string("io_uring multishot receives are not supported; using epoll."), 1, Logger::L_WARN);
+			useVibrationSocket();
+			return;
+		}
+
+		m_vibration_received = true;
+		if (completion.buffer >= 0) {
+			// Handled in place, before the buffer is given back to the kernel
+			handleVibrationData(m_vibration_ring.buffer(completion.buffer), completion.res);
+			m_vibration_ring.recycleBuffer(completion.buffer);
 		}
 	}
-	
-	shutdown(m_vibration_socket, SHUT_RDWR);
+
+	if (!armed && !armVibrationRing()) {
+		printText("Could not re-arm the receive on the vibration socket; using epoll.", 1, Logger::L_WARN);
+		useVibrationSocket();
+		return;
+	}
+
+	runHaptics();
 }
 
-void MimicryApp::handleSigint(int sig)
+/**
+ * Run one frame when the frame timer expires: read the runtime, publish
+ * the frame and set the timer for the next one.
+ **/
+void MimicryApp::handleFrameTimer()
 {
-	MimicryApp::m_running = false;
+	if (Reactor::readTimer(m_frame_timer) == 0) {
+		return;
+	}
+
+	m_scheduler.startFrame();
+	m_subscriptions.expire(FrameScheduler::monotonicNow());
+
+	bool fresh(handleInput());
+	if (m_scheduler.isFreeRunning()) {
+		// Only publish new samples; duplicates just widen the backoff
+		m_scheduler.reportSample(fresh);
+	}
+	if (fresh || !m_scheduler.isFreeRunning()) {
+		postOutputData();
+	}
+
+	int64_t deadline(m_scheduler.scheduleNextFrame());
+
+	// Send a partial batch now if waiting for the next frame would take it past its deadline
+	if (m_batcher.due(deadline)) {
+		flushBatch();
+	}
+
+	Reactor::armTimer(m_frame_timer, deadline);
 }
 
-bool MimicryApp::m_running = false;
+/**
+ * Stop the main loop on SIGINT or SIGTERM, which are only delivered
+ * through the signal descriptor.
+ **/
+void MimicryApp::handleSignal()
+{
+	signalfd_siginfo info;
+
+	while (read(m_signal_fd, &info, sizeof(info)) == sizeof(info)) {
+		printText(std::string("Received ") + strsignal(info.ssi_signo) + ", stopping.");
+		m_running = false;
+	}
+}
+
+/**
+ * Register everything the main loop waits for with the reactor: stop(),
+ * the frame and haptic timers, the vibration and control sockets and,
+ * unless the host process handles them, the termination signals.
+ * 
+ * Params:
+ * 		signals - signals to receive through a descriptor; they must already
+ * 			be blocked in every thread
+ * 
+ * Returns: true on success, false otherwise.
+ **/
+bool MimicryApp::setupEventLoop(const sigset_t &signals)
+{
+	std::string error;
+
+	if (m_stop_fd < 0) {
+		return false; // Already reported by the constructor
+	}
+
+	if (!m_reactor.open(error)
+			|| !m_reactor.add(m_stop_fd, EPOLLIN, [](uint32_t) {}, error)
+			|| (m_frame_timer = Reactor::createTimer(error)) < 0
+			|| (m_haptic_timer = Reactor::createTimer(error)) < 0
+			|| !m_reactor.add(m_frame_timer, EPOLLIN, [this](uint32_t) { handleFrameTimer(); }, error)
+			|| !m_reactor.add(m_haptic_timer, EPOLLIN,
+				[this](uint32_t) { Reactor::readTimer(m_haptic_timer); runHaptics(); }, error)) {
+		printText(error, 1, Logger::L_ERROR);
+		return false;
+	}
+
+	if (m_handle_sigint) {
+		if ((m_signal_fd = Reactor::createSignalFd(signals, error)) < 0
+				|| !m_reactor.add(m_signal_fd, EPOLLIN, [this](uint32_t) { handleSignal(); }, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			return false;
+		}
+	}
+
+	if (!openVibrationSocket()) {
+		return false;
+	}
+	m_haptics.setSystem(m_vrs);
+	if (m_params.io_uring && openVibrationRing()) {
+		if (!m_reactor.add(m_vibration_ring.fd(), EPOLLIN, [this](uint32_t) { handleVibrationRing(); }, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			return false;
+		}
+	}
+	else if (!m_reactor.add(m_vibration_socket, EPOLLIN, [this](uint32_t) { handleVibrationSocket(); }, error)) {
+		printText(error, 1, Logger::L_ERROR);
+		return false;
+	}
+
+	if (m_subscriptions.isOpen()) {
+		if (!m_reactor.add(m_subscriptions.fd(), EPOLLIN,
+				[this](uint32_t) { m_subscriptions.handleRequests(m_devices, m_params.update_freq); }, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void MimicryApp::closeEventLoop()
+{
+	m_reactor.close();
+	m_vibration_ring.close();
+
+	for (int *fd : { &m_frame_timer, &m_haptic_timer, &m_signal_fd, &m_vibration_socket }) {
+		if (*fd >= 0) {
+			close(*fd);
+			*fd = -1;
+		}
+	}
+}
+
+MimicryApp::MimicryApp() : m_configured(false), m_left_config(false), m_right_config(false),
+		m_left_found(false), m_right_found(false), m_vibration_socket(-1), m_pulse_time(300),
+		m_vibration_received(false), m_handle_sigint(true), m_frame_timer(-1), m_haptic_timer(-1),
+		m_signal_fd(-1), m_running(true)
+{
+	std::string error;
+
+	// Created here rather than with the event loop, so that stop() can be called at any time
+	if ((m_stop_fd = Reactor::createEventFd(error)) < 0) {
+		printText(error, 1, Logger::L_ERROR);
+	}
+}
+
+MimicryApp::~MimicryApp()
+{
+	if (m_stop_fd >= 0) {
+		close(m_stop_fd);
+	}
+}
+
+/**
+ * Ask the main loop to stop and wake it up. The descriptor is never read,
+ * so a stop() that comes before the loop starts still ends its first wait.
+ **/
+void MimicryApp::stop()
+{
+	m_running = false;
+	if (m_stop_fd >= 0) {
+		Reactor::notifyEvent(m_stop_fd);
+	}
+}
 
 /**
  * Entry point for the mimicry_control application.
@@ -790,9 +1826,19 @@ bool MimicryApp::m_running = false;
 void MimicryApp::runMainLoop(std::string params_file)
 {
 	vr::EVRInitError vr_err(vr::VRInitError_None);
-	auto start(std::chrono::high_resolution_clock::now());
-	auto end(std::chrono::high_resolution_clock::now());
+	sigset_t signals, old_signals;
+
+	// Block the termination signals before the app starts its threads, so that they inherit
+	// the mask and the signals are only ever received through the reactor. Threads the host
+	// process started earlier do not, so it must have blocked them already (see mimicry_control)
+	sigemptyset(&signals);
+	if (m_handle_sigint) {
+		sigaddset(&signals, SIGINT);
+		sigaddset(&signals, SIGTERM);
+	}
+	pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
 
+	Logger::instance().start();
 	printText("Initializing mimicry_control...");
 
 	// Load the SteamVR Runtime
@@ -801,12 +1847,9 @@ void MimicryApp::runMainLoop(std::string params_file)
 	// In theory, the other modes will automatically launch SteamVR, but that was not the
 	// case for me.
 
-	MimicryApp::m_running = true;
-	std::thread handle_vibration(&MimicryApp::handleVibration, this);
-
     if (vr_err != vr::VRInitError_None) {
-		printText("Unable to init VR runtime: ", 0);
-		printText(vr::VR_GetVRInitErrorAsEnglishDescription(vr_err));
+		printText(std::string("Unable to init VR runtime: ") + vr::VR_GetVRInitErrorAsEnglishDescription(vr_err), 1,
+			Logger::L_ERROR);
         goto shutdown;
 	}
 
@@ -814,27 +1857,48 @@ void MimicryApp::runMainLoop(std::string params_file)
 		goto shutdown;
 	}
 
-	signal(SIGINT, MimicryApp::handleSigint);
+	for (FrameSink *sink : m_sinks) {
+		std::string error;
+		if (!sink->start(m_devices, error)) {
+			printText(error, 1, Logger::L_ERROR);
+			goto shutdown;
+		}
+	}
+
+	if (!setupEventLoop(signals)) {
+		goto shutdown;
+	}
+
+	activateConnectedDevices();
 
-	while (MimicryApp::m_running) {
-		std::chrono::duration<double, std::milli> time_elapsed = end - start;
-		std::chrono::duration<double, std::milli> delta = this->m_refresh_time - time_elapsed;
-		std::this_thread::sleep_for(delta);
+	m_scheduler.start();
+	Reactor::armTimer(m_frame_timer, m_scheduler.scheduleNextFrame());
+	while (m_running) {
+		if (m_reactor.wait(-1) < 0) {
+			break;
+		}
+	}
 
-		start = std::chrono::high_resolution_clock::now();
-		handleInput();
-		postOutputData();
-		end = std::chrono::high_resolution_clock::now();
+	flushBatch();
+
+	printText("Frame timing: " + m_scheduler.stats().summary());
+	printText("Output destinations:\n" + m_publisher.summary());
+	if (m_batcher.enabled()) {
+		printText("Batches: " + m_batcher.summary());
+	}
+	if (m_subscriptions.isOpen()) {
+		printText("Subscriptions: " + m_subscriptions.summary());
 	}
 
 shutdown:
-	MimicryApp::m_running = false;
-	handle_vibration.join();
+	closeEventLoop();
 
     if (m_vrs != NULL) {
         vr::VR_Shutdown();
         m_vrs = NULL;
     }
 	printText("Exiting VR system...");
+	Logger::instance().stop();
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
 	return;
 }
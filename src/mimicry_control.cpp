@@ -1,8 +1,14 @@
 #include <iostream>
+#include <memory>
+#include <signal.h>
 #include <unistd.h>
+#include <pthread.h>
+
+#include <ros/ros.h>
 
 #include "mimicry_openvr/json.hpp"
 #include "mimicry_openvr/mimicry_app.hpp"
+#include "mimicry_openvr/ros_publisher.hpp"
 
 
 using json = nlohmann::json;
@@ -10,13 +16,30 @@ using json = nlohmann::json;
 
 // TODO: Get parameters for:
 // - Verbose output?
-// - Specifying refresh rate of 0 should indicate as fast as possible
 // - Add tracker configuration
 // - Switch to glm vectors
 
 int main(int argc, char* argv[]) 
 {
-	MimicryApp app = MimicryApp();
+	MimicryApp app;
+	std::unique_ptr<RosPublisher> ros_publisher;
+
+	// The app stops itself on SIGINT and SIGTERM, which it reads from a descriptor. That only
+	// works if they are blocked in every thread, so block them before roscpp starts its own
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	ros::init(argc, argv, "mimicry_control", ros::init_options::NoSigintHandler);
+	if (ros::master::check()) {
+		ros_publisher.reset(new RosPublisher(ros::NodeHandle(), ros::NodeHandle("~")));
+		app.addFrameSink(ros_publisher.get());
+	}
+	else {
+		printf("No ROS master found; not publishing ROS topics.\n");
+	}
 	
 	chdir("../../../src/mimicry_openvr");
 
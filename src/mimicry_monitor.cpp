@@ -0,0 +1,465 @@
+#include <iostream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "mimicry_openvr/json.hpp"
+#include "mimicry_openvr/wire_decoder.hpp"
+
+
+using json = nlohmann::json;
+
+/**
+ * Receives the output of mimicry_control and reports, once per interval,
+ * how well the stream is arriving: lost, reordered and duplicated frames
+ * (from the frame sequence numbers), inter-arrival jitter, and a histogram
+ * of one-way latency from the frame's capture time to its arrival. JSON
+ * and binary frames are both understood, batched or not.
+ *
+ * Latency compares the publisher's CLOCK_REALTIME with this host's, so it
+ * is only meaningful on the same host or with synchronized clocks (PTP or
+ * a well-disciplined NTP). Arrival times are taken from kernel receive
+ * timestamps where available, so the monitor's own scheduling delays don't
+ * inflate the numbers.
+ *
+ * Usage: mimicry_monitor <port | address:port | unix:path> [interval_s]
+ *
+ * A multicast address:port joins the group; unix:@name listens on an
+ * abstract Unix socket.
+ **/
+
+static const uint64_t SEQ_WINDOW = 4096;
+static const double BUCKET_US[] = { 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000 };
+static const size_t NUM_BUCKETS = sizeof(BUCKET_US) / sizeof(BUCKET_US[0]) + 1;
+
+static volatile sig_atomic_t g_running = 1;
+
+struct IntervalStats
+{
+	uint64_t received = 0;		// Frames, however many chunks they were split into
+	uint64_t messages = 0;
+	int64_t lost = 0;		// Can go negative when frames counted lost arrive late
+	uint64_t reordered = 0;
+	uint64_t duplicates = 0;
+	uint64_t other = 0;		// Schema messages and anything unrecognized
+	uint64_t latency_count = 0;
+	double latency_sum_us = 0;
+	double latency_min_us = INFINITY;
+	double latency_max_us = -INFINITY;
+	uint64_t buckets[NUM_BUCKETS] = {};
+
+	void add(const IntervalStats &other_stats);
+};
+
+void IntervalStats::add(const IntervalStats &o)
+{
+	received += o.received;
+	messages += o.messages;
+	lost += o.lost;
+	reordered += o.reordered;
+	duplicates += o.duplicates;
+	other += o.other;
+	latency_count += o.latency_count;
+	latency_sum_us += o.latency_sum_us;
+	latency_min_us = std::min(latency_min_us, o.latency_min_us);
+	latency_max_us = std::max(latency_max_us, o.latency_max_us);
+	for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+		buckets[i] += o.buckets[i];
+	}
+}
+
+/**
+ * Classifies sequence numbers as in order, late or duplicated, using a
+ * window of recently seen numbers behind the highest one. Frames split
+ * into chunks count once, when their first chunk arrives; the window keeps
+ * a bit per chunk so repeated chunks are still caught as duplicates.
+ **/
+class SeqTracker
+{
+public:
+	SeqTracker() : m_started(false), m_highest(0), m_seen(SEQ_WINDOW, 0) {}
+
+	void add(uint64_t seq, unsigned chunk, IntervalStats &stats)
+	{
+		uint64_t bit(1ull << std::min(chunk, 63u));
+
+		if (!m_started || seq + SEQ_WINDOW < m_highest) {
+			// First frame, or the publisher restarted its sequence
+			std::fill(m_seen.begin(), m_seen.end(), 0);
+			m_started = true;
+			m_highest = seq;
+			m_seen[seq % SEQ_WINDOW] = bit;
+			stats.received++;
+			return;
+		}
+
+		if (seq > m_highest) {
+			uint64_t gap(seq - m_highest - 1);
+			stats.lost += gap;
+			stats.received++;
+
+			for (uint64_t s = m_highest + 1, n = 0; s < seq && n < SEQ_WINDOW; ++s, ++n) {
+				m_seen[s % SEQ_WINDOW] = 0;
+			}
+			m_seen[seq % SEQ_WINDOW] = bit;
+			m_highest = seq;
+		}
+		else if (m_highest - seq >= SEQ_WINDOW || (m_seen[seq % SEQ_WINDOW] & bit)) {
+			stats.duplicates++;
+		}
+		else if (m_seen[seq % SEQ_WINDOW] != 0) {
+			// Another chunk of a frame that was already counted
+			m_seen[seq % SEQ_WINDOW] |= bit;
+		}
+		else {
+			// Counted as lost when the gap was seen; it has arrived after all
+			m_seen[seq % SEQ_WINDOW] = bit;
+			stats.received++;
+			stats.reordered++;
+			stats.lost--;
+		}
+	}
+
+private:
+	bool m_started;
+	uint64_t m_highest;
+	std::vector<uint64_t> m_seen; // Chunks received of each frame in the window
+};
+
+static void handleSigint(int)
+{
+	g_running = 0;
+}
+
+static int64_t realtimeNow()
+{
+	timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (int64_t)ts.tv_sec * 1000000000ll + ts.tv_nsec;
+}
+
+/**
+ * Open the listening socket for a source given on the command line.
+ *
+ * Returns: the socket, or -1 on failure.
+ **/
+static int openSource(const std::string &source)
+{
+	int sock;
+
+	if (source.compare(0, 5, "unix:") == 0) {
+		std::string path(source.substr(5));
+		sockaddr_un addr = {};
+
+		if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+			std::cerr << "Invalid Unix socket path: " << path << std::endl;
+			return -1;
+		}
+
+		addr.sun_family = AF_UNIX;
+		memcpy(addr.sun_path, path.data(), path.size());
+		if (path[0] == '@') {
+			addr.sun_path[0] = '\0';
+		}
+		else {
+			unlink(path.c_str());
+		}
+		socklen_t len(offsetof(sockaddr_un, sun_path) + path.size() + (path[0] == '@' ? 0 : 1));
+
+		if ((sock = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+			perror("socket");
+			return -1;
+		}
+		if (bind(sock, (sockaddr *)&addr, len) < 0) {
+			perror("bind");
+			close(sock);
+			return -1;
+		}
+	}
+	else {
+		size_t colon(source.rfind(':'));
+		std::string host(colon == std::string::npos ? "" : source.substr(0, colon));
+		int port(atoi(source.c_str() + (colon == std::string::npos ? 0 : colon + 1)));
+		sockaddr_in addr = {};
+		in_addr group = {};
+		int one(1);
+
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		addr.sin_addr.s_addr = INADDR_ANY;
+
+		if (port <= 0 || port > 65535 || (!host.empty() && inet_pton(AF_INET, host.c_str(), &group) <= 0)) {
+			std::cerr << "Invalid source: " << source << std::endl;
+			return -1;
+		}
+
+		bool multicast(!host.empty() && IN_MULTICAST(ntohl(group.s_addr)));
+		if (!host.empty() && !multicast) {
+			addr.sin_addr = group;
+		}
+
+		if ((sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+			perror("socket");
+			return -1;
+		}
+		setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		if (bind(sock, (sockaddr *)&addr, sizeof(addr)) < 0) {
+			perror("bind");
+			close(sock);
+			return -1;
+		}
+
+		if (multicast) {
+			ip_mreq req = {};
+			req.imr_multiaddr = group;
+			req.imr_interface.s_addr = INADDR_ANY;
+			if (setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &req, sizeof(req)) < 0) {
+				perror("IP_ADD_MEMBERSHIP");
+				close(sock);
+				return -1;
+			}
+		}
+	}
+
+	int one(1);
+	setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+
+	return sock;
+}
+
+struct FrameStamp
+{
+	uint64_t seq;
+	unsigned chunk;
+	int64_t capture_ns;
+};
+
+/**
+ * Extract the sequence number, chunk index and capture time of a binary
+ * frame message.
+ *
+ * Returns: true if the message is a frame carrying them, false otherwise.
+ **/
+static bool parseBinaryFrame(const uint8_t *data, size_t len, FrameStamp &frame)
+{
+	mimicry::wire::Header hdr;
+
+	// Keyframes and deltas start with the same frame info block
+	if (!mimicry::wire::parseHeader(data, len, hdr)
+			|| (hdr.type != mimicry::wire::MSG_FRAME && hdr.type != mimicry::wire::MSG_DELTA)
+			|| len < mimicry::wire::HEADER_SIZE + mimicry::wire::FRAME_INFO_SIZE) {
+		return false;
+	}
+
+	frame.seq = mimicry::wire::getU64(data + mimicry::wire::HEADER_SIZE);
+	frame.chunk = hdr.chunk;
+	frame.capture_ns = mimicry::wire::getU64(data + mimicry::wire::HEADER_SIZE + 8);
+	return true;
+}
+
+static bool parseJsonFrame(const json &j, FrameStamp &frame)
+{
+	if (!j.is_object() || j.find("_frame") == j.end()) {
+		return false;
+	}
+
+	frame.seq = j["_frame"].value("seq", 0ull);
+	frame.chunk = j["_frame"].value("chunk", 0u);
+	frame.capture_ns = j["_frame"].value("capture_ns", 0ll);
+	return true;
+}
+
+/**
+ * Extract the frames in a received datagram: a single frame, or the
+ * frames of a batch.
+ *
+ * Params:
+ * 		frames - cleared, then filled with the frames found
+ *
+ * Returns: number of messages in the datagram that were not frames.
+ **/
+static size_t parseFrames(const uint8_t *data, size_t len, std::vector<FrameStamp> &frames)
+{
+	mimicry::wire::Header hdr;
+	FrameStamp frame;
+	size_t other(0);
+
+	frames.clear();
+
+	if (mimicry::wire::parseHeader(data, len, hdr)) {
+		if (hdr.type != mimicry::wire::MSG_BATCH) {
+			if (!parseBinaryFrame(data, len, frame)) {
+				return 1;
+			}
+			frames.push_back(frame);
+			return 0;
+		}
+
+		mimicry::wire::BatchReader batch(data, len);
+		const uint8_t *msg;
+		size_t msg_len;
+		while (batch.next(msg, msg_len)) {
+			if (parseBinaryFrame(msg, msg_len, frame)) {
+				frames.push_back(frame);
+			}
+			else {
+				other++;
+			}
+		}
+		return other;
+	}
+
+	json j(json::parse(data, data + len, nullptr, false));
+	if (j.is_discarded()) {
+		return 1;
+	}
+
+	// Batched JSON frames arrive as an array
+	if (!j.is_array()) {
+		j = json::array({ j });
+	}
+	for (const json &elem : j) {
+		if (parseJsonFrame(elem, frame)) {
+			frames.push_back(frame);
+		}
+		else {
+			other++;
+		}
+	}
+	return other;
+}
+
+static void printStats(const char *label, const IntervalStats &stats, double jitter_us)
+{
+	printf("%s recv %llu, msgs %llu, lost %lld, reordered %llu, dup %llu, jitter %.1f us",
+		label, (unsigned long long)stats.received, (unsigned long long)stats.messages, (long long)stats.lost,
+		(unsigned long long)stats.reordered, (unsigned long long)stats.duplicates, jitter_us);
+
+	if (stats.latency_count > 0) {
+		printf(", latency min/mean/max %.1f/%.1f/%.1f us",
+			stats.latency_min_us, stats.latency_sum_us / stats.latency_count, stats.latency_max_us);
+	}
+	printf("\n  latency (us):");
+
+	for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+		if (i + 1 < NUM_BUCKETS) {
+			printf(" <%g:%llu", BUCKET_US[i], (unsigned long long)stats.buckets[i]);
+		}
+		else {
+			printf(" >=%g:%llu", BUCKET_US[i - 1], (unsigned long long)stats.buckets[i]);
+		}
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	if (argc < 2) {
+		std::cerr << "Usage: mimicry_monitor <port | address:port | unix:path> [interval_s]" << std::endl;
+		return 1;
+	}
+
+	double interval_s((argc > 2) ? atof(argv[2]) : 1.0);
+	int sock(openSource(argv[1]));
+	if (sock < 0) {
+		return 1;
+	}
+
+	signal(SIGINT, handleSigint);
+
+	std::vector<uint8_t> buf(65536);
+	char control[CMSG_SPACE(sizeof(timespec))];
+	std::vector<FrameStamp> frames;
+	SeqTracker tracker;
+	IntervalStats interval, total;
+	double jitter_us(0);
+	bool have_transit(false);
+	int64_t last_transit_ns(0);
+	int64_t next_report(realtimeNow() + (int64_t)(interval_s * 1e9));
+
+	while (g_running) {
+		int64_t now(realtimeNow());
+		if (now >= next_report) {
+			printStats("interval:", interval, jitter_us);
+			total.add(interval);
+			interval = IntervalStats();
+			next_report += (int64_t)(interval_s * 1e9);
+			continue;
+		}
+
+		pollfd pfd = { sock, POLLIN, 0 };
+		if (poll(&pfd, 1, (next_report - now) / 1000000 + 1) <= 0) {
+			continue;
+		}
+
+		iovec iov = { buf.data(), buf.size() };
+		msghdr msg = {};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+
+		ssize_t len(recvmsg(sock, &msg, 0));
+		if (len <= 0) {
+			continue;
+		}
+
+		int64_t arrival_ns(0);
+		for (cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+				timespec ts;
+				memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+				arrival_ns = (int64_t)ts.tv_sec * 1000000000ll + ts.tv_nsec;
+			}
+		}
+		if (arrival_ns == 0) {
+			arrival_ns = realtimeNow();
+		}
+
+		interval.other += parseFrames(buf.data(), len, frames);
+
+		for (const FrameStamp &frame : frames) {
+			interval.messages++;
+			tracker.add(frame.seq, frame.chunk, interval);
+
+			// Inter-arrival jitter as in RFC 3550: smoothed variation of the transit time
+			int64_t transit_ns(arrival_ns - frame.capture_ns);
+			if (have_transit) {
+				double d_us(std::fabs((transit_ns - last_transit_ns) / 1000.0));
+				jitter_us += (d_us - jitter_us) / 16.0;
+			}
+			last_transit_ns = transit_ns;
+			have_transit = true;
+
+			double latency_us(transit_ns / 1000.0);
+			size_t bucket(0);
+			while (bucket + 1 < NUM_BUCKETS && latency_us >= BUCKET_US[bucket]) {
+				bucket++;
+			}
+			interval.buckets[bucket]++;
+			interval.latency_count++;
+			interval.latency_sum_us += latency_us;
+			interval.latency_min_us = std::min(interval.latency_min_us, latency_us);
+			interval.latency_max_us = std::max(interval.latency_max_us, latency_us);
+		}
+	}
+
+	total.add(interval);
+	printStats("total:", total, jitter_us);
+	close(sock);
+
+	return 0;
+}
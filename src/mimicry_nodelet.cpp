@@ -0,0 +1,32 @@
+#include <pluginlib/class_list_macros.h>
+#include <ros/package.h>
+
+#include "mimicry_openvr/mimicry_nodelet.hpp"
+
+
+MimicryNodelet::~MimicryNodelet()
+{
+	if (m_thread.joinable()) {
+		m_app.stop();
+		m_thread.join();
+	}
+}
+
+void MimicryNodelet::onInit()
+{
+	std::string config_file;
+
+	getPrivateNodeHandle().param<std::string>("config_file", config_file, "vive_params.json");
+	if (config_file.find('/') == std::string::npos) {
+		config_file = ros::package::getPath("mimicry_openvr") + "/param_files/" + config_file;
+	}
+
+	m_ros.reset(new RosPublisher(getNodeHandle(), getPrivateNodeHandle()));
+	m_app.addFrameSink(m_ros.get());
+	// SIGINT belongs to the nodelet manager, which unloads this nodelet on shutdown
+	m_app.setHandleSigint(false);
+
+	m_thread = std::thread(&MimicryApp::runMainLoop, &m_app, config_file);
+}
+
+PLUGINLIB_EXPORT_CLASS(MimicryNodelet, nodelet::Nodelet)
@@ -0,0 +1,153 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+
+#include "mimicry_openvr/wire_quantize.hpp"
+
+
+namespace wire = mimicry::wire;
+
+/**
+ * Round-trips random poses through the quantized pose encoding for a few
+ * bit budgets, and reports the position and rotation errors against the
+ * bounds documented in wire_quantize.hpp, along with the encoded size and
+ * the time to pack and unpack a pose.
+ *
+ * Positions are drawn uniformly from a 10 m cube around the origin (or the
+ * encodable range, if smaller) and orientations uniformly from all
+ * rotations.
+ *
+ * Usage: pose_quantization_bench [samples]
+ *
+ * Returns: 0 if every error is within its bound, 1 otherwise.
+ **/
+
+struct Pose
+{
+	float pos[3];
+	float quat[4];
+};
+
+static std::vector<Pose> makePoses(unsigned samples)
+{
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+	std::vector<Pose> poses(samples);
+
+	for (Pose &pose : poses) {
+		for (unsigned i = 0; i < 3; ++i) {
+			pose.pos[i] = unit(rng) * 2.0f - 1.0f;
+		}
+
+		// Uniform random rotation (Shoemake)
+		float u1(unit(rng)), u2(unit(rng) * 2.0f * M_PI), u3(unit(rng) * 2.0f * M_PI);
+		pose.quat[0] = std::sqrt(1.0f - u1) * std::sin(u2);
+		pose.quat[1] = std::sqrt(1.0f - u1) * std::cos(u2);
+		pose.quat[2] = std::sqrt(u1) * std::sin(u3);
+		pose.quat[3] = std::sqrt(u1) * std::cos(u3);
+	}
+
+	return poses;
+}
+
+/**
+ * Angle of the rotation from a to b, from the relative quaternion conj(a) b.
+ * Taking it from the vector part rather than acos of the dot product keeps
+ * it accurate for tiny angles.
+ **/
+static double rotationAngle(const float a[4], const float b[4])
+{
+	double ax(a[0]), ay(a[1]), az(a[2]), aw(a[3]);
+	double bx(b[0]), by(b[1]), bz(b[2]), bw(b[3]);
+
+	double w(aw * bw + ax * bx + ay * by + az * bz);
+	double x(aw * bx - bw * ax - (ay * bz - az * by));
+	double y(aw * by - bw * ay - (az * bx - ax * bz));
+	double z(aw * bz - bw * az - (ax * by - ay * bx));
+
+	return 2.0 * std::atan2(std::sqrt(x * x + y * y + z * z), std::fabs(w));
+}
+
+static bool run(const wire::PoseFormat &fmt, const std::vector<Pose> &unit_poses)
+{
+	double extent(std::min(5.0, fmt.range() * 0.99));
+	std::vector<Pose> poses(unit_poses);
+	std::vector<uint8_t> buf(poses.size() * fmt.poseSize());
+	double pos_max(0.0), pos_sq(0.0), ang_max(0.0), ang_sum(0.0);
+
+	for (Pose &pose : poses) {
+		for (unsigned i = 0; i < 3; ++i) {
+			pose.pos[i] *= extent;
+		}
+	}
+
+	auto start(std::chrono::steady_clock::now());
+	uint8_t *p(buf.data());
+	for (const Pose &pose : poses) {
+		wire::putPosition(p, pose.pos, fmt);
+		wire::putOrientation(p, pose.quat, fmt);
+	}
+	auto encoded(std::chrono::steady_clock::now());
+
+	std::vector<Pose> out(poses.size());
+	const uint8_t *q(buf.data());
+	for (Pose &pose : out) {
+		wire::getPosition(q, fmt, pose.pos);
+		wire::getOrientation(q + fmt.positionSize(), fmt, pose.quat);
+		q += fmt.poseSize();
+	}
+	auto decoded(std::chrono::steady_clock::now());
+
+	for (size_t n = 0; n < poses.size(); ++n) {
+		for (unsigned i = 0; i < 3; ++i) {
+			double err(std::fabs((double)out[n].pos[i] - poses[n].pos[i]));
+			pos_max = std::max(pos_max, err);
+			pos_sq += err * err;
+		}
+
+		double angle(rotationAngle(poses[n].quat, out[n].quat));
+		ang_max = std::max(ang_max, angle);
+		ang_sum += angle;
+	}
+
+	// Positions are rounded in double but published as floats, which adds up to
+	// half a float ulp at the largest coordinate
+	double pos_bound(fmt.resolution() / 2.0 + extent * 6e-8);
+	double ang_bound(4.0 * std::sqrt(3.0) * fmt.orientationError());
+	double per_pose_ns(1e9 / poses.size());
+	bool ok(pos_max <= pos_bound && ang_max <= ang_bound);
+
+	printf("%2u/%2u/%2u bits %3zu B  %8.4f mm over +-%-8g m  pos max %.4f rms %.4f (bound %.4f) mm"
+		"  rot max %.4f mean %.4f (bound %.4f) deg  pack %.1f unpack %.1f ns  %s\n",
+		fmt.pos_bits, fmt.frac_bits, fmt.quat_bits, fmt.poseSize(), fmt.resolution() * 1000.0, fmt.range(),
+		pos_max * 1000.0, std::sqrt(pos_sq / (3.0 * poses.size())) * 1000.0, pos_bound * 1000.0,
+		ang_max * 180.0 / M_PI, ang_sum / poses.size() * 180.0 / M_PI, ang_bound * 180.0 / M_PI,
+		std::chrono::duration<double>(encoded - start).count() * per_pose_ns,
+		std::chrono::duration<double>(decoded - encoded).count() * per_pose_ns,
+		ok ? "ok" : "OUT OF BOUNDS");
+
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned samples((argc > 1) ? atoi(argv[1]) : 1000000);
+	std::vector<Pose> poses(makePoses(samples));
+	const wire::PoseFormat formats[] = {
+		wire::PoseFormat(16, 10, 8),	// 1 mm over +-32 m
+		wire::PoseFormat(21, 14, 10),	// The 12-byte pose
+		wire::PoseFormat(24, 16, 12),
+		wire::PoseFormat(32, 20, 16)
+	};
+	bool ok(true);
+
+	std::cout << "f32 pose: 28 B" << std::endl;
+	for (const wire::PoseFormat &fmt : formats) {
+		ok = run(fmt, poses) && ok;
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,411 @@
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <net/if.h>
+#include <arpa/inet.h>
+
+#include "mimicry_openvr/publisher.hpp"
+
+
+/**
+ * Add a destination for output messages. Must be called before open().
+ *
+ * Params:
+ * 		addr - IPv4 address. An empty string sends to INADDR_ANY
+ * 		port - destination port
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the destination is valid, false otherwise.
+ **/
+bool Publisher::addDestination(const std::string &addr, unsigned port, std::string &error)
+{
+	Destination dest;
+
+	memset(&dest.addr, 0, sizeof(dest.addr));
+	dest.addr.in.sin_family = AF_INET;
+	dest.addr.in.sin_port = htons(port);
+	dest.addr_len = sizeof(dest.addr.in);
+	dest.socket = -1;
+
+	if (port == 0 || port > 65535) {
+		error = "Invalid output port specified: " + std::to_string(port);
+		return false;
+	}
+
+	if (addr.empty()) {
+		dest.addr.in.sin_addr.s_addr = INADDR_ANY;
+	}
+	else if (inet_pton(AF_INET, addr.c_str(), &dest.addr.in.sin_addr) <= 0) {
+		error = "Invalid address specified: " + addr;
+		return false;
+	}
+
+	dest.label = (addr.empty() ? "*" : addr) + ":" + std::to_string(port);
+	dest.multicast = IN_MULTICAST(ntohl(dest.addr.in.sin_addr.s_addr));
+	dest.sent = 0;
+	dest.dropped = 0;
+	dest.errors = 0;
+
+	m_dests.emplace_back(dest);
+	return true;
+}
+
+/**
+ * Add a multicast group as a destination. Output is sent to the group once
+ * per message, using the options set with setMulticastOptions().
+ *
+ * Params:
+ * 		group - IPv4 multicast address (224.0.0.0 to 239.255.255.255)
+ * 		port - destination port
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the group is valid, false otherwise.
+ **/
+bool Publisher::addMulticastGroup(const std::string &group, unsigned port, std::string &error)
+{
+	if (!addDestination(group, port, error)) {
+		return false;
+	}
+
+	if (!m_dests.back().multicast) {
+		m_dests.pop_back();
+		error = "Not a multicast group address: " + group;
+		return false;
+	}
+
+	return true;
+}
+
+/**
+ * Add a Unix domain datagram socket as a destination. The receiver must
+ * have bound its socket before messages are delivered; until then, sends
+ * to it are counted as errors.
+ *
+ * Params:
+ * 		path - filesystem path of the receiving socket, or '@' followed by a
+ * 			name in the abstract namespace
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the address is valid, false otherwise.
+ **/
+bool Publisher::addUnixDestination(const std::string &path, std::string &error)
+{
+	Destination dest;
+
+	memset(&dest.addr, 0, sizeof(dest.addr));
+	dest.addr.un.sun_family = AF_UNIX;
+
+	if (path.empty() || path == "@" || path.size() >= sizeof(dest.addr.un.sun_path)) {
+		error = "Invalid Unix socket address: '" + path + "'";
+		return false;
+	}
+
+	// Abstract names start with a NUL byte instead of '@' and are not NUL-terminated,
+	// so the address length has to cover exactly the name
+	memcpy(dest.addr.un.sun_path, path.data(), path.size());
+	if (path[0] == '@') {
+		dest.addr.un.sun_path[0] = '\0';
+	}
+	dest.addr_len = offsetof(sockaddr_un, sun_path) + path.size() + (path[0] == '@' ? 0 : 1);
+
+	dest.socket = -1;
+	dest.label = "unix:" + path;
+	dest.multicast = false;
+	dest.sent = 0;
+	dest.dropped = 0;
+	dest.errors = 0;
+
+	m_dests.emplace_back(dest);
+	return true;
+}
+
+/**
+ * Set the socket options used for multicast destinations.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+bool Publisher::applyMulticastOptions(std::string &error)
+{
+	int ttl(m_mcast.ttl);
+	if (ttl < 0 || ttl > 255 || setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0) {
+		error = "Invalid multicast TTL: " + std::to_string(m_mcast.ttl);
+		return false;
+	}
+
+	unsigned char loop(m_mcast.loopback ? 1 : 0);
+	if (setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0) {
+		error = "Could not set multicast loopback.";
+		return false;
+	}
+
+	if (!m_mcast.interface.empty()) {
+		// Accept either an interface name (e.g. "eth0") or the address of one
+		ip_mreqn req;
+		memset(&req, 0, sizeof(req));
+
+		if (inet_pton(AF_INET, m_mcast.interface.c_str(), &req.imr_address) <= 0) {
+			req.imr_ifindex = if_nametoindex(m_mcast.interface.c_str());
+			if (req.imr_ifindex == 0) {
+				error = "Unknown multicast interface: " + m_mcast.interface;
+				return false;
+			}
+		}
+
+		if (setsockopt(m_socket, IPPROTO_IP, IP_MULTICAST_IF, &req, sizeof(req)) < 0) {
+			error = "Could not use multicast interface " + m_mcast.interface + ": " + strerror(errno);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * Create the output sockets and build the message array for the configured
+ * destinations.
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+bool Publisher::open(std::string &error)
+{
+	if (m_dests.empty()) {
+		error = "No output destinations specified.";
+		return false;
+	}
+
+	for (Destination &dest : m_dests) {
+		if (dest.addr.in.sin_family == AF_INET && m_socket < 0) {
+			if ((m_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+				error = "Could not initialize socket.";
+				close();
+				return false;
+			}
+		}
+		else if (dest.addr.in.sin_family == AF_UNIX) {
+			if ((dest.socket = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+				error = "Could not initialize Unix socket.";
+				close();
+				return false;
+			}
+			if (m_unix_sndbuf > 0 && setsockopt(dest.socket, SOL_SOCKET, SO_SNDBUF,
+					&m_unix_sndbuf, sizeof(m_unix_sndbuf)) < 0) {
+				error = "Could not set Unix socket send buffer size.";
+				close();
+				return false;
+			}
+		}
+	}
+
+	for (const Destination &dest : m_dests) {
+		if (dest.multicast) {
+			if (!applyMulticastOptions(error)) {
+				close();
+				return false;
+			}
+			break;
+		}
+	}
+
+	m_iov.iov_base = NULL;
+	m_iov.iov_len = 0;
+
+	// Order the messages by socket, so that every AF_INET destination is in one sendmmsg batch
+	m_msg_dests.clear();
+	for (size_t i = 0; i < m_dests.size(); ++i) {
+		if (m_dests[i].addr.in.sin_family == AF_INET) {
+			m_msg_dests.push_back(i);
+		}
+	}
+	for (size_t i = 0; i < m_dests.size(); ++i) {
+		if (m_dests[i].addr.in.sin_family != AF_INET) {
+			m_msg_dests.push_back(i);
+		}
+	}
+
+	m_msgs.resize(m_dests.size());
+	m_batches.clear();
+	for (size_t i = 0; i < m_msgs.size(); ++i) {
+		Destination &dest(m_dests[m_msg_dests[i]]);
+		int sock(dest.addr.in.sin_family == AF_UNIX ? dest.socket : m_socket);
+
+		memset(&m_msgs[i], 0, sizeof(m_msgs[i]));
+		m_msgs[i].msg_hdr.msg_name = &dest.addr;
+		m_msgs[i].msg_hdr.msg_namelen = dest.addr_len;
+		m_msgs[i].msg_hdr.msg_iov = &m_iov;
+		m_msgs[i].msg_hdr.msg_iovlen = 1;
+
+		if (m_batches.empty() || m_batches.back().socket != sock) {
+			Batch batch = { sock, i, 0 };
+			m_batches.push_back(batch);
+		}
+		m_batches.back().count++;
+	}
+
+	if (m_use_ring && !m_ring.open(m_dests.size(), m_ring_error)) {
+		m_ring.close();
+	}
+
+	return true;
+}
+
+void Publisher::close()
+{
+	m_ring.close();
+	if (m_socket >= 0) {
+		::close(m_socket);
+		m_socket = -1;
+	}
+	for (Destination &dest : m_dests) {
+		if (dest.socket >= 0) {
+			::close(dest.socket);
+			dest.socket = -1;
+		}
+	}
+}
+
+/**
+ * Send a message to every destination.
+ **/
+void Publisher::send(const void *data, size_t len)
+{
+	m_iov.iov_base = const_cast<void *>(data);
+	m_iov.iov_len = len;
+
+	if (m_ring.isOpen()) {
+		sendRing();
+		return;
+	}
+
+	for (const Batch &batch : m_batches) {
+		sendBatch(batch);
+	}
+}
+
+/**
+ * Count the outcome of a send to a destination.
+ *
+ * Params:
+ * 		dest - destination sent to
+ * 		err - 0 on success, errno otherwise
+ **/
+void Publisher::countResult(Destination &dest, int err)
+{
+	if (err == 0) {
+		dest.sent++;
+	}
+	else if (err == EAGAIN || err == EWOULDBLOCK || err == ENOBUFS) {
+		dest.dropped++;
+	}
+	else {
+		dest.errors++;
+	}
+}
+
+/**
+ * Send the current message to every destination through io_uring. The
+ * sends are non-blocking, so they complete while being submitted, and the
+ * same system call waits for their completions: once it returns, the
+ * message buffer may be reused.
+ **/
+void Publisher::sendRing()
+{
+	IoRing::Completion completion;
+	size_t queued(0);
+
+	for (const Batch &batch : m_batches) {
+		for (size_t i = batch.first; i < batch.first + batch.count; ++i) {
+			if (!m_ring.queueSendmsg(batch.socket, &m_msgs[i].msg_hdr, MSG_DONTWAIT, m_msg_dests[i])) {
+				m_dests[m_msg_dests[i]].errors++;
+				continue;
+			}
+			queued++;
+		}
+	}
+
+	int ret(m_ring.submit(queued));
+	if (ret < 0) {
+		// Don't leave requests for this message queued behind the next one; go back to sendmmsg
+		m_ring_error = std::string("io_uring_enter failed: ") + strerror(-ret);
+		m_ring.close();
+		for (Destination &dest : m_dests) {
+			dest.errors++;
+		}
+		return;
+	}
+
+	while (m_ring.nextCompletion(completion)) {
+		countResult(m_dests[completion.user_data], (completion.res < 0) ? -completion.res : 0);
+	}
+}
+
+/**
+ * Send the current message to one run of destinations. sendmmsg stops at
+ * the first destination that fails; count it and carry on with the rest.
+ **/
+void Publisher::sendBatch(const Batch &batch)
+{
+	size_t next(batch.first);
+	size_t end(batch.first + batch.count);
+
+	while (next < end) {
+		int sent(sendmmsg(batch.socket, &m_msgs[next], end - next, MSG_DONTWAIT));
+
+		if (sent < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			countResult(m_dests[m_msg_dests[next]], errno);
+			next++;
+			continue;
+		}
+
+		for (int i = 0; i < sent; ++i) {
+			countResult(m_dests[m_msg_dests[next + i]], 0);
+		}
+		next += sent;
+	}
+}
+
+/**
+ * Returns: one line of send counters per destination.
+ **/
+std::string Publisher::summary() const
+{
+	std::string text;
+
+	for (const Destination &dest : m_dests) {
+		if (!text.empty()) {
+			text += "\n";
+		}
+		text += dest.label + ": sent " + std::to_string(dest.sent)
+			+ ", dropped " + std::to_string(dest.dropped)
+			+ ", errors " + std::to_string(dest.errors);
+	}
+
+	return text;
+}
+
+/**
+ * Split an "address:port" destination as used in the parameter file.
+ *
+ * Returns: true if the port is a valid number, false otherwise.
+ **/
+bool Publisher::parseEndpoint(const std::string &spec, std::string &addr, unsigned &port)
+{
+	size_t colon(spec.rfind(':'));
+	if (colon == std::string::npos || colon + 1 == spec.size()) {
+		return false;
+	}
+
+	char *end;
+	unsigned long val(strtoul(spec.c_str() + colon + 1, &end, 10));
+	if (*end != '\0' || val == 0 || val > 65535) {
+		return false;
+	}
+
+	addr = spec.substr(0, colon);
+	port = val;
+	return true;
+}
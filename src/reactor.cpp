@@ -0,0 +1,200 @@
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+
+#include "mimicry_openvr/reactor.hpp"
+
+
+static const int MAX_EVENTS = 16;
+static const int64_t NSEC_PER_SEC = 1000000000;
+
+bool Reactor::open(std::string &error)
+{
+	close();
+
+	m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (m_epoll_fd < 0) {
+		error = std::string("Could not create epoll instance: ") + strerror(errno);
+		return false;
+	}
+
+	return true;
+}
+
+void Reactor::close()
+{
+	if (m_epoll_fd >= 0) {
+		::close(m_epoll_fd);
+		m_epoll_fd = -1;
+	}
+	m_handlers.clear();
+}
+
+/**
+ * Watch a file descriptor. The reactor does not take ownership of it.
+ *
+ * Params:
+ * 		fd - descriptor to watch
+ * 		events - epoll events to wait for (e.g. EPOLLIN)
+ * 		handler - called with the ready events from wait()
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the descriptor is watched, false otherwise.
+ **/
+bool Reactor::add(int fd, uint32_t events, const Handler &handler, std::string &error)
+{
+	epoll_event ev;
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		error = std::string("Could not watch file descriptor: ") + strerror(errno);
+		return false;
+	}
+
+	m_handlers[fd] = handler;
+	return true;
+}
+
+/**
+ * Stop watching a file descriptor. Safe to call from a handler; events
+ * already returned for the descriptor are dropped.
+ **/
+void Reactor::remove(int fd)
+{
+	if (m_handlers.erase(fd) > 0) {
+		epoll_ctl(m_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+	}
+}
+
+/**
+ * Wait for events and call the handlers of the ready descriptors.
+ *
+ * Params:
+ * 		timeout_ms - longest time to wait, or -1 to wait indefinitely
+ *
+ * Returns: number of events dispatched, 0 if the wait timed out or was
+ * 		interrupted, or -1 on error.
+ **/
+int Reactor::wait(int timeout_ms)
+{
+	epoll_event events[MAX_EVENTS];
+	int num(epoll_wait(m_epoll_fd, events, MAX_EVENTS, timeout_ms));
+
+	if (num < 0) {
+		return (errno == EINTR) ? 0 : -1;
+	}
+
+	for (int i = 0; i < num; ++i) {
+		auto it(m_handlers.find(events[i].data.fd));
+		if (it != m_handlers.end()) {
+			// A copy, in case the handler removes itself
+			Handler handler(it->second);
+			handler(events[i].events);
+		}
+	}
+
+	return num;
+}
+
+/**
+ * Create a disarmed timer on CLOCK_MONOTONIC that becomes readable at the
+ * deadline set by armTimer().
+ *
+ * Returns: the timer descriptor, or -1 on failure.
+ **/
+int Reactor::createTimer(std::string &error)
+{
+	int fd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+
+	if (fd < 0) {
+		error = std::string("Could not create timer: ") + strerror(errno);
+	}
+	return fd;
+}
+
+/**
+ * Set a timer to expire once at an absolute CLOCK_MONOTONIC time. A
+ * deadline in the past expires right away.
+ **/
+void Reactor::armTimer(int fd, int64_t deadline_ns)
+{
+	itimerspec spec;
+
+	memset(&spec, 0, sizeof(spec));
+	// A zero expiration would disarm the timer instead
+	deadline_ns = (deadline_ns > 0) ? deadline_ns : 1;
+	spec.it_value.tv_sec = deadline_ns / NSEC_PER_SEC;
+	spec.it_value.tv_nsec = deadline_ns % NSEC_PER_SEC;
+	timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void Reactor::disarmTimer(int fd)
+{
+	itimerspec spec;
+
+	memset(&spec, 0, sizeof(spec));
+	timerfd_settime(fd, 0, &spec, NULL);
+}
+
+/**
+ * Acknowledge a timer expiration, so the timer stops being readable.
+ *
+ * Returns: number of expirations since the last read, 0 if none.
+ **/
+uint64_t Reactor::readTimer(int fd)
+{
+	uint64_t expirations(0);
+
+	if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+		return 0;
+	}
+	return expirations;
+}
+
+/**
+ * Create a descriptor that becomes readable when one of the given signals
+ * is pending. The signals must be blocked in every thread, or they are
+ * delivered the usual way instead.
+ *
+ * Returns: the signal descriptor, or -1 on failure.
+ **/
+int Reactor::createSignalFd(const sigset_t &signals, std::string &error)
+{
+	int fd(signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC));
+
+	if (fd < 0) {
+		error = std::string("Could not create signal descriptor: ") + strerror(errno);
+	}
+	return fd;
+}
+
+/**
+ * Create a descriptor that becomes readable once notifyEvent() is called
+ * on it, from any thread, and stays readable until it is read.
+ *
+ * Returns: the event descriptor, or -1 on failure.
+ **/
+int Reactor::createEventFd(std::string &error)
+{
+	int fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+
+	if (fd < 0) {
+		error = std::string("Could not create event descriptor: ") + strerror(errno);
+	}
+	return fd;
+}
+
+void Reactor::notifyEvent(int fd)
+{
+	uint64_t one(1);
+
+	if (write(fd, &one, sizeof(one)) != sizeof(one)) {
+		// Only fails once the counter is about to overflow, when the descriptor is readable anyway
+	}
+}
@@ -0,0 +1,169 @@
+#include <geometry_msgs/PoseStamped.h>
+#include <geometry_msgs/TransformStamped.h>
+#include <sensor_msgs/Joy.h>
+
+#include "mimicry_openvr/ros_publisher.hpp"
+
+
+RosPublisher::RosPublisher(const ros::NodeHandle &nh, const ros::NodeHandle &private_nh) : m_nh(nh)
+{
+	private_nh.param<std::string>("frame_id", m_frame_id, "world");
+	private_nh.param("publish_pose", m_publish_pose, true);
+	private_nh.param("publish_joy", m_publish_joy, true);
+	private_nh.param("publish_tf", m_publish_tf, false);
+	private_nh.param("queue_size", m_queue_size, 10);
+}
+
+/**
+ * Advertise the topics of every configured device, and store the names of
+ * their Joy buttons and axes as parameters.
+ *
+ * Params:
+ * 		devices - configured devices, in slot order
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the topics are advertised, false otherwise.
+ **/
+bool RosPublisher::start(const std::vector<VRDevice> &devices, std::string &error)
+{
+	if (m_queue_size < 1) {
+		error = "ROS queue_size must be at least 1.";
+		return false;
+	}
+
+	m_topics.clear();
+	m_topics.resize(devices.size());
+
+	for (size_t slot = 0; slot < devices.size(); ++slot) {
+		const VRDevice &dev(devices[slot]);
+		DeviceTopics &topics(m_topics[slot]);
+		std::vector<std::string> button_names, axis_names;
+
+		for (uint64_t mask(dev.button_mask); mask != 0; mask &= mask - 1) {
+			const VRButton &button(dev.buttons[__builtin_ctzll(mask)]);
+
+			if (button.val_types[VRButton::V_BOOLEAN]) {
+				button_names.push_back(button.name);
+			}
+			if (button.val_types[VRButton::V_PRESSURE]) {
+				axis_names.push_back(button.name + "/pressure");
+			}
+			if (button.val_types[VRButton::V_2D]) {
+				axis_names.push_back(button.name + "/x");
+				axis_names.push_back(button.name + "/y");
+			}
+		}
+		topics.num_buttons = button_names.size();
+		topics.num_axes = axis_names.size();
+
+		if (m_publish_pose && dev.track_pose) {
+			topics.pose = m_nh.advertise<geometry_msgs::PoseStamped>(dev.name + "/pose", m_queue_size);
+		}
+		if (m_publish_joy && (topics.num_buttons > 0 || topics.num_axes > 0)) {
+			topics.joy = m_nh.advertise<sensor_msgs::Joy>(dev.name + "/joy", m_queue_size);
+			m_nh.setParam(dev.name + "/joy_buttons", button_names);
+			m_nh.setParam(dev.name + "/joy_axes", axis_names);
+		}
+	}
+
+	if (m_publish_tf) {
+		m_tf.reset(new tf2_ros::TransformBroadcaster());
+	}
+
+	return true;
+}
+
+/**
+ * Publish the state of every active device.
+ **/
+void RosPublisher::publish(const std::vector<VRDevice> &devices, const FrameInfo &info)
+{
+	ros::Time stamp;
+	std::vector<geometry_msgs::TransformStamped> transforms;
+
+	stamp.fromNSec(info.capture_ns);
+
+	for (size_t slot = 0; slot < devices.size() && slot < m_topics.size(); ++slot) {
+		const VRDevice &dev(devices[slot]);
+		const DeviceTopics &topics(m_topics[slot]);
+
+		if (!dev.isActive()) {
+			continue;
+		}
+
+		if (topics.joy) {
+			publishJoy(dev, topics, stamp);
+		}
+
+		if (!dev.track_pose || !dev.pose_valid) {
+			continue;
+		}
+
+		if (topics.pose) {
+			publishPose(dev, topics, stamp);
+		}
+		if (m_tf) {
+			geometry_msgs::TransformStamped tf;
+			tf.header.stamp = stamp;
+			tf.header.frame_id = m_frame_id;
+			tf.child_frame_id = dev.name;
+			tf.transform.translation.x = dev.pose.pos.x;
+			tf.transform.translation.y = dev.pose.pos.y;
+			tf.transform.translation.z = dev.pose.pos.z;
+			tf.transform.rotation.x = dev.pose.quat.x;
+			tf.transform.rotation.y = dev.pose.quat.y;
+			tf.transform.rotation.z = dev.pose.quat.z;
+			tf.transform.rotation.w = dev.pose.quat.w;
+			transforms.push_back(tf);
+		}
+	}
+
+	if (m_tf && !transforms.empty()) {
+		m_tf->sendTransform(transforms);
+	}
+}
+
+void RosPublisher::publishPose(const VRDevice &dev, const DeviceTopics &topics, const ros::Time &stamp)
+{
+	geometry_msgs::PoseStampedPtr msg(new geometry_msgs::PoseStamped());
+
+	msg->header.stamp = stamp;
+	msg->header.frame_id = m_frame_id;
+	msg->pose.position.x = dev.pose.pos.x;
+	msg->pose.position.y = dev.pose.pos.y;
+	msg->pose.position.z = dev.pose.pos.z;
+	msg->pose.orientation.x = dev.pose.quat.x;
+	msg->pose.orientation.y = dev.pose.quat.y;
+	msg->pose.orientation.z = dev.pose.quat.z;
+	msg->pose.orientation.w = dev.pose.quat.w;
+
+	// Published by pointer: same-process subscribers share this message
+	topics.pose.publish(msg);
+}
+
+void RosPublisher::publishJoy(const VRDevice &dev, const DeviceTopics &topics, const ros::Time &stamp)
+{
+	sensor_msgs::JoyPtr msg(new sensor_msgs::Joy());
+
+	msg->header.stamp = stamp;
+	msg->header.frame_id = dev.name;
+	msg->buttons.reserve(topics.num_buttons);
+	msg->axes.reserve(topics.num_axes);
+
+	for (uint64_t mask(dev.button_mask); mask != 0; mask &= mask - 1) {
+		const VRButton &button(dev.buttons[__builtin_ctzll(mask)]);
+
+		if (button.val_types[VRButton::V_BOOLEAN]) {
+			msg->buttons.push_back(button.pressed ? 1 : 0);
+		}
+		if (button.val_types[VRButton::V_PRESSURE]) {
+			msg->axes.push_back(button.pressure);
+		}
+		if (button.val_types[VRButton::V_2D]) {
+			msg->axes.push_back(button.touch_pos.x);
+			msg->axes.push_back(button.touch_pos.y);
+		}
+	}
+
+	topics.joy.publish(msg);
+}
@@ -0,0 +1,149 @@
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "mimicry_openvr/json.hpp"
+#include "mimicry_openvr/mimicry_app.hpp"
+#include "mimicry_openvr/shm_reader.hpp"
+#include "mimicry_openvr/bench_devices.hpp"
+
+
+using json = nlohmann::json;
+
+/**
+ * Measures publish-to-consume latency of the shared-memory transport
+ * against the default UDP path on loopback. Each sample is a single frame
+ * in flight: the clock starts before the frame is written and stops once
+ * the consumer holds a usable copy, i.e. a parsed JSON object for UDP and
+ * a validated snapshot for shared memory.
+ *
+ * The UDP consumer blocks in recv(), while the shared-memory consumer
+ * polls the frame counter, as a latency-sensitive local reader would.
+ *
+ * Usage: shm_latency_bench [samples]
+ **/
+
+static std::atomic<int64_t> g_sent_ns(0);
+static std::atomic<unsigned> g_done(0);
+static std::vector<int64_t> g_latency_ns;
+
+static void report(const std::string &label, std::vector<int64_t> &samples)
+{
+	std::sort(samples.begin(), samples.end());
+
+	std::cout << label << ": min " << samples.front() / 1000.0
+		<< " us, median " << samples[samples.size() / 2] / 1000.0
+		<< " us, p99 " << samples[samples.size() * 99 / 100] / 1000.0
+		<< " us, max " << samples.back() / 1000.0 << " us" << std::endl;
+}
+
+static void waitForConsumer(unsigned count)
+{
+	while (g_done.load() < count) {
+		std::this_thread::yield();
+	}
+}
+
+static void udpConsumer(int sock, unsigned samples)
+{
+	std::vector<char> buf(65536);
+
+	for (unsigned i = 0; i < samples; ++i) {
+		ssize_t len(recv(sock, buf.data(), buf.size(), 0));
+		json j(json::parse(buf.data(), buf.data() + len));
+
+		g_latency_ns[i] = FrameScheduler::monotonicNow() - g_sent_ns.load();
+		g_done.fetch_add(1);
+	}
+}
+
+static void shmConsumer(const std::string &name, unsigned samples)
+{
+	mimicry::shm::ShmReader reader;
+	mimicry::shm::Snapshot snap;
+	std::string error;
+
+	if (!reader.open(name, error)) {
+		std::cerr << error << std::endl;
+		exit(1);
+	}
+
+	for (unsigned i = 0; i < samples; ++i) {
+		while (reader.frames() <= i) {}
+		reader.latest(snap);
+
+		g_latency_ns[i] = FrameScheduler::monotonicNow() - g_sent_ns.load();
+		g_done.fetch_add(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	unsigned samples((argc > 1) ? atoi(argv[1]) : 20000);
+	std::vector<VRDevice> devices(bench::makeDevices());
+	FrameInfo info;
+	std::string error;
+
+	g_latency_ns.resize(samples);
+
+	// UDP: compact JSON through the publisher to a socket on an ephemeral port
+	int sock(socket(AF_INET, SOCK_DGRAM, 0));
+	sockaddr_in addr = {};
+	socklen_t addr_len(sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	bind(sock, (sockaddr *)&addr, sizeof(addr));
+	getsockname(sock, (sockaddr *)&addr, &addr_len);
+
+	JsonEmitter emitter;
+	Publisher publisher;
+	if (!emitter.compile(devices, info, error)
+			|| !publisher.addDestination("127.0.0.1", ntohs(addr.sin_port), error)
+			|| !publisher.open(error)) {
+		std::cerr << error << std::endl;
+		return 1;
+	}
+
+	std::thread udp_thread(udpConsumer, sock, samples);
+	for (unsigned i = 0; i < samples; ++i) {
+		devices[0].pose.pos.x = i;
+		g_sent_ns.store(FrameScheduler::monotonicNow());
+		size_t len(emitter.emit());
+		publisher.send(emitter.data(), len);
+		waitForConsumer(i + 1);
+		usleep(50);
+	}
+	udp_thread.join();
+	close(sock);
+	report("UDP + JSON parse", g_latency_ns);
+
+	// Shared memory
+	std::string shm_name("/mimicry_bench_" + std::to_string(getpid()));
+	ShmWriter writer;
+	if (!writer.open(shm_name, devices, ShmWriter::DEFAULT_RING_SIZE, error)) {
+		std::cerr << error << std::endl;
+		return 1;
+	}
+
+	g_done.store(0);
+	std::thread shm_thread(shmConsumer, shm_name, samples);
+	for (unsigned i = 0; i < samples; ++i) {
+		devices[0].pose.pos.x = i;
+		g_sent_ns.store(FrameScheduler::monotonicNow());
+		writer.publish(devices, info);
+		waitForConsumer(i + 1);
+		usleep(50);
+	}
+	shm_thread.join();
+	writer.close();
+	report("Shared memory", g_latency_ns);
+
+	return 0;
+}
@@ -0,0 +1,170 @@
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mimicry_openvr/mimicry_app.hpp"
+#include "mimicry_openvr/shm_writer.hpp"
+
+
+using namespace mimicry::shm;
+
+constexpr unsigned ShmWriter::DEFAULT_RING_SIZE;
+
+static void copyName(char *dest, const std::string &name)
+{
+	size_t len(name.size() < NAME_LEN - 1 ? name.size() : NAME_LEN - 1);
+	memcpy(dest, name.data(), len);
+	dest[len] = '\0';
+}
+
+/**
+ * Create the shared-memory segment and describe the configured devices in
+ * it. An existing segment with the same name is unlinked first.
+ *
+ * Params:
+ * 		name - shm object name; a leading '/' is added if missing
+ * 		devices - configured devices, in slot order
+ * 		ring_size - number of frames kept in the ring
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the segment is ready for publishing, false otherwise.
+ **/
+bool ShmWriter::open(const std::string &name, const std::vector<VRDevice> &devices,
+	unsigned ring_size, std::string &error)
+{
+	close();
+
+	if (devices.size() > MAX_DEVICES) {
+		error = "Shared memory output supports at most " + std::to_string(MAX_DEVICES) + " devices.";
+		return false;
+	}
+	if (ring_size < 2) {
+		error = "Shared memory ring must hold at least 2 frames.";
+		return false;
+	}
+
+	m_path = (name.empty() || name[0] != '/') ? "/" + name : name;
+	m_size = segmentSize(ring_size);
+
+	// Replace rather than truncate a stale segment, which readers may still have mapped
+	shm_unlink(m_path.c_str());
+	int fd(shm_open(m_path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644));
+	if (fd < 0) {
+		error = "Could not create shared memory segment " + m_path;
+		return false;
+	}
+
+	if (ftruncate(fd, m_size) < 0) {
+		::close(fd);
+		shm_unlink(m_path.c_str());
+		error = "Could not size shared memory segment " + m_path;
+		return false;
+	}
+
+	void *addr(mmap(NULL, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+	::close(fd);
+	if (addr == MAP_FAILED) {
+		shm_unlink(m_path.c_str());
+		error = "Could not map shared memory segment " + m_path;
+		return false;
+	}
+
+	// The segment is zero-filled by ftruncate, so every slot starts with an even sequence
+	m_seg = (Segment *)addr;
+	m_seg->ring_size = ring_size;
+	m_seg->num_devices = devices.size();
+	m_frame = 0;
+
+	for (size_t slot = 0; slot < devices.size(); ++slot) {
+		const VRDevice &dev(devices[slot]);
+		DeviceInfo &info(m_seg->devices[slot]);
+
+		copyName(info.name, dev.name);
+		info.role = dev.role;
+
+		m_button_ids[slot].clear();
+		for (uint64_t mask(dev.button_mask); mask != 0; mask &= mask - 1) {
+			const VRButton &button(dev.buttons[__builtin_ctzll(mask)]);
+
+			if (m_button_ids[slot].size() == MAX_BUTTONS) {
+				close();
+				error = "Too many buttons configured for " + dev.name + " for shared memory output.";
+				return false;
+			}
+
+			ButtonInfo &b_info(info.buttons[m_button_ids[slot].size()]);
+			b_info.id = button.id;
+			b_info.types = WireEncoder::buttonTypeBits(button);
+			copyName(b_info.name, button.name);
+
+			m_button_ids[slot].push_back(button.id);
+		}
+		info.num_buttons = m_button_ids[slot].size();
+	}
+
+	// Readers check the magic last, so they never see a half-initialized header
+	m_seg->version = VERSION;
+	std::atomic_thread_fence(std::memory_order_release);
+	m_seg->magic = MAGIC;
+
+	return true;
+}
+
+/**
+ * Write the current state of all configured devices as the next frame.
+ **/
+void ShmWriter::publish(const std::vector<VRDevice> &devices, const FrameInfo &info)
+{
+	FrameSlot &slot(m_seg->ring[m_frame % m_seg->ring_size]);
+	uint32_t seq(slot.seq.load(std::memory_order_relaxed));
+
+	slot.seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.frame = m_frame;
+	slot.publish_ns = FrameScheduler::monotonicNow();
+	slot.capture_ns = info.capture_ns;
+	slot.pose_time_ns = info.pose_time_ns;
+	slot.num_devices = m_seg->num_devices;
+
+	for (size_t ix = 0; ix < m_seg->num_devices; ++ix) {
+		const VRDevice &dev(devices[ix]);
+		DeviceState &state(slot.devices[ix]);
+
+		state.flags = (dev.isActive() ? F_ACTIVE : 0) | (dev.pose_valid ? F_POSE_VALID : 0);
+		state.packet_num = dev.packet_num;
+		state.pos[0] = dev.pose.pos.x;
+		state.pos[1] = dev.pose.pos.y;
+		state.pos[2] = dev.pose.pos.z;
+		state.quat[0] = dev.pose.quat.x;
+		state.quat[1] = dev.pose.quat.y;
+		state.quat[2] = dev.pose.quat.z;
+		state.quat[3] = dev.pose.quat.w;
+
+		for (size_t b = 0; b < m_button_ids[ix].size(); ++b) {
+			const VRButton &button(dev.buttons[m_button_ids[ix][b]]);
+
+			state.buttons[b].pressed = button.pressed;
+			state.buttons[b].pressure = button.pressure;
+			state.buttons[b].touch[0] = button.touch_pos.x;
+			state.buttons[b].touch[1] = button.touch_pos.y;
+		}
+	}
+
+	slot.seq.store(seq + 2, std::memory_order_release);
+	m_seg->frames.store(++m_frame, std::memory_order_release);
+}
+
+/**
+ * Unmap and remove the segment. Readers that still have it mapped keep
+ * their mapping, but see no further frames.
+ **/
+void ShmWriter::close()
+{
+	if (m_seg != NULL) {
+		munmap(m_seg, m_size);
+		shm_unlink(m_path.c_str());
+		m_seg = NULL;
+	}
+}
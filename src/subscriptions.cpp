@@ -0,0 +1,489 @@
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "mimicry_openvr/mimicry_app.hpp"
+#include "mimicry_openvr/subscriptions.hpp"
+
+
+using json = nlohmann::json;
+
+static const size_t MAX_REQUEST_SIZE = 4096;
+
+struct SubscriptionManager::Subscriber
+{
+	std::string destination;	// "address:port" or "unix:path"; identifies the subscriber
+	std::string request;		// Request the plan was built from, to recognize renewals
+	Projection proj;
+	bool binary;
+	double rate;				// Effective rate in Hz, 0 for every frame
+	int64_t interval_ns;		// 0 to send every frame
+	int64_t next_due_ns;
+	int64_t expires_ns;
+	int64_t last_schema_ns;
+	FrameInfo info;				// seq counts the frames sent to this subscriber
+	Publisher publisher;
+	JsonEmitter emitter;
+	WireEncoder encoder;
+};
+
+/**
+ * Parse a field name as used in subscription requests.
+ *
+ * Returns: the matching Projection::Field, or 0 if the name is invalid.
+ **/
+static unsigned fieldFromName(const std::string &name)
+{
+	if (name == "pose") {
+		return Projection::F_POSE;
+	}
+	else if (name == "buttons") {
+		return Projection::F_BUTTONS;
+	}
+	else if (name == "velocity") {
+		return Projection::F_VELOCITY;
+	}
+
+	return 0;
+}
+
+static std::string endpointLabel(const sockaddr_in &addr)
+{
+	char text[INET_ADDRSTRLEN];
+
+	inet_ntop(AF_INET, &addr.sin_addr, text, sizeof(text));
+	return std::string(text) + ":" + std::to_string(ntohs(addr.sin_port));
+}
+
+static json errorReply(const std::string &text)
+{
+	json reply;
+	reply["error"] = text;
+	return reply;
+}
+
+SubscriptionManager::SubscriptionManager() : m_socket(-1), m_timeout_ns(0), m_schema_interval_ns(0),
+		m_max_message_size(0), m_accepted(0)
+{
+}
+
+SubscriptionManager::~SubscriptionManager()
+{
+	close();
+}
+
+/**
+ * Open the control socket.
+ *
+ * Params:
+ * 		addr - local IPv4 address to receive requests on; empty for every
+ * 			interface
+ * 		port - UDP port to receive requests on
+ * 		timeout_s - lease time of a subscription, in seconds
+ * 		schema_interval - how often binary subscribers get the schema, in msecs
+ * 		max_message_size - size above which frames are split into chunks, 0
+ * 			for no limit
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if successful, false otherwise.
+ **/
+bool SubscriptionManager::open(const std::string &addr, unsigned port, unsigned timeout_s,
+	unsigned schema_interval, size_t max_message_size, std::string &error)
+{
+	sockaddr_in local;
+
+	close();
+
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_addr.s_addr = INADDR_ANY;
+	local.sin_port = htons(port);
+
+	if (port == 0 || port > 65535) {
+		error = "Invalid control port specified: " + std::to_string(port);
+		return false;
+	}
+	if (!addr.empty() && inet_pton(AF_INET, addr.c_str(), &local.sin_addr) <= 0) {
+		error = "Invalid control address specified: " + addr;
+		return false;
+	}
+
+	if ((m_socket = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		error = "Could not initialize control socket.";
+		return false;
+	}
+
+	if (bind(m_socket, (const sockaddr *)&local, sizeof(local)) < 0) {
+		error = "Control socket binding failed.";
+		close();
+		return false;
+	}
+
+	m_timeout_ns = timeout_s * 1000000000ll;
+	m_schema_interval_ns = schema_interval * 1000000ll;
+	m_max_message_size = max_message_size;
+	m_accepted = 0;
+
+	return true;
+}
+
+void SubscriptionManager::close()
+{
+	if (m_socket >= 0) {
+		::close(m_socket);
+		m_socket = -1;
+	}
+
+	m_subs.clear();
+}
+
+/**
+ * Answer every pending control request without blocking, and drop the
+ * subscribers whose lease has run out.
+ *
+ * Params:
+ * 		devices - configured devices. Must stay at the same address for as
+ * 			long as subscriptions are published
+ * 		update_freq - rate of the main loop in Hz, 0 if free-running
+ **/
+void SubscriptionManager::handleRequests(const std::vector<VRDevice> &devices, unsigned update_freq)
+{
+	char buf[MAX_REQUEST_SIZE];
+	sockaddr_in from;
+
+	if (m_socket < 0) {
+		return;
+	}
+
+	for (;;) {
+		socklen_t from_len(sizeof(from));
+		ssize_t len(recvfrom(m_socket, buf, sizeof(buf), MSG_DONTWAIT, (sockaddr *)&from, &from_len));
+		if (len < 0) {
+			break;
+		}
+
+		json req(json::parse(buf, buf + len, nullptr, false));
+		json reply;
+
+		if (req.is_discarded() || !req.is_object()) {
+			reply = errorReply("Request is not a JSON object.");
+		}
+		else if (req.find("subscribe") != req.end()) {
+			reply = subscribe(req["subscribe"], from, devices, update_freq);
+		}
+		else if (req.find("unsubscribe") != req.end()) {
+			reply = unsubscribe(req["unsubscribe"], from);
+		}
+		else {
+			reply = errorReply("Unknown request. Expected 'subscribe' or 'unsubscribe'.");
+		}
+
+		std::string text(reply.dump());
+		sendto(m_socket, text.data(), text.size(), MSG_DONTWAIT, (const sockaddr *)&from, from_len);
+	}
+
+	expire(FrameScheduler::monotonicNow());
+}
+
+/**
+ * Check whether a client may have frames sent to a destination. Any
+ * client may use the destinations configured with setAllowedDestinations();
+ * otherwise only UDP destinations at the client's own address are allowed,
+ * so that a request can't direct a stream at a third party, or at a local
+ * socket that the client couldn't reach itself.
+ **/
+bool SubscriptionManager::isAllowed(const std::string &destination, const sockaddr_in &from) const
+{
+	std::string addr;
+	unsigned port;
+	in_addr dest_addr;
+
+	if (std::find(m_allowed.begin(), m_allowed.end(), destination) != m_allowed.end()) {
+		return true;
+	}
+
+	return destination.compare(0, 5, "unix:") != 0
+		&& Publisher::parseEndpoint(destination, addr, port)
+		&& inet_pton(AF_INET, addr.c_str(), &dest_addr) > 0
+		&& dest_addr.s_addr == from.sin_addr.s_addr;
+}
+
+/**
+ * Create, update or renew a subscription. An identical request from the
+ * same destination only extends the lease; any other request for the
+ * destination replaces its plan, keeping its sequence numbers going.
+ *
+ * Returns: the reply to send to the client.
+ **/
+json SubscriptionManager::subscribe(const json &req, const sockaddr_in &from,
+	const std::vector<VRDevice> &devices, unsigned update_freq)
+{
+	std::string destination, format;
+	Projection proj;
+	double rate;
+
+	if (!req.is_object()) {
+		return errorReply("Subscription request must be an object.");
+	}
+
+	try {
+		destination = req.value("destination", "");
+		format = req.value("format", "json");
+		rate = req.value("rate", 0.0);
+
+		if (req.find("devices") != req.end()) {
+			proj.devices = 0;
+			for (const json &name : req["devices"]) {
+				size_t slot(0);
+				while (slot < devices.size() && devices[slot].name != name.get<std::string>()) {
+					slot++;
+				}
+				if (slot == devices.size()) {
+					return errorReply("Unknown device: " + name.get<std::string>());
+				}
+				proj.devices |= 1ull << slot;
+			}
+		}
+
+		if (req.find("fields") != req.end()) {
+			proj.fields = 0;
+			for (const json &name : req["fields"]) {
+				unsigned field(fieldFromName(name.get<std::string>()));
+				if (field == 0) {
+					return errorReply("Unknown field: " + name.get<std::string>()
+						+ ". Valid fields are 'pose', 'buttons' and 'velocity'.");
+				}
+				proj.fields |= field;
+			}
+		}
+	}
+	catch (const json::exception &exc) {
+		return errorReply(std::string("Invalid subscription request: ") + exc.what());
+	}
+
+	if (destination.empty()) {
+		destination = endpointLabel(from);
+	}
+	if (!isAllowed(destination, from)) {
+		return errorReply("Destination not allowed: " + destination
+			+ ". Subscribe from the destination's address, or configure it in '_subscription_destinations'.");
+	}
+	if (format != "json" && format != "binary") {
+		return errorReply("Invalid format: " + format + ". Valid formats are 'json' and 'binary'.");
+	}
+	if (rate < 0) {
+		return errorReply("Rate cannot be negative.");
+	}
+	// A subscription must get at least one frame per lease, which also keeps 1e9 / rate in range
+	double min_rate(1e9 / std::max(m_timeout_ns, (int64_t)1000000000));
+	if (rate > 0 && rate < min_rate) {
+		std::ostringstream text;
+		text << "Rate must be at least " << min_rate << " Hz (one frame per subscription timeout), or 0 for every frame.";
+		return errorReply(text.str());
+	}
+
+	// Frames can't be sent faster than they are produced
+	if (update_freq > 0 && (rate == 0 || rate > update_freq)) {
+		rate = update_freq;
+	}
+
+	int64_t now(FrameScheduler::monotonicNow());
+	std::string request(req.dump());
+	size_t ix(0);
+	while (ix < m_subs.size() && m_subs[ix]->destination != destination) {
+		ix++;
+	}
+
+	if (ix < m_subs.size() && m_subs[ix]->request == request) {
+		m_subs[ix]->expires_ns = now + m_timeout_ns;
+	}
+	else {
+		std::unique_ptr<Subscriber> sub(new Subscriber);
+		std::string error, addr;
+		unsigned port;
+
+		if (ix == m_subs.size() && m_subs.size() >= MAX_SUBSCRIBERS) {
+			return errorReply("Too many subscribers.");
+		}
+
+		sub->destination = destination;
+		sub->request = request;
+		sub->proj = proj;
+		sub->binary = (format == "binary");
+		sub->rate = (update_freq > 0 && rate >= update_freq) ? 0 : rate;
+		sub->interval_ns = (sub->rate > 0) ? (int64_t)(1e9 / sub->rate) : 0;
+		sub->next_due_ns = now;
+		sub->expires_ns = now + m_timeout_ns;
+		sub->last_schema_ns = now - m_schema_interval_ns;
+
+		if (destination.compare(0, 5, "unix:") == 0) {
+			if (!sub->publisher.addUnixDestination(destination.substr(5), error)) {
+				return errorReply(error);
+			}
+		}
+		else if (!Publisher::parseEndpoint(destination, addr, port)
+				|| !sub->publisher.addDestination(addr, port, error)) {
+			return errorReply(error.empty() ? "Invalid destination: " + destination
+				+ ". Expected 'address:port' or 'unix:path'." : error);
+		}
+
+		sub->encoder.setMaxMessageSize(m_max_message_size);
+		sub->emitter.setMaxMessageSize(m_max_message_size);
+		if (!sub->publisher.open(error)
+				|| (sub->binary && !sub->encoder.configure(devices, proj, error))
+				|| (!sub->binary && !sub->emitter.compile(devices, sub->info, proj, error))) {
+			return errorReply(error);
+		}
+
+		if (ix < m_subs.size()) {
+			sub->info.seq = m_subs[ix]->info.seq;
+			m_subs[ix] = std::move(sub);
+			Logger::instance().log(Logger::L_INFO, "Updated subscription of " + destination);
+		}
+		else {
+			m_subs.emplace_back(std::move(sub));
+			m_accepted++;
+			Logger::instance().log(Logger::L_INFO, "New subscription from " + destination);
+		}
+	}
+
+	json reply;
+	reply["subscribed"]["destination"] = destination;
+	reply["subscribed"]["rate"] = rate;
+	reply["subscribed"]["timeout"] = m_timeout_ns / 1000000000ll;
+
+	return reply;
+}
+
+/**
+ * End a subscription before its lease runs out.
+ *
+ * Returns: the reply to send to the client.
+ **/
+json SubscriptionManager::unsubscribe(const json &req, const sockaddr_in &from)
+{
+	std::string destination;
+
+	if (req.is_object()) {
+		try {
+			destination = req.value("destination", "");
+		}
+		catch (const json::exception &exc) {
+			return errorReply(std::string("Invalid unsubscribe request: ") + exc.what());
+		}
+	}
+	if (destination.empty()) {
+		destination = endpointLabel(from);
+	}
+	if (!isAllowed(destination, from)) {
+		return errorReply("Destination not allowed: " + destination);
+	}
+
+	for (size_t ix = 0; ix < m_subs.size(); ++ix) {
+		if (m_subs[ix]->destination == destination) {
+			m_subs.erase(m_subs.begin() + ix);
+			Logger::instance().log(Logger::L_INFO, "Ended subscription of " + destination);
+
+			json reply;
+			reply["unsubscribed"]["destination"] = destination;
+			return reply;
+		}
+	}
+
+	return errorReply("Not subscribed: " + destination);
+}
+
+/**
+ * Drop the subscriptions whose lease has run out. Called on every frame,
+ * as well as after handling requests.
+ **/
+void SubscriptionManager::expire(int64_t now)
+{
+	for (size_t ix = 0; ix < m_subs.size(); ) {
+		if (now >= m_subs[ix]->expires_ns) {
+			Logger::instance().log(Logger::L_INFO, "Subscription of " + m_subs[ix]->destination
+				+ " expired.");
+			m_subs.erase(m_subs.begin() + ix);
+		}
+		else {
+			ix++;
+		}
+	}
+}
+
+/**
+ * Send the current frame to every subscriber that is due for one. Each
+ * subscriber is scheduled against absolute deadlines of its own, so its
+ * average rate matches the requested one as closely as the main loop's
+ * frame times allow.
+ *
+ * Params:
+ * 		devices - configured devices, as passed to handleRequests()
+ * 		info - timestamps of the frame. Subscribers number their frames
+ * 			themselves, so that decimation doesn't look like loss
+ **/
+void SubscriptionManager::publish(const std::vector<VRDevice> &devices, const FrameInfo &info)
+{
+	if (m_subs.empty()) {
+		return;
+	}
+
+	int64_t now(FrameScheduler::monotonicNow());
+
+	for (std::unique_ptr<Subscriber> &sub_ptr : m_subs) {
+		Subscriber &sub(*sub_ptr);
+
+		if (now < sub.next_due_ns) {
+			continue;
+		}
+
+		// Resynchronize after a stall rather than sending a burst of frames
+		sub.next_due_ns += sub.interval_ns;
+		if (sub.next_due_ns < now) {
+			sub.next_due_ns = now + sub.interval_ns;
+		}
+
+		sub.info.capture_ns = info.capture_ns;
+		sub.info.pose_time_ns = info.pose_time_ns;
+
+		if (sub.binary) {
+			if (now - sub.last_schema_ns >= m_schema_interval_ns) {
+				for (size_t chunk = 0; chunk < sub.encoder.numSchemaChunks(); ++chunk) {
+					sub.publisher.send(sub.encoder.schemaData(chunk), sub.encoder.schemaSize(chunk));
+				}
+				sub.last_schema_ns = now;
+			}
+
+			if (sub.encoder.encodeFrame(devices, sub.info) > 0) {
+				for (size_t chunk = 0; chunk < sub.encoder.numFrameChunks(); ++chunk) {
+					sub.publisher.send(sub.encoder.frameChunkData(chunk), sub.encoder.frameChunkSize(chunk));
+				}
+				sub.info.seq++;
+			}
+		}
+		else if (sub.emitter.emit() > 0) {
+			for (size_t chunk = 0; chunk < sub.emitter.numChunks(); ++chunk) {
+				sub.publisher.send(sub.emitter.chunkData(chunk), sub.emitter.chunkSize(chunk));
+			}
+			sub.info.seq++;
+		}
+	}
+}
+
+/**
+ * Returns: the number of subscriptions, and one line of send counters per
+ * 		current subscriber.
+ **/
+std::string SubscriptionManager::summary() const
+{
+	std::string text(std::to_string(m_subs.size()) + " active, "
+		+ std::to_string(m_accepted) + " accepted");
+
+	for (const std::unique_ptr<Subscriber> &sub : m_subs) {
+		text += "\n" + sub->publisher.summary();
+	}
+
+	return text;
+}
@@ -369,7 +369,7 @@ void checkButton(ParamInfo &params, VRDevice &controller)
                 params.button_selected = true;
                 printText("|", 2);
 
-                if (controller.buttons.find(params.cur_button) != controller.buttons.end()) {
+                if (controller.hasButton(params.cur_button)) {
                     std::string query = 
                         "This button has already been configured. Would you like to\n"
                         "edit the entry for this button?";
@@ -402,15 +402,8 @@ void buttonInfoQuery(ParamInfo &params, VRDevice &controller, std::map<std::stri
 {
     std::string query;
     std::string help_text;
-    VRButton *button_entry;
     vr::EVRButtonId button = params.cur_button;
-
-    if (controller.buttons.find(button) != controller.buttons.end()) {
-        button_entry = controller.buttons.at(button);
-    }
-    else {
-        button_entry = new VRButton();
-    }
+    VRButton *button_entry = &controller.buttons[button];
 
     query =
         "Default data type configuration for " + params.button_names.at(button) + ":\n"
@@ -425,11 +418,11 @@ void buttonInfoQuery(ParamInfo &params, VRDevice &controller, std::map<std::stri
         "file. Alternatively, you may run this program in manual mode.";
     button_entry->name = promptText(query, help_text);
     button_entry->id = button;
-    button_entry->val_types["boolean"] = types["boolean"];
-    button_entry->val_types["pressure"] = types["pressure"];
-    button_entry->val_types["2d"] = types["2d"];
+    button_entry->val_types[VRButton::V_BOOLEAN] = types["boolean"];
+    button_entry->val_types[VRButton::V_PRESSURE] = types["pressure"];
+    button_entry->val_types[VRButton::V_2D] = types["2d"];
 
-    controller.buttons[button] = button_entry;
+    controller.button_mask |= vr::ButtonMaskFromId(button);
 }
 
 void promptButtonInfo(ParamInfo &params, VRDevice &controller)
@@ -563,7 +556,7 @@ void writeToFile(const ParamInfo &params)
 
     for (int i = 0; i < params.devices.size(); i++) {
         std::string dev_ix = "dev" + std::to_string(i);
-        VRDevice cur_dev = params.devices[i];
+        const VRDevice &cur_dev = params.devices[i];
 
         j[dev_ix]["_name"] = cur_dev.name;
         j[dev_ix]["_role"] = roleEnumToName(cur_dev.role);
@@ -574,19 +567,19 @@ void writeToFile(const ParamInfo &params)
 
         j[dev_ix]["_track_pose"] = cur_dev.track_pose;
 
-        std::map<vr::EVRButtonId, VRButton*>::iterator it = cur_dev.buttons.begin();
-        for ( ; it != cur_dev.buttons.end(); it++) {
-            VRButton *cur_but = it->second;
+        std::vector<vr::EVRButtonId>::const_iterator it = params.button_map.begin();
+        for ( ; it != params.button_map.end(); it++) {
+            if (!cur_dev.hasButton(*it)) {
+                continue;
+            }
+
+            const VRButton *cur_but = &cur_dev.buttons[*it];
             std::string but_id = params.button_names.at(cur_but->id);
 
             j[dev_ix]["buttons"][but_id]["name"] = cur_but->name;
 
-            std::map<std::string, bool>::iterator t_it = cur_but->val_types.begin();
-            for ( ; t_it != cur_but->val_types.end(); t_it++) {
-                std::string but_name = t_it->first;
-                bool type_valid = t_it->second;
-
-                j[dev_ix]["buttons"][but_id]["types"][but_name] = type_valid;
+            for (int type = 0; type < VRButton::TYPE_NUM; type++) {
+                j[dev_ix]["buttons"][but_id]["types"][VRButton::typeName(type)] = cur_but->val_types[type];
             }
         }
     }
@@ -0,0 +1,583 @@
+#include <cmath>
+
+#include "mimicry_openvr/mimicry_app.hpp"
+#include "mimicry_openvr/wire_encoder.hpp"
+
+namespace wire = mimicry::wire;
+
+
+/**
+ * Get the protocol type bits for the value types published by a button.
+ **/
+uint8_t WireEncoder::buttonTypeBits(const VRButton &button)
+{
+	uint8_t types(0);
+
+	if (button.val_types[VRButton::V_BOOLEAN]) {
+		types |= wire::T_BOOLEAN;
+	}
+	if (button.val_types[VRButton::V_PRESSURE]) {
+		types |= wire::T_PRESSURE;
+	}
+	if (button.val_types[VRButton::V_2D]) {
+		types |= wire::T_2D;
+	}
+
+	return types;
+}
+
+/**
+ * Get the buttons of a device that are published under the configured
+ * projection.
+ **/
+uint64_t WireEncoder::buttonMask(const VRDevice &dev) const
+{
+	return (m_fields & Projection::F_BUTTONS) ? dev.button_mask : 0;
+}
+
+/**
+ * 32-bit FNV-1a hash, used to identify a schema.
+ **/
+static uint32_t fnv1a(const uint8_t *data, size_t len)
+{
+	uint32_t hash(2166136261u);
+
+	for (size_t i = 0; i < len; ++i) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+
+	return hash;
+}
+
+/**
+ * Build the schema message for the configured devices and size the frame
+ * buffer for the largest possible frame.
+ * 
+ * Params:
+ * 		devices - configured devices, indexed by slot
+ * 		error - set to a description of the problem on failure
+ * 
+ * Returns: true if the devices can be described by the protocol, false
+ * 		otherwise.
+ **/
+bool WireEncoder::configure(const std::vector<VRDevice> &devices, std::string &error)
+{
+	return configure(devices, Projection(), error);
+}
+
+/**
+ * Build the schema message for the devices selected by a projection. Only
+ * those devices are described and encoded, with their button values if
+ * F_BUTTONS is selected and their velocities if F_VELOCITY is. Poses are
+ * part of the fixed record layout, so they are always encoded.
+ **/
+bool WireEncoder::configure(const std::vector<VRDevice> &devices, const Projection &proj,
+	std::string &error)
+{
+	size_t schema_size(wire::HEADER_SIZE);
+	size_t frame_size(wire::HEADER_SIZE + wire::FRAME_INFO_SIZE);
+	uint16_t count(0);
+
+	m_devices = proj.devices;
+	m_fields = proj.fields;
+
+	for (size_t slot = 0; slot < devices.size(); ++slot) {
+		const VRDevice &dev(devices[slot]);
+		uint64_t button_mask(buttonMask(dev));
+		unsigned num_buttons(__builtin_popcountll(button_mask));
+		size_t num_analog(0);
+
+		if (!proj.hasDevice(slot)) {
+			continue;
+		}
+
+		if (dev.name.size() > UINT8_MAX) {
+			error = "Device name too long for binary output: " + dev.name;
+			return false;
+		}
+		if (num_buttons > wire::MAX_BUTTONS) {
+			error = "Too many buttons for binary output on device " + dev.name;
+			return false;
+		}
+
+		schema_size += 4 + dev.name.size();
+		for (uint64_t mask(button_mask); mask != 0; mask &= mask - 1) {
+			const VRButton &button(dev.buttons[__builtin_ctzll(mask)]);
+
+			if (button.name.size() > UINT8_MAX) {
+				error = "Button name too long for binary output: " + button.name;
+				return false;
+			}
+
+			schema_size += 3 + button.name.size();
+			num_analog += wire::analogCount(buttonTypeBits(button));
+		}
+
+		frame_size += wire::RECORD_PREFIX_SIZE + m_pose.poseSize() + 4 * num_analog;
+		if (proj.hasField(Projection::F_VELOCITY)) {
+			frame_size += wire::RECORD_VELOCITY_SIZE;
+		}
+		count++;
+	}
+
+	m_schema.resize(schema_size);
+	m_frame.resize(frame_size);
+
+	std::vector<size_t> entries; // Offset of each device entry in m_schema
+	uint8_t *p(m_schema.data() + wire::HEADER_SIZE);
+	for (size_t slot = 0; slot < devices.size(); ++slot) {
+		const VRDevice &dev(devices[slot]);
+		uint64_t button_mask(buttonMask(dev));
+
+		if (!proj.hasDevice(slot)) {
+			continue;
+		}
+
+		entries.push_back(p - m_schema.data());
+		wire::putU8(p, slot);
+		wire::putU8(p, dev.role);
+		wire::putU8(p, __builtin_popcountll(button_mask));
+		wire::putU8(p, dev.name.size());
+		memcpy(p, dev.name.data(), dev.name.size());
+		p += dev.name.size();
+
+		for (uint64_t mask(button_mask); mask != 0; mask &= mask - 1) {
+			const VRButton &button(dev.buttons[__builtin_ctzll(mask)]);
+
+			wire::putU8(p, button.id);
+			wire::putU8(p, buttonTypeBits(button));
+			wire::putU8(p, button.name.size());
+			memcpy(p, button.name.data(), button.name.size());
+			p += button.name.size();
+		}
+	}
+
+	m_schema_id = fnv1a(m_schema.data() + wire::HEADER_SIZE, schema_size - wire::HEADER_SIZE);
+
+	p = m_schema.data();
+	wire::putHeader(p, wire::MSG_SCHEMA, m_schema_id, count);
+
+	m_schema_chunks.assign(1, std::make_pair((size_t)0, schema_size));
+	if (m_max_size > 0 && schema_size > m_max_size && !splitSchema(entries, count, error)) {
+		return false;
+	}
+
+	// Deltas carry the keyframe seq on top of the frame info, and their entries are
+	// never larger than full records
+	m_frame.resize(frame_size + wire::DELTA_INFO_SIZE - wire::FRAME_INFO_SIZE);
+	m_records.reserve(count);
+	m_frame_chunks.reserve(count);
+	m_chunk_buffer.resize(m_frame.size() + count * (wire::HEADER_SIZE + wire::DELTA_INFO_SIZE));
+
+	m_key.assign(devices.size(), DeviceValues());
+	for (DeviceValues &key : m_key) {
+		key.valid = false;
+	}
+	m_have_key = false;
+
+	return true;
+}
+
+/**
+ * Split the schema message built by configure() into chunks of whole
+ * device entries, each at most the maximum message size. The chunks are
+ * appended to m_schema after the unsplit message.
+ *
+ * Params:
+ * 		entries - offset of each device entry in m_schema
+ * 		count - number of device entries
+ * 		error - set to a description of the problem on failure
+ *
+ * Returns: true if the schema could be split, false if an entry is too
+ * 		large for a message of its own.
+ **/
+bool WireEncoder::splitSchema(const std::vector<size_t> &entries, uint16_t count, std::string &error)
+{
+	std::vector<size_t> firsts; // First entry of each chunk
+	size_t body_end(m_schema.size());
+	size_t size(0);
+
+	for (size_t i = 0; i < count; ++i) {
+		size_t entry_size((i + 1 < count ? entries[i + 1] : body_end) - entries[i]);
+
+		if (wire::HEADER_SIZE + entry_size > m_max_size) {
+			error = "Schema entry of device slot " + std::to_string(m_schema[entries[i]])
+				+ " does not fit in the maximum message size.";
+			return false;
+		}
+		if (firsts.empty() || size + entry_size > m_max_size) {
+			firsts.push_back(i);
+			size = wire::HEADER_SIZE;
+		}
+		size += entry_size;
+	}
+
+	if (firsts.size() > wire::MAX_CHUNKS) {
+		error = "Schema needs more than " + std::to_string(wire::MAX_CHUNKS) + " messages.";
+		return false;
+	}
+
+	m_schema_chunks.clear();
+	m_schema.resize(body_end + firsts.size() * wire::HEADER_SIZE + (body_end - wire::HEADER_SIZE));
+
+	size_t offset(body_end);
+	for (size_t c = 0; c < firsts.size(); ++c) {
+		size_t first(firsts[c]);
+		size_t end(c + 1 < firsts.size() ? firsts[c + 1] : count);
+		size_t begin_off(entries[first]);
+		size_t end_off(end < count ? entries[end] : body_end);
+		uint8_t *p(m_schema.data() + offset);
+
+		wire::putHeader(p, wire::MSG_SCHEMA, m_schema_id, end - first, c, firsts.size());
+		memcpy(p, m_schema.data() + begin_off, end_off - begin_off);
+
+		m_schema_chunks.push_back(std::make_pair(offset, wire::HEADER_SIZE + end_off - begin_off));
+		offset += wire::HEADER_SIZE + end_off - begin_off;
+	}
+
+	return true;
+}
+
+/**
+ * Encode the current state of every active device with a valid pose into
+ * the frame buffer: as a FRAME message, or with delta encoding enabled, as
+ * a DELTA message relative to the last keyframe unless a keyframe is due.
+ * 
+ * Params:
+ * 		devices - configured devices, as passed to configure()
+ * 		info - sequence number and timestamps of the frame
+ * 
+ * Returns: size of the encoded frame in bytes, or 0 if no device was
+ * 		encoded. The data is available through frameData() until the next
+ * 		call.
+ **/
+size_t WireEncoder::encodeFrame(const std::vector<VRDevice> &devices, const FrameInfo &info)
+{
+	bool keyframe(!m_delta.enabled() || keyframeDue(info));
+	size_t info_size(keyframe ? wire::FRAME_INFO_SIZE : wire::DELTA_INFO_SIZE);
+	uint8_t *p(m_frame.data() + wire::HEADER_SIZE + info_size);
+	uint16_t count(0);
+	unsigned active(0);
+	DeviceValues vals;
+
+	m_records.clear();
+	m_frame_chunks.clear();
+	m_split = false;
+
+	for (size_t slot = 0; slot < devices.size(); ++slot) {
+		const VRDevice &dev(devices[slot]);
+
+		if (!((m_devices >> slot) & 1)) {
+			continue;
+		}
+
+		DeviceValues &key(m_key[slot]);
+		if (!dev.isActive() || !dev.pose_valid) {
+			if (keyframe) {
+				key.valid = false;
+			}
+			else if (key.valid) {
+				m_records.push_back(p - m_frame.data());
+				putDelta(p, slot, wire::D_REMOVED, vals);
+				count++;
+			}
+			continue;
+		}
+
+		readValues(dev, vals);
+		active++;
+
+		if (keyframe) {
+			m_records.push_back(p - m_frame.data());
+			putRecord(p, slot, vals);
+			count++;
+			if (m_delta.enabled()) {
+				key = vals;
+			}
+			continue;
+		}
+
+		uint8_t changes(changedFields(vals, key));
+		if (changes != 0) {
+			m_records.push_back(p - m_frame.data());
+			putDelta(p, slot, changes, vals);
+			count++;
+		}
+	}
+
+	if (active == 0) {
+		// Receivers only learn that every device is gone from the next keyframe
+		m_have_key = false;
+		return 0;
+	}
+
+	size_t len(p - m_frame.data());
+
+	p = m_frame.data();
+	wire::putHeader(p, keyframe ? wire::MSG_FRAME : wire::MSG_DELTA, m_schema_id, count, 0, 1, m_pose.word());
+	wire::putU64(p, info.seq);
+	wire::putU64(p, info.capture_ns);
+	wire::putU64(p, info.pose_time_ns);
+
+	if (keyframe) {
+		m_have_key = true;
+		m_key_seq = info.seq;
+		m_key_ns = info.capture_ns;
+		m_since_key = 0;
+	}
+	else {
+		wire::putU64(p, m_key_seq);
+		m_since_key++;
+	}
+
+	if (m_max_size == 0 || len <= m_max_size) {
+		m_frame_chunks.emplace_back(0, len);
+	}
+	else {
+		splitFrame(len, keyframe ? wire::MSG_FRAME : wire::MSG_DELTA, info_size);
+	}
+
+	return len;
+}
+
+/**
+ * Check whether the next frame has to be a keyframe under the delta
+ * options: because there is no keyframe yet, or because the last one is
+ * too many frames or too long ago.
+ **/
+bool WireEncoder::keyframeDue(const FrameInfo &info) const
+{
+	return !m_have_key
+		|| (m_delta.keyframe_frames != 0 && m_since_key + 1 >= m_delta.keyframe_frames)
+		|| (m_delta.keyframe_ms != 0
+			&& info.capture_ns - m_key_ns >= m_delta.keyframe_ms * 1000000ll);
+}
+
+/**
+ * Collect the values of a device that are published under the configured
+ * projection, in the order they are encoded.
+ **/
+void WireEncoder::readValues(const VRDevice &dev, DeviceValues &vals) const
+{
+	unsigned bit(0);
+
+	vals.valid = true;
+	vals.num_analog = 0;
+	vals.pressed = 0;
+
+	vals.pos[0] = dev.pose.pos.x;
+	vals.pos[1] = dev.pose.pos.y;
+	vals.pos[2] = dev.pose.pos.z;
+	vals.quat[0] = dev.pose.quat.x;
+	vals.quat[1] = dev.pose.quat.y;
+	vals.quat[2] = dev.pose.quat.z;
+	vals.quat[3] = dev.pose.quat.w;
+	vals.vel[0] = dev.pose.vel.x;
+	vals.vel[1] = dev.pose.vel.y;
+	vals.vel[2] = dev.pose.vel.z;
+	vals.vel[3] = dev.pose.ang_vel.x;
+	vals.vel[4] = dev.pose.ang_vel.y;
+	vals.vel[5] = dev.pose.ang_vel.z;
+
+	for (uint64_t mask(buttonMask(dev)); mask != 0; mask &= mask - 1, ++bit) {
+		const VRButton &button(dev.buttons[__builtin_ctzll(mask)]);
+
+		if (button.pressed) {
+			vals.pressed |= 1u << bit;
+		}
+		if (button.val_types[VRButton::V_PRESSURE]) {
+			vals.analog[vals.num_analog++] = button.pressure;
+		}
+		if (button.val_types[VRButton::V_2D]) {
+			vals.analog[vals.num_analog++] = button.touch_pos.x;
+			vals.analog[vals.num_analog++] = button.touch_pos.y;
+		}
+	}
+}
+
+static bool exceeds(const float *a, const float *b, unsigned n, float epsilon)
+{
+	for (unsigned i = 0; i < n; ++i) {
+		if (std::fabs(a[i] - b[i]) > epsilon) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * Compare the values of a device with its keyframe values.
+ *
+ * Returns: DeltaBits of the fields to send; all of them if the device was
+ * 		not in the keyframe.
+ **/
+uint8_t WireEncoder::changedFields(const DeviceValues &vals, const DeviceValues &key) const
+{
+	bool all(!key.valid);
+	uint8_t changes(0);
+
+	if (all || exceeds(vals.pos, key.pos, 3, m_delta.position_epsilon)) {
+		changes |= wire::D_POSITION;
+	}
+	if (all || exceeds(vals.quat, key.quat, 4, m_delta.orientation_epsilon)) {
+		changes |= wire::D_ORIENTATION;
+	}
+	if ((m_fields & Projection::F_VELOCITY)
+			&& (all || exceeds(vals.vel, key.vel, 6, m_delta.velocity_epsilon))) {
+		changes |= wire::D_VELOCITY;
+	}
+	if (all || vals.pressed != key.pressed) {
+		changes |= wire::D_BUTTONS;
+	}
+	if (vals.num_analog > 0
+			&& (all || exceeds(vals.analog, key.analog, vals.num_analog, m_delta.analog_epsilon))) {
+		changes |= wire::D_ANALOG;
+	}
+
+	return changes;
+}
+
+/**
+ * Write the position of a device in the configured pose format.
+ **/
+void WireEncoder::putPosition(uint8_t *&p, const DeviceValues &vals) const
+{
+	if (m_pose.quantized()) {
+		wire::putPosition(p, vals.pos, m_pose);
+		return;
+	}
+
+	for (unsigned i = 0; i < 3; ++i) {
+		wire::putF32(p, vals.pos[i]);
+	}
+}
+
+/**
+ * Write the orientation of a device in the configured pose format.
+ **/
+void WireEncoder::putOrientation(uint8_t *&p, const DeviceValues &vals) const
+{
+	if (m_pose.quantized()) {
+		wire::putOrientation(p, vals.quat, m_pose);
+		return;
+	}
+
+	for (unsigned i = 0; i < 4; ++i) {
+		wire::putF32(p, vals.quat[i]);
+	}
+}
+
+/**
+ * Write the full FRAME entry of a device.
+ **/
+void WireEncoder::putRecord(uint8_t *&p, size_t slot, const DeviceValues &vals) const
+{
+	bool velocity(m_fields & Projection::F_VELOCITY);
+
+	wire::putU8(p, slot);
+	wire::putU8(p, wire::F_POSE_VALID | (velocity ? wire::F_VELOCITY : 0));
+	wire::putU8(p, vals.num_analog);
+	wire::putU8(p, 0);
+	wire::putU32(p, vals.pressed);
+	putPosition(p, vals);
+	putOrientation(p, vals);
+	if (velocity) {
+		for (unsigned i = 0; i < 6; ++i) {
+			wire::putF32(p, vals.vel[i]);
+		}
+	}
+	for (unsigned i = 0; i < vals.num_analog; ++i) {
+		wire::putF32(p, vals.analog[i]);
+	}
+}
+
+/**
+ * Write the DELTA entry of a device, holding only the given fields.
+ **/
+void WireEncoder::putDelta(uint8_t *&p, size_t slot, uint8_t changes, const DeviceValues &vals) const
+{
+	wire::putU8(p, slot);
+	wire::putU8(p, changes);
+	wire::putU8(p, (changes & wire::D_ANALOG) ? vals.num_analog : 0);
+	wire::putU8(p, 0);
+
+	if (changes & wire::D_POSITION) {
+		putPosition(p, vals);
+	}
+	if (changes & wire::D_ORIENTATION) {
+		putOrientation(p, vals);
+	}
+	if (changes & wire::D_VELOCITY) {
+		for (unsigned i = 0; i < 6; ++i) {
+			wire::putF32(p, vals.vel[i]);
+		}
+	}
+	if (changes & wire::D_BUTTONS) {
+		wire::putU32(p, vals.pressed);
+	}
+	if (changes & wire::D_ANALOG) {
+		for (unsigned i = 0; i < vals.num_analog; ++i) {
+			wire::putF32(p, vals.analog[i]);
+		}
+	}
+}
+
+/**
+ * Split the frame encoded in m_frame into chunks of whole device records,
+ * each at most the maximum message size and carrying the frame's info
+ * block. A record too large for a chunk of its own is sent alone anyway.
+ *
+ * Params:
+ * 		len - size of the unsplit frame
+ * 		type - MSG_FRAME or MSG_DELTA
+ * 		info_size - size of the info block after the header
+ **/
+void WireEncoder::splitFrame(size_t len, wire::MsgType type, size_t info_size)
+{
+	const size_t prefix(wire::HEADER_SIZE + info_size);
+	size_t size(0);
+
+	// First pass: the first record and number of records of each chunk
+	for (size_t i = 0; i < m_records.size(); ++i) {
+		size_t record_size((i + 1 < m_records.size() ? m_records[i + 1] : len) - m_records[i]);
+
+		if (m_frame_chunks.empty() || size + record_size > m_max_size) {
+			m_frame_chunks.emplace_back(i, 0);
+			size = prefix;
+		}
+		m_frame_chunks.back().second++;
+		size += record_size;
+	}
+
+	if (m_frame_chunks.size() > wire::MAX_CHUNKS) {
+		// Can't be numbered; send the frame whole and leave it to IP fragmentation
+		m_frame_chunks.assign(1, std::make_pair((size_t)0, len));
+		return;
+	}
+
+	// Second pass: write the chunks, replacing the record ranges with their offsets and sizes
+	size_t num_chunks(m_frame_chunks.size());
+	size_t offset(0);
+	for (size_t c = 0; c < num_chunks; ++c) {
+		size_t first(m_frame_chunks[c].first);
+		size_t end(first + m_frame_chunks[c].second);
+		size_t begin_off(m_records[first]);
+		size_t end_off(end < m_records.size() ? m_records[end] : len);
+		uint8_t *p(m_chunk_buffer.data() + offset);
+
+		wire::putHeader(p, type, m_schema_id, end - first, c, num_chunks, m_pose.word());
+		memcpy(p, m_frame.data() + wire::HEADER_SIZE, info_size);
+		memcpy(p + info_size, m_frame.data() + begin_off, end_off - begin_off);
+
+		m_frame_chunks[c] = std::make_pair(offset, prefix + end_off - begin_off);
+		offset += prefix + end_off - begin_off;
+	}
+
+	m_split = true;
+}
+
+const uint8_t * WireEncoder::frameChunkData(size_t chunk) const
+{
+	return (m_split ? m_chunk_buffer.data() : m_frame.data()) + m_frame_chunks[chunk].first;
+}